@@ -1,16 +1,88 @@
 #ifndef BVH_H
 #define BVH_H
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
 #include <stdint.h>
 #include <limits>
+#include <thread>
 #include <vector>
 #include "Vector3.h"
 
 namespace dae
 {
+	enum class BVHSplitMethod : uint8_t
+	{
+		Midpoint, //Split at the spatial center of the longest axis
+		BinnedSAH, //Surface Area Heuristic, evaluated at the borders of a fixed amount of bins per axis
+		Morton //Linear BVH over the Morton order of the centroids, O(n) and parallel; lower quality, meant for per frame rebuilds
+	};
+
+	enum class BVHLayout : uint8_t
+	{
+		Binary, //2 children per node, scalar box tests
+		Wide4, //Binary tree collapsed into 4 children per node, one SSE box test per node
+		Wide8, //Binary tree collapsed into 8 children per node, one AVX box test per node (scalar loop without AVX)
+		Quantized4 //Wide4 with 8 bit child bounds, 64 byte nodes; less memory and bandwidth for a few more box tests
+	};
+
+	struct BVHBuildSettings final
+	{
+		BVHSplitMethod splitMethod{ BVHSplitMethod::BinnedSAH };
+		BVHLayout layout{ BVHLayout::Binary }; //Traversal layout, the binary tree is always built first
+
+		uint32_t binCount{ 8 }; //Amount of candidate bins per axis (SAH only)
+		uint32_t maxLeafSize{ 4 }; //Subtrees with at most this many triangles become one leaf (Morton only)
+		float traversalCost{ 1.f }; //Cost of visiting an interior node (AABB test)
+		float intersectionCost{ 1.f }; //Cost of testing a single triangle in a leaf
+
+		uint32_t threadCount{ 0 }; //Build threads, 0 uses every hardware thread; does not change the tree
+	};
+
+	struct AABB final
+	{
+		Vector3 min{ 1e30f, 1e30f, 1e30f };
+		Vector3 max{ -1e30f, -1e30f, -1e30f };
+
+		void Grow(const Vector3& p)
+		{
+			min = Vector3::Min(min, p);
+			max = Vector3::Max(max, p);
+		}
+
+		void Grow(const AABB& other)
+		{
+			//Skip empty boxes so they don't poison the bounds
+			if (other.min.x > other.max.x)
+			{
+				return;
+			}
+
+			min = Vector3::Min(min, other.min);
+			max = Vector3::Max(max, other.max);
+		}
+
+		//Half of the surface area; the factor 2 cancels out in every SAH ratio
+		float HalfArea() const
+		{
+			Vector3 const e{ max - min };
+			if (e.x < 0.f)
+			{
+				return 0.f;
+			}
+
+			return e.x * e.y + e.y * e.z + e.z * e.x;
+		}
+	};
+
 	struct BVHNode final
 	{
+		//Deepest level a node can be at (the root is 0), the builders turn nodes there into leaves
+		//so every traversal can bound its stack by it instead of trusting the geometry
+		static constexpr uint32_t maxDepth{ 64 };
+
 		Vector3 aabbMin{};
 		Vector3 aabbMax{};
 
@@ -20,21 +92,53 @@ namespace dae
 		uint32_t triangleCount{ 0 };
 
 		bool IsLeaf() const
-		{ 
-			return triangleCount > 0; 
+		{
+			return triangleCount > 0;
 		}
 
-		void BuildBVH(std::vector<BVHNode>& bvh, std::vector<int>& indices, std::vector<Vector3>const& vertices, std::vector<Vector3>& normals, std::vector<Vector3>& transformedNormals)
+		//Builds the tree over all triangles into bvh, which is resized to fit; bvh[0] is the root
+		//The triangles (indices, normals, transformedNormals) are reordered so every leaf covers a contiguous range of them
+		//Big subtrees are built on other threads, the resulting tree does not depend on settings.threadCount
+		//pTriangleOrder, when given, is reordered along with the triangles so the caller can do the same to its own per triangle data
+		static void BuildBVH(std::vector<BVHNode>& bvh, std::vector<int>& indices, std::vector<Vector3>const& vertices, std::vector<Vector3>& normals, std::vector<Vector3>& transformedNormals, const BVHBuildSettings& settings = {}, std::vector<uint32_t>* pTriangleOrder = nullptr)
 		{
-			static constexpr uint32_t rootNodeIdx{ 0 };
+			if (settings.splitMethod == BVHSplitMethod::Morton)
+			{
+				BuildLBVH(bvh, indices, vertices, normals, transformedNormals, settings, pTriangleOrder);
+				return;
+			}
+
+			uint32_t const triangleCount{ static_cast<uint32_t>(normals.size()) };
+			uint32_t const threadCount{ GetThreadCount(settings) };
+			uint32_t const chunkCount{ std::clamp(triangleCount / taskGrain, 1u, threadCount) };
+
+			//The build only partitions the references, the mesh arrays are reordered once at the end
+			std::vector<TriangleRef> refs{ CreateTriangleRefs(indices, vertices, triangleCount, chunkCount) };
 
-			BVHNode& root{ bvh[rootNodeIdx] };
-			root.triangleCount = normals.size();
+			//A binary tree over N triangles never has more than 2N - 1 nodes, so the pool is allocated once and never moves
+			//Every node owns a fixed block of it for its descendants, subtrees never touch each other's nodes
+			std::vector<BVHNode> pool(std::max(triangleCount, 1u) * 2 - 1);
+			pool[0].triangleCount = triangleCount;
+			UpdateNodeBounds(pool[0], refs);
+
+			BuildContext context{ pool, refs, settings };
+			context.spareThreads = static_cast<int>(threadCount) - 1;
+
+			SubDivide(context, 0, 1, 0);
+
+			//Leaves cover contiguous ranges of refs, putting the triangles in the same order stores every leaf together
+			std::vector<uint32_t> sourceTriangles(triangleCount);
+			for (uint32_t i{ 0 }; i < triangleCount; ++i)
+			{
+				sourceTriangles[i] = refs[i].triangleIdx;
+			}
+			ReorderTriangles(sourceTriangles, indices, normals, transformedNormals, pTriangleOrder, chunkCount);
 
-			//Assign all to root node
-			UpdateNodeBounds(bvh, indices, vertices, rootNodeIdx);
-			//Recursively subdivide
-			SubDivide(bvh, indices, vertices, rootNodeIdx, normals, transformedNormals);
+			//Pack the used nodes in the order a serial depth first build creates them, children pairs stay adjacent and after their parent
+			bvh.resize(context.nodeCount);
+			uint32_t nextIdx{ 1 };
+			Compact(pool, bvh, 0, 0, nextIdx);
+			assert(nextIdx == bvh.size());
 		}
 
 		void UpdateNodeBounds(std::vector<BVHNode>& bvh, std::vector<int>const& indices, std::vector<Vector3>const& vertices, uint32_t nodeIdx)
@@ -44,7 +148,7 @@ namespace dae
 			BVHNode& node{ bvh[nodeIdx] };
 			node.aabbMin = { 1e30f, 1e30f, 1e30f };
 			node.aabbMax = { -1e30f, -1e30f, -1e30f };
-			
+
 			uint32_t const first{ node.leftFirst };
 			for (uint32_t i{ 0 }; i < node.triangleCount; ++i)
 			{
@@ -60,28 +164,130 @@ namespace dae
 			}
 		}
 
-		void SubDivide(std::vector<BVHNode>& bvh, std::vector<int>& indices, std::vector<Vector3>const& vertices, uint32_t nodeIdx, std::vector<Vector3>& normals, std::vector<Vector3>& transformedNormals)
+		//Recomputes all bounds for moved vertices while keeping the topology, O(n) in the amount of nodes
+		static void Refit(std::vector<BVHNode>& bvh, std::vector<int>const& indices, std::vector<Vector3>const& vertices)
 		{
-			BVHNode& node{ bvh[nodeIdx] };
+			//The root of an empty mesh is the only node without triangles or children
+			if (bvh.empty() || (bvh.size() == 1 && !bvh[0].IsLeaf()))
+			{
+				return;
+			}
+
+			//Children are always created after their parent, so walking backwards visits them before the parent
+			for (uint32_t i{ static_cast<uint32_t>(bvh.size()) }; i-- > 0;)
+			{
+				BVHNode& node{ bvh[i] };
+				if (node.IsLeaf())
+				{
+					node.UpdateNodeBounds(bvh, indices, vertices, i);
+					continue;
+				}
+
+				assert(node.leftFirst > i && "Built trees are dense, every interior node has both children");
+				BVHNode const& left{ bvh[node.leftFirst] };
+				BVHNode const& right{ bvh[node.leftFirst + 1] };
+				node.aabbMin = Vector3::Min(left.aabbMin, right.aabbMin);
+				node.aabbMax = Vector3::Max(left.aabbMax, right.aabbMax);
+			}
+		}
+
+		//Expected cost of a ray traversing the tree, relative to the root surface area (lower is better)
+		static float CalculateSAHCost(std::vector<BVHNode>const& bvh, const BVHBuildSettings& settings = {})
+		{
+			if (bvh.empty() || (bvh.size() == 1 && !bvh[0].IsLeaf()))
+			{
+				return 0.f;
+			}
+
+			float const rootArea{ NodeBounds(bvh[0]).HalfArea() };
+			if (rootArea <= 0.f)
+			{
+				return 0.f;
+			}
+
+			float cost{ 0.f };
+			for (auto const& node : bvh)
+			{
+				float const relativeArea{ NodeBounds(node).HalfArea() / rootArea };
+				cost += node.IsLeaf() ? relativeArea * node.triangleCount * settings.intersectionCost
+									  : relativeArea * settings.traversalCost;
+			}
+
+			return cost;
+		}
+
+	private:
+		//Subtrees with fewer triangles than this are always built on the thread that reaches them
+		static constexpr uint32_t parallelBuildThreshold{ 4096 };
+		//Triangles per thread below which splitting a linear pass over them is not worth starting a thread
+		static constexpr uint32_t taskGrain{ 16384 };
 
-			if (node.triangleCount <= 2)
+		//What the build needs of a triangle in one place, partitioning swaps these instead of the scattered mesh arrays
+		struct TriangleRef final
+		{
+			AABB bounds{};
+			Vector3 centroid{};
+			uint32_t triangleIdx{ 0 }; //where the triangle is in the mesh arrays
+		};
+
+		struct BuildContext final
+		{
+			std::vector<BVHNode>& pool;
+			std::vector<TriangleRef>& refs;
+			const BVHBuildSettings& settings;
+
+			std::atomic<uint32_t> nodeCount{ 1 };
+			std::atomic<int> spareThreads{ 0 };
+		};
+
+		//blockStart is the first pool slot of the 2 * triangleCount - 2 that belong to the descendants of nodeIdx
+		static void SubDivide(BuildContext& context, uint32_t nodeIdx, uint32_t blockStart, uint32_t depth)
+		{
+			if (depth >= maxDepth)
 			{
 				return;
 			}
 
-			//Splitting plane axis
-			Vector3 const extent{ node.aabbMax - node.aabbMin };
+			std::vector<BVHNode>& bvh{ context.pool };
+			std::vector<TriangleRef>& refs{ context.refs };
+			const BVHBuildSettings& settings{ context.settings };
+
+			BVHNode& node{ bvh[nodeIdx] };
+
 			int axis{ 0 };
-			if (extent.y > extent.x)
+			float splitPos{ 0.f };
+
+			if (settings.splitMethod == BVHSplitMethod::BinnedSAH)
 			{
-				axis = 1;
+				float const splitCost{ FindBestSplitPlane(node, refs, settings, axis, splitPos) };
+				float const leafCost{ node.triangleCount * settings.intersectionCost };
+
+				//Splitting is only worth it when it is cheaper than intersecting every triangle in this node
+				if (splitCost >= leafCost)
+				{
+					return;
+				}
 			}
-			if (extent.z > extent[axis])
+			else
 			{
-				axis = 2;
-			}
+				if (node.triangleCount <= 2)
+				{
+					return;
+				}
+
+				//Splitting plane axis
+				Vector3 const extent{ node.aabbMax - node.aabbMin };
+				if (extent.y > extent.x)
+				{
+					axis = 1;
+				}
+				if (extent.z > extent[axis])
+				{
+					axis = 2;
+				}
 
-			float const splitPos{ node.aabbMin[axis] + extent[axis] * .5f };
+				splitPos = node.aabbMin[axis] + extent[axis] * .5f;
+			}
 
 			uint32_t i{ node.leftFirst };
 			uint32_t j{ i + node.triangleCount - 1 };
@@ -89,30 +295,18 @@ namespace dae
 			//in place splitting of groups
 			while(i <= j)
 			{
-				//triangles[0] == indices[0, 1, 2] and so on
-				auto const idx{ i * 3 };
-				//Center is currently not stored inside the mesh, could be stored if necessary
-				Vector3 const center{ (vertices[indices[idx]] + vertices[indices[idx + 1]] + vertices[indices[idx + 2]]) / 3 };
-
-				if (center[axis] < splitPos)
+				if (refs[i].centroid[axis] < splitPos)
 				{
 					i++;
 				}
 				else
 				{
-					//Swap the indices - Example: indices [0, 1, 2] are swapped with [6, 7, 8] - with the way we currently store data this would mess up the normals
-					//So also swap the normal; indices[0, 1, 2] == normal [0] so say we swap indices 0-2 with indices 6-8 we swap normal 0 with normal 2
-					//Do the same with the transformxedNormals to avoid recalculating all normals
-					//this can be avoided by changing the mesh struct in the future - store a vector with triangles and work with the triangleIndex in the bvh
-
-					auto const idx2{ (j * 3) };
-					std::swap(indices[idx], indices[idx2]);
-					std::swap(indices[idx + 1], indices[idx2 + 1]);
-					std::swap(indices[idx + 2], indices[idx2 + 2]);
-
-					std::swap(normals[i], normals[j]);
-					std::swap(transformedNormals[i], transformedNormals[j]);
+					std::swap(refs[i], refs[j]);
 
+					if (j == 0)
+					{
+						break;
+					}
 					--j;
 				}
 			}
@@ -124,26 +318,513 @@ namespace dae
 				return;
 			}
 
-			//Create child nodes
-			bvh.emplace_back(BVHNode{});
-			auto const leftChildIdx = bvh.size() - 1;
-			bvh.emplace_back(BVHNode{});
-			auto const rightChildIdx = bvh.size() - 1;
+			uint32_t const first{ node.leftFirst };
+			uint32_t const count{ node.triangleCount };
+			uint32_t const rightCount{ count - leftCount };
+
+			//The children take the first two slots of the block, the rest is split between their own blocks
+			uint32_t const leftChildIdx{ blockStart };
+			uint32_t const rightChildIdx{ blockStart + 1 };
+			uint32_t const leftBlockStart{ blockStart + 2 };
+			uint32_t const rightBlockStart{ leftBlockStart + 2 * leftCount - 2 };
+			context.nodeCount += 2;
 
-			bvh[leftChildIdx].leftFirst = node.leftFirst;
+			bvh[leftChildIdx].leftFirst = first;
 			bvh[leftChildIdx].triangleCount = leftCount;
 			bvh[rightChildIdx].leftFirst = i;
-			bvh[rightChildIdx].triangleCount = node.triangleCount - leftCount;
+			bvh[rightChildIdx].triangleCount = rightCount;
+
+			node.leftFirst = leftChildIdx;
+			node.triangleCount = 0;
+			UpdateNodeBounds(bvh[leftChildIdx], refs);
+			UpdateNodeBounds(bvh[rightChildIdx], refs);
+
+			//Recurse, handing the right side to a new thread while there are cores left
+			if (rightCount >= parallelBuildThreshold && TryTakeThread(context))
+			{
+				std::thread rightThread{ [&context, rightChildIdx, rightBlockStart, depth]() { SubDivide(context, rightChildIdx, rightBlockStart, depth + 1); } };
+				SubDivide(context, leftChildIdx, leftBlockStart, depth + 1);
+				rightThread.join();
+				++context.spareThreads;
+				return;
+			}
+
+			SubDivide(context, leftChildIdx, leftBlockStart, depth + 1);
+			SubDivide(context, rightChildIdx, rightBlockStart, depth + 1);
+		}
+
+		static bool TryTakeThread(BuildContext& context)
+		{
+			int spare{ context.spareThreads.load() };
+			while (spare > 0)
+			{
+				if (context.spareThreads.compare_exchange_weak(spare, spare - 1))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		static void Compact(const std::vector<BVHNode>& pool, std::vector<BVHNode>& bvh, uint32_t poolIdx, uint32_t bvhIdx, uint32_t& nextIdx)
+		{
+			BVHNode const& node{ pool[poolIdx] };
+			bvh[bvhIdx] = node;
+
+			//A root that was never split (or has no triangles) ends the tree as well
+			if (node.IsLeaf() || node.leftFirst == 0)
+			{
+				return;
+			}
+
+			uint32_t const leftChildIdx{ nextIdx };
+			nextIdx += 2;
+			bvh[bvhIdx].leftFirst = leftChildIdx;
+
+			Compact(pool, bvh, node.leftFirst, leftChildIdx, nextIdx);
+			Compact(pool, bvh, node.leftFirst + 1, leftChildIdx + 1, nextIdx);
+		}
+
+		static uint32_t GetThreadCount(const BVHBuildSettings& settings)
+		{
+			return settings.threadCount > 0 ? settings.threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		//Runs task(0) to task(taskCount - 1) each on its own thread, task 0 on the calling one
+		template<typename Task>
+		static void RunTasks(uint32_t taskCount, const Task& task)
+		{
+			std::vector<std::thread> threads{};
+			threads.reserve(taskCount - 1);
+			for (uint32_t t{ 1 }; t < taskCount; ++t)
+			{
+				threads.emplace_back([&task, t]() { task(t); });
+			}
+
+			task(0);
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+		}
+
+		static std::vector<TriangleRef> CreateTriangleRefs(std::vector<int>const& indices, std::vector<Vector3>const& vertices, uint32_t triangleCount, uint32_t chunkCount)
+		{
+			std::vector<TriangleRef> refs(triangleCount);
+			RunTasks(chunkCount, [&](uint32_t chunk)
+			{
+				for (uint32_t i{ chunk * triangleCount / chunkCount }, end{ (chunk + 1) * triangleCount / chunkCount }; i < end; ++i)
+				{
+					TriangleRef& ref{ refs[i] };
+					ref.bounds.Grow(vertices[indices[i * 3]]);
+					ref.bounds.Grow(vertices[indices[i * 3 + 1]]);
+					ref.bounds.Grow(vertices[indices[i * 3 + 2]]);
+					ref.centroid = TriangleCenter(indices, vertices, i);
+					ref.triangleIdx = i;
+				}
+			});
+			return refs;
+		}
+
+		static void UpdateNodeBounds(BVHNode& node, std::vector<TriangleRef>const& refs)
+		{
+			AABB bounds{};
+			for (uint32_t i{ node.leftFirst }; i < node.leftFirst + node.triangleCount; ++i)
+			{
+				bounds.Grow(refs[i].bounds);
+			}
+			node.aabbMin = bounds.min;
+			node.aabbMax = bounds.max;
+		}
+
+		//Applies the order the build settled on to the mesh arrays, triangle i becomes the one that was at sourceTriangles[i]
+		static void ReorderTriangles(std::vector<uint32_t>const& sourceTriangles, std::vector<int>& indices, std::vector<Vector3>& normals, std::vector<Vector3>& transformedNormals, std::vector<uint32_t>* pTriangleOrder, uint32_t chunkCount)
+		{
+			uint32_t const triangleCount{ static_cast<uint32_t>(sourceTriangles.size()) };
+
+			std::vector<int> sortedIndices(indices.size());
+			std::vector<Vector3> sortedNormals(triangleCount);
+			std::vector<Vector3> sortedTransformedNormals(triangleCount);
+			std::vector<uint32_t> sortedOrder(pTriangleOrder ? triangleCount : 0);
+			RunTasks(chunkCount, [&](uint32_t chunk)
+			{
+				for (uint32_t i{ chunk * triangleCount / chunkCount }, end{ (chunk + 1) * triangleCount / chunkCount }; i < end; ++i)
+				{
+					uint32_t const source{ sourceTriangles[i] };
+					sortedIndices[i * 3] = indices[source * 3];
+					sortedIndices[i * 3 + 1] = indices[source * 3 + 1];
+					sortedIndices[i * 3 + 2] = indices[source * 3 + 2];
+					sortedNormals[i] = normals[source];
+					sortedTransformedNormals[i] = transformedNormals[source];
+					if (pTriangleOrder)
+					{
+						sortedOrder[i] = (*pTriangleOrder)[source];
+					}
+				}
+			});
+
+			indices.swap(sortedIndices);
+			normals.swap(sortedNormals);
+			transformedNormals.swap(sortedTransformedNormals);
+			if (pTriangleOrder)
+			{
+				pTriangleOrder->swap(sortedOrder);
+			}
+		}
+
+#pragma region LBVH
+		//Linear BVH after Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees" (HPG 2012)
+		//Triangles are sorted along a Morton curve through their centroids, every internal node of the resulting radix tree
+		//then finds its own range and split in the sorted codes independently of the others
+
+		static constexpr uint32_t lbvhLeafFlag{ 0x80000000u };
+
+		struct MortonKey final
+		{
+			uint64_t code{ 0 };
+			uint32_t triangleIdx{ 0 };
+		};
+
+		//Internal node of the radix tree, children are internal node indices or sorted triangle indices marked with lbvhLeafFlag
+		struct LBVHNode final
+		{
+			uint32_t first{ 0 };
+			uint32_t last{ 0 };
+			uint32_t children[2]{};
+		};
+
+		//Spreads the lower 21 bits of v so there are two zero bits between each of them
+		static uint64_t SpreadBits(uint64_t v)
+		{
+			v &= 0x1fffff;
+			v = (v | v << 32) & 0x1f00000000ffffull;
+			v = (v | v << 16) & 0x1f0000ff0000ffull;
+			v = (v | v << 8) & 0x100f00f00f00f00full;
+			v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+			v = (v | v << 2) & 0x1249249249249249ull;
+			return v;
+		}
+
+		//Length of the common prefix of the keys at i and j, -1 outside of the array
+		//Equal codes fall back on the indices, so every key is unique as far as the tree is concerned
+		static int CommonPrefix(const std::vector<MortonKey>& keys, int64_t i, int64_t j)
+		{
+			if (j < 0 || j >= static_cast<int64_t>(keys.size()))
+			{
+				return -1;
+			}
+
+			uint64_t const difference{ keys[i].code ^ keys[j].code };
+			if (difference == 0)
+			{
+				return 64 + std::countl_zero(static_cast<uint32_t>(i ^ j));
+			}
+			return std::countl_zero(difference);
+		}
+
+		//Stable LSD radix sort on the lowest keyBits of the codes, every pass counts and scatters one chunk per thread
+		static void RadixSort(std::vector<MortonKey>& keys, uint32_t keyBits, uint32_t chunkCount)
+		{
+			static constexpr uint32_t digitBits{ 11 };
+			static constexpr uint32_t radix{ 1u << digitBits };
+
+			std::vector<MortonKey> sorted(keys.size());
+			std::vector<uint32_t> offsets(chunkCount * radix);
+			uint32_t const keyCount{ static_cast<uint32_t>(keys.size()) };
+
+			for (uint32_t shift{ 0 }; shift < keyBits; shift += digitBits)
+			{
+				std::fill(offsets.begin(), offsets.end(), 0u);
+				RunTasks(chunkCount, [&](uint32_t chunk)
+				{
+					uint32_t* const pCounts{ offsets.data() + chunk * radix };
+					for (uint32_t i{ chunk * keyCount / chunkCount }, end{ (chunk + 1) * keyCount / chunkCount }; i < end; ++i)
+					{
+						++pCounts[(keys[i].code >> shift) & (radix - 1)];
+					}
+				});
+
+				//Exclusive prefix sum digit major, so chunk c writes its keys of a digit right after those of chunk c - 1
+				uint32_t sum{ 0 };
+				for (uint32_t digit{ 0 }; digit < radix; ++digit)
+				{
+					for (uint32_t chunk{ 0 }; chunk < chunkCount; ++chunk)
+					{
+						uint32_t const count{ offsets[chunk * radix + digit] };
+						offsets[chunk * radix + digit] = sum;
+						sum += count;
+					}
+				}
+
+				RunTasks(chunkCount, [&](uint32_t chunk)
+				{
+					uint32_t* const pOffsets{ offsets.data() + chunk * radix };
+					for (uint32_t i{ chunk * keyCount / chunkCount }, end{ (chunk + 1) * keyCount / chunkCount }; i < end; ++i)
+					{
+						sorted[pOffsets[(keys[i].code >> shift) & (radix - 1)]++] = keys[i];
+					}
+				});
+
+				keys.swap(sorted);
+			}
+		}
+
+		static void BuildLBVH(std::vector<BVHNode>& bvh, std::vector<int>& indices, std::vector<Vector3>const& vertices, std::vector<Vector3>& normals, std::vector<Vector3>& transformedNormals, const BVHBuildSettings& settings, std::vector<uint32_t>* pTriangleOrder)
+		{
+			uint32_t const triangleCount{ static_cast<uint32_t>(normals.size()) };
+			bvh.assign(1, BVHNode{});
+			if (triangleCount == 0)
+			{
+				return;
+			}
+
+			uint32_t const chunkCount{ std::clamp(triangleCount / taskGrain, 1u, GetThreadCount(settings)) };
+			auto const chunkBegin{ [=](uint32_t chunk) { return chunk * triangleCount / chunkCount; } };
+
+			std::vector<TriangleRef> const refs{ CreateTriangleRefs(indices, vertices, triangleCount, chunkCount) };
+
+			AABB centroidBounds{};
+			for (auto const& ref : refs)
+			{
+				centroidBounds.Grow(ref.centroid);
+			}
+
+			//30 bit codes give a 1024^3 grid, meshes with more than a million triangles get 63 bits so fewer of them share a cell
+			uint32_t const bitsPerAxis{ triangleCount > (1u << 20) ? 21u : 10u };
+			float const cellCount{ static_cast<float>((1u << bitsPerAxis) - 1) };
+			//One scale for all axes, cubic cells keep a flat mesh from spending as many splits on its thin axis as on the others
+			Vector3 const extent{ centroidBounds.max - centroidBounds.min };
+			float const maxExtent{ std::max({ extent.x, extent.y, extent.z }) };
+			float const scale{ maxExtent > 0.f ? cellCount / maxExtent : 0.f };
+
+			std::vector<MortonKey> keys(triangleCount);
+			RunTasks(chunkCount, [&](uint32_t chunk)
+			{
+				for (uint32_t i{ chunkBegin(chunk) }; i < chunkBegin(chunk + 1); ++i)
+				{
+					uint64_t cell[3]{};
+					for (int a{ 0 }; a < 3; ++a)
+					{
+						cell[a] = static_cast<uint64_t>(std::min((refs[i].centroid[a] - centroidBounds.min[a]) * scale, cellCount));
+					}
+					keys[i].code = SpreadBits(cell[0]) << 2 | SpreadBits(cell[1]) << 1 | SpreadBits(cell[2]);
+					keys[i].triangleIdx = i;
+				}
+			});
+
+			RadixSort(keys, bitsPerAxis * 3, chunkCount);
+
+			//Put the triangles in Morton order, so every subtree covers a contiguous range of them
+			std::vector<uint32_t> sourceTriangles(triangleCount);
+			for (uint32_t i{ 0 }; i < triangleCount; ++i)
+			{
+				sourceTriangles[i] = keys[i].triangleIdx;
+			}
+			ReorderTriangles(sourceTriangles, indices, normals, transformedNormals, pTriangleOrder, chunkCount);
+
+			if (triangleCount <= settings.maxLeafSize || triangleCount == 1)
+			{
+				bvh[0].triangleCount = triangleCount;
+				bvh[0].UpdateNodeBounds(bvh, indices, vertices, 0);
+				return;
+			}
+
+			//Every internal node only reads the sorted keys, so they are all built at the same time
+			std::vector<LBVHNode> radixTree(triangleCount - 1);
+			uint32_t const internalCount{ triangleCount - 1 };
+			RunTasks(chunkCount, [&](uint32_t chunk)
+			{
+				for (uint32_t node{ chunk * internalCount / chunkCount }, end{ (chunk + 1) * internalCount / chunkCount }; node < end; ++node)
+				{
+					int64_t const i{ node };
+
+					//Direction of the range, towards the neighbour with the longer common prefix
+					int64_t const d{ CommonPrefix(keys, i, i + 1) - CommonPrefix(keys, i, i - 1) > 0 ? 1 : -1 };
+					int const minPrefix{ CommonPrefix(keys, i, i - d) };
+
+					//Upper bound for the length of the range, then the exact other end with a binary search
+					int64_t maxLength{ 2 };
+					while (CommonPrefix(keys, i, i + maxLength * d) > minPrefix)
+					{
+						maxLength *= 2;
+					}
+					int64_t length{ 0 };
+					for (int64_t t{ maxLength / 2 }; t >= 1; t /= 2)
+					{
+						if (CommonPrefix(keys, i, i + (length + t) * d) > minPrefix)
+						{
+							length += t;
+						}
+					}
+					int64_t const j{ i + length * d };
+
+					//Split where the prefix of the whole range ends
+					int const nodePrefix{ CommonPrefix(keys, i, j) };
+					int64_t split{ 0 };
+					int64_t t{ length };
+					do
+					{
+						t = (t + 1) / 2;
+						if (CommonPrefix(keys, i, i + (split + t) * d) > nodePrefix)
+						{
+							split += t;
+						}
+					} while (t > 1);
+					uint32_t const gamma{ static_cast<uint32_t>(i + split * d + std::min<int64_t>(d, 0)) };
+
+					LBVHNode& radixNode{ radixTree[node] };
+					radixNode.first = static_cast<uint32_t>(std::min(i, j));
+					radixNode.last = static_cast<uint32_t>(std::max(i, j));
+					radixNode.children[0] = radixNode.first == gamma ? gamma | lbvhLeafFlag : gamma;
+					radixNode.children[1] = radixNode.last == gamma + 1 ? (gamma + 1) | lbvhLeafFlag : gamma + 1;
+				}
+			});
+
+			//Same layout the other builders produce: children pairs adjacent and after their parent, leaves with triangle ranges
+			bvh.resize(triangleCount * 2 - 1);
+			uint32_t nextIdx{ 1 };
+			EmitLBVH(radixTree, bvh, indices, vertices, settings, 0, 0, 0, nextIdx);
+			bvh.resize(nextIdx);
+		}
+
+		static void EmitLBVH(const std::vector<LBVHNode>& radixTree, std::vector<BVHNode>& bvh, std::vector<int>const& indices, std::vector<Vector3>const& vertices, const BVHBuildSettings& settings, uint32_t radixIdx, uint32_t bvhIdx, uint32_t depth, uint32_t& nextIdx)
+		{
+			bool const isRadixLeaf{ (radixIdx & lbvhLeafFlag) != 0 };
+			uint32_t const first{ isRadixLeaf ? radixIdx & ~lbvhLeafFlag : radixTree[radixIdx].first };
+			uint32_t const count{ isRadixLeaf ? 1 : radixTree[radixIdx].last - first + 1 };
+
+			//Equal codes are split by index, which can chain far deeper than the code bits; every radix node covers a contiguous range so it can end there
+			BVHNode& node{ bvh[bvhIdx] };
+			if (count <= settings.maxLeafSize || isRadixLeaf || depth >= maxDepth)
+			{
+				node.leftFirst = first;
+				node.triangleCount = count;
+				node.UpdateNodeBounds(bvh, indices, vertices, bvhIdx);
+				return;
+			}
+
+			uint32_t const leftChildIdx{ nextIdx };
+			nextIdx += 2;
+			EmitLBVH(radixTree, bvh, indices, vertices, settings, radixTree[radixIdx].children[0], leftChildIdx, depth + 1, nextIdx);
+			EmitLBVH(radixTree, bvh, indices, vertices, settings, radixTree[radixIdx].children[1], leftChildIdx + 1, depth + 1, nextIdx);
 
 			node.leftFirst = leftChildIdx;
 			node.triangleCount = 0;
-			UpdateNodeBounds(bvh, indices, vertices, leftChildIdx);
-			UpdateNodeBounds(bvh, indices, vertices, rightChildIdx);
-			//Recurse
-			SubDivide(bvh, indices, vertices, leftChildIdx,normals, transformedNormals);
-			SubDivide(bvh, indices, vertices, rightChildIdx, normals, transformedNormals);
+			node.aabbMin = Vector3::Min(bvh[leftChildIdx].aabbMin, bvh[leftChildIdx + 1].aabbMin);
+			node.aabbMax = Vector3::Max(bvh[leftChildIdx].aabbMax, bvh[leftChildIdx + 1].aabbMax);
+		}
+#pragma endregion
+
+		static AABB NodeBounds(const BVHNode& node)
+		{
+			AABB bounds{};
+			bounds.min = node.aabbMin;
+			bounds.max = node.aabbMax;
+			return bounds;
+		}
+
+		static Vector3 TriangleCenter(std::vector<int>const& indices, std::vector<Vector3>const& vertices, uint32_t triangleIdx)
+		{
+			//Center is currently not stored inside the mesh, could be stored if necessary
+			auto const idx{ triangleIdx * 3 };
+			return (vertices[indices[idx]] + vertices[indices[idx + 1]] + vertices[indices[idx + 2]]) / 3;
+		}
+
+		//Returns the SAH cost of the best split, axis and splitPos are set to the matching plane
+		static float FindBestSplitPlane(const BVHNode& node, std::vector<TriangleRef>const& refs, const BVHBuildSettings& settings, int& axis, float& splitPos)
+		{
+			struct Bin final
+			{
+				AABB bounds{};
+				uint32_t triangleCount{ 0 };
+			};
+
+			assert(settings.binCount >= 2);
+			uint32_t const binCount{ settings.binCount };
+
+			std::vector<Bin> bins(binCount);
+			std::vector<float> leftArea(binCount - 1);
+			std::vector<float> rightArea(binCount - 1);
+			std::vector<uint32_t> leftCount(binCount - 1);
+			std::vector<uint32_t> rightCount(binCount - 1);
+
+			float const parentArea{ NodeBounds(node).HalfArea() };
+			float bestCost{ std::numeric_limits<float>::max() };
+
+			if (parentArea <= 0.f)
+			{
+				return bestCost;
+			}
+
+			for (int a{ 0 }; a < 3; ++a)
+			{
+				//Bin over the centroid bounds rather than the node bounds, so no bins are wasted on empty space
+				float boundsMin{ 1e30f };
+				float boundsMax{ -1e30f };
+				for (uint32_t i{ 0 }; i < node.triangleCount; ++i)
+				{
+					float const c{ refs[node.leftFirst + i].centroid[a] };
+					boundsMin = std::min(boundsMin, c);
+					boundsMax = std::max(boundsMax, c);
+				}
+
+				if (boundsMin == boundsMax)
+				{
+					continue;
+				}
+
+				std::fill(bins.begin(), bins.end(), Bin{});
+				float const scale{ binCount / (boundsMax - boundsMin) };
+
+				for (uint32_t i{ 0 }; i < node.triangleCount; ++i)
+				{
+					TriangleRef const& ref{ refs[node.leftFirst + i] };
+					uint32_t const binIdx{ std::min(binCount - 1, static_cast<uint32_t>((ref.centroid[a] - boundsMin) * scale)) };
+
+					Bin& bin{ bins[binIdx] };
+					++bin.triangleCount;
+					bin.bounds.Grow(ref.bounds);
+				}
+
+				//Sweep from both sides to gather the area and count left and right of every bin border
+				AABB leftBox{};
+				AABB rightBox{};
+				uint32_t leftSum{ 0 };
+				uint32_t rightSum{ 0 };
+				for (uint32_t i{ 0 }; i < binCount - 1; ++i)
+				{
+					leftSum += bins[i].triangleCount;
+					leftCount[i] = leftSum;
+					leftBox.Grow(bins[i].bounds);
+					leftArea[i] = leftBox.HalfArea();
+
+					rightSum += bins[binCount - 1 - i].triangleCount;
+					rightCount[binCount - 2 - i] = rightSum;
+					rightBox.Grow(bins[binCount - 1 - i].bounds);
+					rightArea[binCount - 2 - i] = rightBox.HalfArea();
+				}
+
+				float const binWidth{ (boundsMax - boundsMin) / binCount };
+				for (uint32_t i{ 0 }; i < binCount - 1; ++i)
+				{
+					if (leftCount[i] == 0 || rightCount[i] == 0)
+					{
+						continue;
+					}
+
+					float const cost{ settings.traversalCost + settings.intersectionCost * (leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i]) / parentArea };
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						axis = a;
+						splitPos = boundsMin + binWidth * (i + 1);
+					}
+				}
+			}
+
+			return bestCost;
 		}
 	};
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,8 @@
 #pragma once
+#ifndef DAE_HEADLESS
 #include <SDL_keyboard.h>
 #include <SDL_mouse.h>
+#endif
 
 #include "Maths.h"
 #include "Timer.h"
@@ -45,6 +47,10 @@ namespace dae
 
 		void Update(Timer* pTimer)
 		{
+#ifdef DAE_HEADLESS
+			//No window, so no input to react to
+			(void)pTimer;
+#else
 			float const deltaTime{ pTimer->GetElapsed() };
 
 			Vector3 movementDir{ };
@@ -84,6 +90,7 @@ namespace dae
 			{
 				UpdateCameraDirection(static_cast<float>(mouseX), static_cast<float>(mouseY), deltaTime);
 			}
+#endif
 		}
 
 	private:
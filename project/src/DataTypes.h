@@ -1,20 +1,25 @@
 #ifndef DATATYPES_H
 #define DATATYPES_H
 
+#include <numeric>
 #include <vector>
 #include "Maths.h"
 
 #include "BVH.h"
+#include "WideBVH.h"
 
 namespace dae
 {
 #pragma region GEOMETRY
+	//Index into the scene material table
+	using MaterialId = uint32_t;
+
 	struct Sphere
 	{
 		Vector3 origin{};
 		float radius{};
 
-		unsigned char materialIndex{ 0 };
+		MaterialId materialIndex{ 0 };
 	};
 
 	struct Plane
@@ -22,7 +27,7 @@ namespace dae
 		Vector3 origin{};
 		Vector3 normal{};
 
-		unsigned char materialIndex{ 0 };
+		MaterialId materialIndex{ 0 };
 	};
 
 	enum class TriangleCullMode : uint8_t
@@ -41,7 +46,7 @@ namespace dae
 		Vector3 normal{};
 
 		TriangleCullMode cullMode{};
-		uint8_t materialIndex{};
+		MaterialId materialIndex{};
 
 		Triangle() = default;
 		Triangle(const Vector3& _v0, const Vector3& _v1, const Vector3& _v2, const Vector3& _normal) :
@@ -56,11 +61,25 @@ namespace dae
 		}
 	};
 
+	//Intersection ready copy of a mesh triangle in world space, one cache line per triangle
+	struct alignas(64) TriangleIntersectionData
+	{
+		Vector3 v0{};
+		Vector3 edge1{}; //v1 - v0
+		Vector3 edge2{}; //v2 - v0
+		Vector3 normal{};
+
+		TriangleCullMode cullMode{};
+		MaterialId materialIndex{};
+	};
+
 	struct TriangleMesh
 	{
 		std::vector<Vector3> positions{}; //vertices
 		std::vector<Vector3> normals{}; //normals (1 normal per 3 indices)
 		std::vector<int> indices{}; //indices; this contains the index in the positions array to avoid duplicate positions for shared vertices
+		std::vector<Vector3> vertexNormals{}; //1 per index, only filled when the source file has them; shading still uses the face normals
+		std::vector<Vector3> uvs{}; //1 per index as (u, v, w), only filled when the source file has them
 
 		Matrix rotationTransform{};
 		Matrix translationTransform{};
@@ -71,13 +90,20 @@ namespace dae
 
 		std::vector<Vector3> transformedPositions{};
 		std::vector<Vector3> transformedNormals{};
+		std::vector<TriangleIntersectionData> triangles{}; //1 per 3 indices, in the same order; rebuilt with the transforms
 
 		Vector3 transformedMinAABB{};
 		Vector3 transformedMaxAABB{};
 
 		std::vector<BVHNode> bvh{}; //the mesh BVH, bvh[0] == root
+		std::vector<BVH4Node> bvh4{}; //collapsed copies of bvh, only filled for the matching BVHLayout
+		std::vector<BVH8Node> bvh8{};
+		std::vector<QuantizedBVH4Node> bvhQuantized4{};
+		BVHBuildSettings bvhSettings{};
+		float bvhBuildCost{ 0.f }; //SAH cost right after the last full build
+		float bvhRebuildThreshold{ 1.5f }; //Rebuild once a refit tree costs this many times the freshly built one
  
-		uint8_t materialIndex{};
+		MaterialId materialIndex{};
 
 		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
 		bool isDirty{ false }; //are the transforms currently 'dirty'; whe this is set, the transforms (and bvh will be updated);
@@ -182,10 +208,34 @@ namespace dae
 			}
 
 			UpdateTransformedAABB(finalTransform);
+			UpdateTriangles();
+
+			if (!bvh.empty())
+			{
+				UpdateBVH();
+			}
 
 			isDirty = false;
 		}
 
+		void UpdateTriangles()
+		{
+			triangles.resize(indices.size() / 3);
+
+			for (uint32_t i{ 0 }; i < triangles.size(); ++i)
+			{
+				Vector3 const& v0{ transformedPositions[indices[i * 3]] };
+
+				TriangleIntersectionData& t{ triangles[i] };
+				t.v0 = v0;
+				t.edge1 = transformedPositions[indices[i * 3 + 1]] - v0;
+				t.edge2 = transformedPositions[indices[i * 3 + 2]] - v0;
+				t.normal = transformedNormals[i];
+				t.cullMode = cullMode;
+				t.materialIndex = materialIndex;
+			}
+		}
+
 		void UpdateAABB()
 		{
 			if(positions.size() > 0)
@@ -238,12 +288,128 @@ namespace dae
 			transformedMaxAABB = tMaxAABB;
 		}
 
-		void InitializeBVH()
+		void InitializeBVH(const BVHBuildSettings& settings = {})
+		{
+			bvhSettings = settings;
+
+			//The build only swaps indices and face normals, the per index attributes follow the order it reports
+			bool const hasCornerAttributes{ !vertexNormals.empty() || !uvs.empty() };
+			std::vector<uint32_t> triangleOrder{};
+			if (hasCornerAttributes)
+			{
+				triangleOrder.resize(normals.size());
+				std::iota(triangleOrder.begin(), triangleOrder.end(), 0u);
+			}
+
+			//Traversal tests the transformed positions, so the bounds have to be built over those as well
+			BVHNode::BuildBVH(bvh, indices, transformedPositions, normals, transformedNormals, settings, hasCornerAttributes ? &triangleOrder : nullptr);
+			bvhBuildCost = BVHNode::CalculateSAHCost(bvh, bvhSettings);
+
+			if (hasCornerAttributes)
+			{
+				ReorderCornerAttributes(vertexNormals, triangleOrder);
+				ReorderCornerAttributes(uvs, triangleOrder);
+			}
+
+			//The build reordered the triangles
+			UpdateTriangles();
+			CollapseBVH();
+		}
+
+		//attributes[t * 3 + k] becomes the old attributes[triangleOrder[t] * 3 + k]
+		static void ReorderCornerAttributes(std::vector<Vector3>& attributes, const std::vector<uint32_t>& triangleOrder)
+		{
+			if (attributes.empty())
+			{
+				return;
+			}
+
+			std::vector<Vector3> reordered(attributes.size());
+			for (size_t t{ 0 }; t < triangleOrder.size(); ++t)
+			{
+				for (size_t k{ 0 }; k < 3; ++k)
+				{
+					reordered[t * 3 + k] = attributes[triangleOrder[t] * 3 + k];
+				}
+			}
+			attributes = std::move(reordered);
+		}
+
+		void CollapseBVH()
+		{
+			bvh4.clear();
+			bvh8.clear();
+			bvhQuantized4.clear();
+
+			switch (bvhSettings.layout)
+			{
+			case BVHLayout::Wide4:
+				BVH4Node::Collapse(bvh4, bvh);
+				break;
+			case BVHLayout::Wide8:
+				BVH8Node::Collapse(bvh8, bvh);
+				break;
+			case BVHLayout::Quantized4:
+			{
+				//The full precision BVH4 is only needed while compressing
+				std::vector<BVH4Node> collapsed{};
+				BVH4Node::Collapse(collapsed, bvh);
+				QuantizedBVH4Node::Compress(bvhQuantized4, collapsed);
+				break;
+			}
+			case BVHLayout::Binary:
+			default:
+				break;
+			}
+		}
+
+		//Refits the BVH to the current transformed positions, falls back to a full rebuild when the refit tree got too loose
+		void UpdateBVH()
 		{
-			bvh.emplace_back(BVHNode{  });
-			bvh.reserve(1000); //temporarily just reserve 16 child nodes (and 1 root node)
+			BVHNode::Refit(bvh, indices, transformedPositions);
 
-			bvh[0].BuildBVH(bvh, indices, positions, normals, transformedNormals);
+			if (BVHNode::CalculateSAHCost(bvh, bvhSettings) > bvhBuildCost * bvhRebuildThreshold)
+			{
+				InitializeBVH(bvhSettings);
+				return;
+			}
+
+			CollapseBVH();
+		}
+	};
+
+	//A placed copy of a shared mesh; rays are brought into object space instead of duplicating the vertices
+	struct MeshInstance
+	{
+		uint32_t meshIndex{}; //index of the shared mesh (and its bottom level BVH) in the scene
+
+		Matrix objectToWorld{};
+		Matrix worldToObject{};
+		Matrix normalToWorld{}; //inverse transpose, keeps normals perpendicular under non-uniform scales
+
+		Vector3 minAABB{}; //world space bounds
+		Vector3 maxAABB{};
+
+		MaterialId materialIndex{};
+
+		void SetTransform(const Matrix& transform, const TriangleMesh& mesh)
+		{
+			objectToWorld = transform;
+			worldToObject = Matrix::Inverse(transform);
+			normalToWorld = Matrix::Transpose(worldToObject);
+
+			//World bounds of the 8 transformed corners of the object space bounds
+			Vector3 const& bmin{ mesh.bvh.empty() ? mesh.minAABB : mesh.bvh[0].aabbMin };
+			Vector3 const& bmax{ mesh.bvh.empty() ? mesh.maxAABB : mesh.bvh[0].aabbMax };
+
+			minAABB = { 1e30f, 1e30f, 1e30f };
+			maxAABB = { -1e30f, -1e30f, -1e30f };
+			for (int i{ 0 }; i < 8; ++i)
+			{
+				Vector3 const corner{ objectToWorld.TransformPoint(i & 1 ? bmax.x : bmin.x, i & 2 ? bmax.y : bmin.y, i & 4 ? bmax.z : bmin.z) };
+				minAABB = Vector3::Min(minAABB, corner);
+				maxAABB = Vector3::Max(maxAABB, corner);
+			}
 		}
 	};
 #pragma endregion
@@ -265,7 +431,21 @@ namespace dae
 		float t = FLT_MAX;
 
 		bool didHit{ false };
-		uint8_t materialIndex{ 0 };
+		MaterialId materialIndex{ 0 };
+	};
+
+	//What the triangle loops keep while searching, the HitRecord is only rebuilt from it for the closest hit of a ray
+	struct TriangleHit
+	{
+		static constexpr uint32_t invalidIdx{ 0xFFFFFFFF };
+
+		float t{ FLT_MAX };
+		float u{}; //barycentric of v1
+		float v{}; //barycentric of v2
+		uint32_t triangleIdx{ invalidIdx }; //into TriangleMesh::triangles
+		uint32_t instanceIdx{ invalidIdx }; //into the scene instances, only set by the TLAS traversal
+
+		bool DidHit() const { return triangleIdx != invalidIdx; }
 	};
 #pragma endregion
 }
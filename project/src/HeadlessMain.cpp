@@ -0,0 +1,235 @@
+//Offscreen entry point for batch renders, no window or SDL video needed
+//Usage: GP1_Raytracer_Headless --scene reference --width 1920 --height 1080 --samples 4 --output frame.bmp
+
+//Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+//Project includes
+#include "Renderer.h"
+#include "Scene.h"
+
+using namespace dae;
+
+namespace
+{
+	struct RenderSettings final
+	{
+		std::string sceneName{ "reference" };
+		std::string output{ "RayTracing_Buffer.bmp" };
+		int width{ 640 };
+		int height{ 480 };
+		uint32_t samples{ 1 };
+		uint32_t frames{ 1 };
+		uint32_t threads{ 0 };
+		uint32_t tileSize{ 32 };
+		bool shadows{ true };
+		bool packets{ true };
+		Renderer::SampleMode sampleMode{ Renderer::SampleMode::UniformSquare };
+
+		bool adaptive{ false };
+		float adaptiveThreshold{ .05f };
+		uint32_t minSamples{ 4 };
+		uint32_t maxSamples{ 64 };
+	};
+
+	std::unordered_map<std::string, std::function<Scene*()>> const g_Scenes
+	{
+		{ "w1", []() -> Scene* { return new Scene_W1{}; } },
+		{ "w2", []() -> Scene* { return new Scene_W2{}; } },
+		{ "w3", []() -> Scene* { return new Scene_W3{}; } },
+		{ "w3test", []() -> Scene* { return new Scene_W3_TestScene{}; } },
+		{ "triangle", []() -> Scene* { return new Scene_TriangleTest{}; } },
+		{ "w4test", []() -> Scene* { return new Scene_W4_TestScene{}; } },
+		{ "reference", []() -> Scene* { return new Scene_W4_ReferenceScene{}; } },
+		{ "bunny", []() -> Scene* { return new Scene_W4_BunnyScene{}; } },
+		{ "bunnyinstances", []() -> Scene* { return new Scene_BunnyInstances{}; } },
+		{ "softshadows", []() -> Scene* { return new Scene_Softshadows{}; } },
+	};
+
+	std::unordered_map<std::string, Renderer::SampleMode> const g_SampleModes
+	{
+		{ "random", Renderer::SampleMode::RandomSquare },
+		{ "uniform", Renderer::SampleMode::UniformSquare },
+		{ "sobol", Renderer::SampleMode::Sobol },
+		{ "halton", Renderer::SampleMode::Halton },
+		{ "bluenoise", Renderer::SampleMode::BlueNoise },
+	};
+
+	void PrintUsage()
+	{
+		std::cout << "Usage: GP1_Raytracer_Headless [options]\n";
+		std::cout << "  --scene <name>      ";
+		for (auto const& scene : g_Scenes)
+		{
+			std::cout << scene.first << " ";
+		}
+		std::cout << "(default reference)\n";
+		std::cout << "  --width <pixels>    default 640\n";
+		std::cout << "  --height <pixels>   default 480\n";
+		std::cout << "  --samples <count>   samples per pixel per frame, default 1\n";
+		std::cout << "  --frames <count>    progressive frames accumulated into the image, default 1\n";
+		std::cout << "  --threads <count>   0 uses every hardware thread, default 0\n";
+		std::cout << "  --tile-size <px>    default 32\n";
+		std::cout << "  --sampler <name>    random uniform sobol halton bluenoise (default uniform)\n";
+		std::cout << "  --no-shadows\n";
+		std::cout << "  --no-packets        trace camera rays one by one instead of in packets\n";
+		std::cout << "  --adaptive <error>  adaptive sampling, stops a pixel once its relative error is below this (e.g. 0.05)\n";
+		std::cout << "  --min-samples <n>   adaptive sampling lower bound per pixel, default 4\n";
+		std::cout << "  --max-samples <n>   adaptive sampling upper bound per pixel, default 64\n";
+		std::cout << "  --output <file>     BMP file, default RayTracing_Buffer.bmp\n";
+	}
+
+	bool ParseArguments(int argc, char* args[], RenderSettings& settings)
+	{
+		for (int i{ 1 }; i < argc; ++i)
+		{
+			std::string const arg{ args[i] };
+
+			if (arg == "--no-shadows")
+			{
+				settings.shadows = false;
+				continue;
+			}
+
+			if (arg == "--no-packets")
+			{
+				settings.packets = false;
+				continue;
+			}
+
+			//Every other option takes a value
+			if (i + 1 >= argc)
+			{
+				std::cout << "Missing value for " << arg << "\n";
+				return false;
+			}
+
+			std::string const value{ args[++i] };
+			if (arg == "--scene")
+			{
+				settings.sceneName = value;
+			}
+			else if (arg == "--output")
+			{
+				settings.output = value;
+			}
+			else if (arg == "--width")
+			{
+				settings.width = std::atoi(value.c_str());
+			}
+			else if (arg == "--height")
+			{
+				settings.height = std::atoi(value.c_str());
+			}
+			else if (arg == "--samples")
+			{
+				settings.samples = static_cast<uint32_t>(std::atoi(value.c_str()));
+			}
+			else if (arg == "--frames")
+			{
+				settings.frames = std::max(static_cast<uint32_t>(std::atoi(value.c_str())), 1u);
+			}
+			else if (arg == "--threads")
+			{
+				settings.threads = static_cast<uint32_t>(std::atoi(value.c_str()));
+			}
+			else if (arg == "--sampler")
+			{
+				if (!g_SampleModes.contains(value))
+				{
+					std::cout << "Unknown sampler " << value << "\n";
+					return false;
+				}
+				settings.sampleMode = g_SampleModes.at(value);
+			}
+			else if (arg == "--adaptive")
+			{
+				settings.adaptive = true;
+				settings.adaptiveThreshold = static_cast<float>(std::atof(value.c_str()));
+			}
+			else if (arg == "--min-samples")
+			{
+				settings.minSamples = static_cast<uint32_t>(std::atoi(value.c_str()));
+			}
+			else if (arg == "--max-samples")
+			{
+				settings.maxSamples = static_cast<uint32_t>(std::atoi(value.c_str()));
+			}
+			else if (arg == "--tile-size")
+			{
+				settings.tileSize = static_cast<uint32_t>(std::atoi(value.c_str()));
+			}
+			else
+			{
+				std::cout << "Unknown option " << arg << "\n";
+				return false;
+			}
+		}
+
+		if (settings.width <= 0 || settings.height <= 0)
+		{
+			std::cout << "Resolution has to be positive\n";
+			return false;
+		}
+
+		if (!g_Scenes.contains(settings.sceneName))
+		{
+			std::cout << "Unknown scene " << settings.sceneName << "\n";
+			return false;
+		}
+
+		return true;
+	}
+}
+
+int main(int argc, char* args[])
+{
+	RenderSettings settings{};
+	if (!ParseArguments(argc, args, settings))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	std::unique_ptr<Scene> const pScene{ g_Scenes.at(settings.sceneName)() };
+	Renderer renderer{ settings.width, settings.height, settings.threads };
+	renderer.SetSampleCount(settings.samples);
+	renderer.SetTileSize(settings.tileSize);
+	renderer.SetShadowsEnabled(settings.shadows);
+	renderer.SetSampleMode(settings.sampleMode);
+	renderer.SetPacketTracingEnabled(settings.packets);
+	renderer.SetProgressiveEnabled(settings.frames > 1);
+	renderer.SetAdaptiveSampling(settings.adaptive, settings.minSamples, settings.maxSamples, settings.adaptiveThreshold);
+
+	using Clock = std::chrono::steady_clock;
+
+	auto const initStart{ Clock::now() };
+	pScene->Initialize();
+	auto const renderStart{ Clock::now() };
+	for (uint32_t frame{ 0 }; frame < settings.frames; ++frame)
+	{
+		renderer.Render(pScene.get());
+	}
+	auto const renderEnd{ Clock::now() };
+
+	std::cout << "Scene " << settings.sceneName << " initialized in " << std::chrono::duration<float, std::milli>(renderStart - initStart).count() << " ms\n";
+	std::cout << "Rendered " << settings.width << "x" << settings.height << " at " << renderer.GetAverageSampleCount() << " spp on " << renderer.GetThreadCount() << " threads in "
+		<< std::chrono::duration<float, std::milli>(renderEnd - renderStart).count() << " ms\n";
+	renderer.PrintTileTimings();
+
+	if (!renderer.SaveBufferToImage(settings.output))
+	{
+		std::cout << "Could not write " << settings.output << "\n";
+		return 1;
+	}
+
+	std::cout << "Saved " << settings.output << "\n";
+	return 0;
+}
@@ -0,0 +1,118 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace dae;
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& filename)
+{
+	HANDLE const file{ CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	m_FileHandle = file;
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file, &size))
+	{
+		return;
+	}
+
+	m_Size = static_cast<size_t>(size.QuadPart);
+	if (m_Size == 0)
+	{
+		//Mapping an empty file fails, there is nothing to read anyway
+		m_IsOpen = true;
+		return;
+	}
+
+	HANDLE const mapping{ CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+	if (!mapping)
+	{
+		return;
+	}
+	m_MappingHandle = mapping;
+
+	m_pData = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	m_IsOpen = m_pData != nullptr;
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_pData)
+	{
+		UnmapViewOfFile(m_pData);
+	}
+	if (m_MappingHandle)
+	{
+		CloseHandle(m_MappingHandle);
+	}
+	if (m_FileHandle)
+	{
+		CloseHandle(m_FileHandle);
+	}
+}
+#else
+MappedFile::MappedFile(const std::string& filename)
+{
+	int const file{ open(filename.c_str(), O_RDONLY) };
+	if (file < 0)
+	{
+		return;
+	}
+
+	struct stat info {};
+	if (fstat(file, &info) != 0)
+	{
+		close(file);
+		return;
+	}
+
+	m_Size = static_cast<size_t>(info.st_size);
+	if (m_Size == 0)
+	{
+		//mmap rejects a zero length, there is nothing to read anyway
+		close(file);
+		m_IsOpen = true;
+		return;
+	}
+
+	void* const pData{ mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0) };
+	//The mapping keeps its own reference to the file
+	close(file);
+	if (pData == MAP_FAILED)
+	{
+		m_Size = 0;
+		return;
+	}
+
+	//Parsers read it front to back
+	madvise(pData, m_Size, MADV_SEQUENTIAL);
+
+	m_pData = static_cast<const char*>(pData);
+	m_IsOpen = true;
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_pData)
+	{
+		munmap(const_cast<char*>(m_pData), m_Size);
+	}
+}
+#endif
@@ -3,151 +3,173 @@
 #include "DataTypes.h"
 #include "BRDFs.h"
 
+#include <algorithm>
 #include <cassert>
 
 namespace dae
 {
 #pragma region Material BASE
-	class Material
+	enum class MaterialType : uint8_t
 	{
-	public:
-		Material() = default;
-		virtual ~Material() = default;
-
-		Material(const Material&) = delete;
-		Material(Material&&) noexcept = delete;
-		Material& operator=(const Material&) = delete;
-		Material& operator=(Material&&) noexcept = delete;
-
-		/**
-		 * \brief Function used to calculate the correct color for the specific material and its parameters
-		 * \param hitRecord current hitrecord
-		 * \param l light direction
-		 * \param v view direction
-		 * \return color
-		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence
 	};
-#pragma endregion
 
-#pragma region Material SOLID COLOR
-	//SOLID COLOR
-	//===========
-	class Material_SolidColor final : public Material
+	//Flat material record, the scene keeps them contiguously in one table indexed by MaterialId
+	//Every BRDF parameter is stored inline, parameters a type does not use stay at their defaults
+	struct Material final
 	{
-	public:
-		Material_SolidColor(const ColorRGB& color) : m_Color(color){ }
+		MaterialType type{ MaterialType::SolidColor };
+
+		ColorRGB color{ colors::White }; //solid color, diffuse color or albedo
+		float diffuseReflectance{ 1.f }; //kd
+		float specularReflectance{ 0.f }; //ks
+		float phongExponent{ 1.f };
+		float metalness{ 0.f };
+		float roughness{ 1.f }; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
 
-		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
+		//Derived on creation, they do not depend on the light or view direction
+		ColorRGB lambert{}; //Lambert diffuse term
+		ColorRGB f0{}; //specular color at normal incidence
+
+		static Material CreateSolidColor(const ColorRGB& color)
 		{
-			return m_Color;
+			Material m{};
+			m.type = MaterialType::SolidColor;
+			m.color = color;
+			return m;
 		}
 
-	private:
-		ColorRGB m_Color{ colors::White };
-	};
-#pragma endregion
-
-#pragma region Material LAMBERT
-	//LAMBERT
-	//=======
-	class Material_Lambert final : public Material
-	{
-	public:
-		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance)
+		static Material CreateLambert(const ColorRGB& diffuseColor, float diffuseReflectance)
 		{
 			assert(diffuseReflectance <= 1.f && diffuseReflectance >= 0.f);
+
+			Material m{};
+			m.type = MaterialType::Lambert;
+			m.color = diffuseColor;
+			m.diffuseReflectance = diffuseReflectance;
+			m.lambert = BRDF::Lambert(diffuseReflectance, diffuseColor);
+			return m;
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		static Material CreateLambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent)
 		{
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			Material m{};
+			m.type = MaterialType::LambertPhong;
+			m.color = diffuseColor;
+			m.diffuseReflectance = kd;
+			m.specularReflectance = ks;
+			m.phongExponent = phongExponent;
+			m.lambert = BRDF::Lambert(kd, diffuseColor);
+			return m;
 		}
 
-	private:
-		ColorRGB m_DiffuseColor{ colors::White };
-		float m_DiffuseReflectance{ 1.f }; //kd
+		static Material CreateCookTorrence(const ColorRGB& albedo, float metalness, float roughness)
+		{
+			assert(metalness == 1.f || metalness == 0.f);
+			assert(roughness != 0.f);
+
+			Material m{};
+			m.type = MaterialType::CookTorrence;
+			m.color = albedo;
+			m.metalness = metalness;
+			m.roughness = roughness;
+			m.f0 = (metalness == 0.f) ? ColorRGB{ 0.04f, 0.04f, 0.04f } : albedo;
+			return m;
+		}
 	};
 #pragma endregion
 
-#pragma region Material LAMBERT PHONG
-	//LAMBERT-PHONG
-	//=============
-	class Material_LambertPhong final : public Material
+#pragma region Shading
+	namespace Shading
 	{
-	public:
-		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(kd), m_SpecularReflectance(ks),
-			m_PhongExponent(phongExponent)
+		//SOLID COLOR
+		//===========
+		inline ColorRGB SolidColor(const Material& m)
 		{
+			return m.color;
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		//LAMBERT
+		//=======
+		inline ColorRGB Lambert(const Material& m)
 		{
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor)
-				 + BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, v, hitRecord.normal);
+			return m.lambert;
 		}
 
-	private:
-		ColorRGB m_DiffuseColor{ colors::White };
-		float m_DiffuseReflectance{ 0.5f }; //kd
-		float m_SpecularReflectance{ 0.5f }; //ks
-		float m_PhongExponent{ 1.f }; //Phong Exponent
-	};
-#pragma endregion
-
-#pragma region Material COOK TORRENCE
-	//COOK TORRENCE
-	class Material_CookTorrence final : public Material
-	{
-	public:
-		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness) :
-			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
+		//LAMBERT-PHONG
+		//=============
+		inline ColorRGB LambertPhong(const Material& m, const Vector3& n, const Vector3& l, const Vector3& v)
 		{
-			assert(m_Metalness == 1.f || m_Metalness == 0.f);
-			assert(m_Roughness != 0.f);
+			return m.lambert + BRDF::Phong(m.specularReflectance, m.phongExponent, l, v, n);
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		//COOK TORRENCE
+		//=============
+		inline ColorRGB CookTorrence(const Material& m, const Vector3& n, const Vector3& l, const Vector3& v)
 		{
-			if (m_Roughness == 0.f)
+			if (m.roughness == 0.f)
 			{
 				return {};
 			}
 
-			ColorRGB const f0{ (m_Metalness == 0.f) ? ColorRGB{ 0.04f, 0.04f, 0.04f } : m_Albedo }; //specular color
-
 			Vector3 const h{ (v + l).Normalized() };
 
-			auto const F{ BRDF::FresnelFunction_Schlick(h, v, f0) };
-			auto const D{ BRDF::NormalDistribution_GGX(hitRecord.normal, h, m_Roughness) };
-			auto const G{ BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, m_Roughness) };
-
-			float const dot1{ Vector3::Dot(v, hitRecord.normal) };
-			float const dot2{ Vector3::Dot(l, hitRecord.normal) };
+			auto const F{ BRDF::FresnelFunction_Schlick(h, v, m.f0) };
+			auto const D{ BRDF::NormalDistribution_GGX(n, h, m.roughness) };
+			auto const G{ BRDF::GeometryFunction_Smith(n, v, l, m.roughness) };
 
-			//Not necesary with observed area check in renderer
-			//if (dot1 < 0.f)
-			//{
-			//	dot1 = 0.f;
-			//}
-			//if (dot2 < 0.f)
-			//{
-			//	dot2 = 0.f;
-			//}
+			float const dot1{ Vector3::Dot(v, n) };
+			float const dot2{ Vector3::Dot(l, n) };
 
+			//No clamping of dot1/dot2 needed, the renderer already skips samples with a negative observed area
 			auto const specular{ (D * F * G) / (4 * dot1 * dot2) };
-			auto const diffuse{ (m_Metalness == 0.f) ? BRDF::Lambert(ColorRGB{1.f,1.f,1.f} - F, m_Albedo)
-															 : BRDF::Lambert(0.f, m_Albedo) };
+			auto const diffuse{ (m.metalness == 0.f) ? BRDF::Lambert(ColorRGB{1.f,1.f,1.f} - F, m.color)
+													 : BRDF::Lambert(0.f, m.color) };
 
 			return diffuse + specular;
 		}
+	}
 
-	private:
-		ColorRGB m_Albedo{ 0.955f, 0.637f, 0.538f }; //Copper
-		float m_Metalness{ 1.0f };
-		float m_Roughness{ 0.1f }; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
+	//One BRDF evaluation, the batched kernels read and write them contiguously
+	struct ShadeQuery final
+	{
+		Vector3 normal{};
+		Vector3 l{}; //light direction
+		Vector3 v{}; //view direction
+		uint32_t id{}; //Whatever the caller needs to map the result back, not used for shading
 	};
+
+	//Shades count queries that all use material m, results[i] belongs to queries[i]
+	//The dispatch happens once per batch, so every loop below runs a single straight kernel
+	inline void ShadeBatch(const Material& m, const ShadeQuery* pQueries, uint32_t count, ColorRGB* pResults)
+	{
+		switch (m.type)
+		{
+		case MaterialType::SolidColor:
+			std::fill(pResults, pResults + count, Shading::SolidColor(m));
+			break;
+		case MaterialType::Lambert:
+			std::fill(pResults, pResults + count, Shading::Lambert(m));
+			break;
+		case MaterialType::LambertPhong:
+			for (uint32_t i{ 0 }; i < count; ++i)
+			{
+				pResults[i] = Shading::LambertPhong(m, pQueries[i].normal, pQueries[i].l, pQueries[i].v);
+			}
+			break;
+		case MaterialType::CookTorrence:
+			for (uint32_t i{ 0 }; i < count; ++i)
+			{
+				pResults[i] = Shading::CookTorrence(m, pQueries[i].normal, pQueries[i].l, pQueries[i].v);
+			}
+			break;
+		default:
+			std::fill(pResults, pResults + count, ColorRGB{});
+			break;
+		}
+	}
 #pragma endregion
 }
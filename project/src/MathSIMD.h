@@ -0,0 +1,59 @@
+#pragma once
+
+//Compile time selection of the math backend
+//Define DAE_MATH_SCALAR to force the plain C++ fallback, otherwise the widest instruction set the compiler targets is used
+#if !defined(DAE_MATH_SCALAR)
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define DAE_MATH_SSE 1
+	#endif
+
+	#if defined(__SSE4_1__) || defined(__AVX__)
+		#define DAE_MATH_SSE41 1
+	#endif
+
+	#if defined(__AVX__)
+		#define DAE_MATH_AVX 1
+	#endif
+
+	//MSVC does not define __FMA__, but /arch:AVX2 implies it
+	#if defined(__FMA__) || (defined(_MSC_VER) && defined(__AVX2__))
+		#define DAE_MATH_FMA 1
+	#endif
+#endif
+
+#if defined(DAE_MATH_SSE)
+#include <immintrin.h>
+
+namespace dae
+{
+	namespace simd
+	{
+		//a * b + c
+		inline __m128 MulAdd(__m128 a, __m128 b, __m128 c)
+		{
+#if defined(DAE_MATH_FMA)
+			return _mm_fmadd_ps(a, b, c);
+#else
+			return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+		}
+
+		//Sum of all 4 lanes, broadcast to every lane
+		inline __m128 HorizontalSum(__m128 v)
+		{
+			__m128 const shuffled{ _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)) };
+			__m128 const sums{ _mm_add_ps(v, shuffled) };
+			return _mm_add_ps(sums, _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(1, 0, 3, 2)));
+		}
+
+		inline float Dot4(__m128 a, __m128 b)
+		{
+#if defined(DAE_MATH_SSE41)
+			return _mm_cvtss_f32(_mm_dp_ps(a, b, 0xF1));
+#else
+			return _mm_cvtss_f32(HorizontalSum(_mm_mul_ps(a, b)));
+#endif
+		}
+	}
+}
+#endif
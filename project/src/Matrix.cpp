@@ -27,34 +27,6 @@ namespace dae
 		data[3] = m[3];
 	}
 
-	Vector3 Matrix::TransformVector(const Vector3& v) const
-	{
-		return TransformVector(v[0], v[1], v[2]);
-	}
-
-	Vector3 Matrix::TransformVector(float x, float y, float z) const
-	{
-		return Vector3{
-			data[0].x * x + data[1].x * y + data[2].x * z,
-			data[0].y * x + data[1].y * y + data[2].y * z,
-			data[0].z * x + data[1].z * y + data[2].z * z
-		};
-	}
-
-	Vector3 Matrix::TransformPoint(const Vector3& p) const
-	{
-		return TransformPoint(p[0], p[1], p[2]);
-	}
-
-	Vector3 Matrix::TransformPoint(float x, float y, float z) const
-	{
-		return Vector3{
-			data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
-			data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
-			data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
-		};
-	}
-
 	const Matrix& Matrix::Transpose()
 	{
 		Matrix result{};
@@ -82,6 +54,47 @@ namespace dae
 		return out;
 	}
 
+	//Only valid for affine matrices (last column 0, 0, 0, 1), which is all this raytracer creates
+	const Matrix& Matrix::Inverse()
+	{
+		Vector3 const a{ data[0] };
+		Vector3 const b{ data[1] };
+		Vector3 const c{ data[2] };
+
+		//Rows of the inverse 3x3 are the cross products of the rows, transposed and divided by the determinant
+		Vector3 const bc{ Vector3::Cross(b, c) };
+		Vector3 const ca{ Vector3::Cross(c, a) };
+		Vector3 const ab{ Vector3::Cross(a, b) };
+
+		float const det{ Vector3::Dot(a, bc) };
+		assert(det != 0.f && "Matrix is not invertible");
+		float const invDet{ 1.f / det };
+
+		Matrix result{
+			Vector3{ bc.x, ca.x, ab.x } * invDet,
+			Vector3{ bc.y, ca.y, ab.y } * invDet,
+			Vector3{ bc.z, ca.z, ab.z } * invDet,
+			Vector3{}
+		};
+
+		Vector3 const t{ data[3] };
+		data[3] = { -result.TransformVector(t), 1.f };
+
+		data[0] = result[0];
+		data[1] = result[1];
+		data[2] = result[2];
+
+		return *this;
+	}
+
+	Matrix Matrix::Inverse(const Matrix& m)
+	{
+		Matrix out{ m };
+		out.Inverse();
+
+		return out;
+	}
+
 	Vector3 Matrix::GetAxisX() const
 	{
 		return data[0];
@@ -114,24 +127,24 @@ namespace dae
 
 	Matrix Matrix::CreateRotationX(float pitch)
 	{
-		float const cosPitch{ std::cosf(pitch) };
-		float const sinPitch{ std::sinf(pitch) };
+		float const cosPitch{ std::cos(pitch) };
+		float const sinPitch{ std::sin(pitch) };
 
 		return { Vector3::UnitX, {0,cosPitch ,  sinPitch}, { 0, -sinPitch, cosPitch}, { } };
 	}
 
 	Matrix Matrix::CreateRotationY(float yaw)
 	{
-		float const cosYaw{ std::cosf(yaw) };
-		float const sinYaw{ std::sinf(yaw) };
+		float const cosYaw{ std::cos(yaw) };
+		float const sinYaw{ std::sin(yaw) };
 
 		return { { cosYaw, 0, -sinYaw}, Vector3::UnitY, { sinYaw, 0, cosYaw}, {} };
 	}
 
 	Matrix Matrix::CreateRotationZ(float roll)
 	{
-		float const cosRoll{ std::cosf(roll) };
-		float const sinRoll{ std::sinf(roll) };
+		float const cosRoll{ std::cos(roll) };
+		float const sinRoll{ std::sin(roll) };
 
 		return { { cosRoll, sinRoll, 0 },{ -sinRoll, cosRoll, 0 }, Vector3::UnitZ, {} };
 	}
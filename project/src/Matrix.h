@@ -25,6 +25,7 @@ namespace dae {
 		Vector3 TransformPoint(const Vector3& p) const;
 		Vector3 TransformPoint(float x, float y, float z) const;
 		const Matrix& Transpose();
+		const Matrix& Inverse();
 
 		Vector3 GetAxisX() const;
 		Vector3 GetAxisY() const;
@@ -43,6 +44,7 @@ namespace dae {
 		static Matrix CreateScale(float sx, float sy, float sz);
 		static Matrix CreateScale(const Vector3& s);
 		static Matrix Transpose(const Matrix& m);
+		static Matrix Inverse(const Matrix& m);
 
 		Vector4& operator[](int index);
 		Vector4 operator[](int index) const;
@@ -66,4 +68,48 @@ namespace dae {
 		// v2x v2y v2z v2w
 		// v3x v3y v3z v3w
 	};
-}
\ No newline at end of file
+
+	//Transforms are on the per ray path (camera rays, instance rays) so they live in the header
+	//Row-major with row vectors: result = x * row0 + y * row1 + z * row2 (+ row3 for points)
+	inline Vector3 Matrix::TransformVector(const Vector3& v) const
+	{
+		return TransformVector(v.x, v.y, v.z);
+	}
+
+	inline Vector3 Matrix::TransformVector(float x, float y, float z) const
+	{
+#if defined(DAE_MATH_SSE)
+		__m128 r{ _mm_mul_ps(_mm_set1_ps(x), data[0].Load()) };
+		r = simd::MulAdd(_mm_set1_ps(y), data[1].Load(), r);
+		r = simd::MulAdd(_mm_set1_ps(z), data[2].Load(), r);
+		return Vector3{ Vector4::Store(r) };
+#else
+		return Vector3{
+			data[0].x * x + data[1].x * y + data[2].x * z,
+			data[0].y * x + data[1].y * y + data[2].y * z,
+			data[0].z * x + data[1].z * y + data[2].z * z
+		};
+#endif
+	}
+
+	inline Vector3 Matrix::TransformPoint(const Vector3& p) const
+	{
+		return TransformPoint(p.x, p.y, p.z);
+	}
+
+	inline Vector3 Matrix::TransformPoint(float x, float y, float z) const
+	{
+#if defined(DAE_MATH_SSE)
+		__m128 r{ simd::MulAdd(_mm_set1_ps(x), data[0].Load(), data[3].Load()) };
+		r = simd::MulAdd(_mm_set1_ps(y), data[1].Load(), r);
+		r = simd::MulAdd(_mm_set1_ps(z), data[2].Load(), r);
+		return Vector3{ Vector4::Store(r) };
+#else
+		return Vector3{
+			data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+			data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+			data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
+		};
+#endif
+	}
+}
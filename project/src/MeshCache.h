@@ -0,0 +1,323 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "DataTypes.h"
+#include "MappedFile.h"
+#include "Utils.h"
+
+namespace dae
+{
+	//Binary snapshot of a loaded and built TriangleMesh: the parsed geometry, the transformed data and every BVH layout
+	//Loading maps the file and copies each array out in one go, nothing is parsed, transformed or built again
+	//The file is only meant for the machine that wrote it, it stores the structs as they are in memory
+	namespace MeshCache
+	{
+		static constexpr uint32_t formatVersion{ 5 }; //Bump whenever a stored struct or the header changes
+		static constexpr size_t sectionAlignment{ 64 }; //Matches TriangleIntersectionData, so the mapped arrays are aligned for every type
+
+		enum Section : uint32_t
+		{
+			Positions,
+			Normals,
+			Indices,
+			VertexNormals,
+			UVs,
+			TransformedPositions,
+			TransformedNormals,
+			Triangles,
+			Nodes,
+			Nodes4,
+			Nodes8,
+			NodesQuantized4,
+			SectionCount
+		};
+
+		struct SectionRange final
+		{
+			uint64_t offset{ 0 }; //bytes from the start of the file
+			uint64_t count{ 0 }; //elements
+		};
+
+		struct Header final
+		{
+			//Declared so Header{} is value-initialized instead of aggregate initialized, which zeroes the padding as well
+			//and keeps stack garbage out of the file; the same mesh always writes the same bytes
+			Header() = default;
+
+			char magic[8]{ 'D', 'A', 'E', 'M', 'E', 'S', 'H', '\0' };
+			uint32_t version{ formatVersion };
+			uint32_t sectionCount{ SectionCount };
+
+			//The source file the cache was written from, a different size or write time makes it stale
+			uint64_t sourceSize{ 0 };
+			int64_t sourceWriteTime{ 0 };
+
+			//What the transformed data and the BVH were built with, the loading mesh has to ask for exactly the same
+			float transforms[3][16]{}; //rotation, translation, scale
+			BVHBuildSettings bvhSettings{};
+			float bvhBuildCost{ 0.f };
+
+			Vector3 minAABB{};
+			Vector3 maxAABB{};
+			Vector3 transformedMinAABB{};
+			Vector3 transformedMaxAABB{};
+
+			SectionRange sections[SectionCount]{};
+		};
+
+		inline void GetSourceStamp(const std::string& sourceFilename, uint64_t& size, int64_t& writeTime)
+		{
+			std::error_code error{};
+			size = static_cast<uint64_t>(std::filesystem::file_size(sourceFilename, error));
+			if (error)
+			{
+				size = 0;
+			}
+
+			auto const time{ std::filesystem::last_write_time(sourceFilename, error) };
+			writeTime = error ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+		}
+
+		inline void StoreMatrix(const Matrix& m, float* pDestination)
+		{
+			for (int row{ 0 }; row < 4; ++row)
+			{
+				Vector4 const r{ m[row] };
+				pDestination[row * 4 + 0] = r.x;
+				pDestination[row * 4 + 1] = r.y;
+				pDestination[row * 4 + 2] = r.z;
+				pDestination[row * 4 + 3] = r.w;
+			}
+		}
+
+		inline void StoreTransforms(const TriangleMesh& mesh, float (&transforms)[3][16])
+		{
+			StoreMatrix(mesh.rotationTransform, transforms[0]);
+			StoreMatrix(mesh.translationTransform, transforms[1]);
+			StoreMatrix(mesh.scaleTransform, transforms[2]);
+		}
+
+		inline bool AreEqual(const BVHBuildSettings& a, const BVHBuildSettings& b)
+		{
+			return a.splitMethod == b.splitMethod && a.layout == b.layout && a.binCount == b.binCount && a.maxLeafSize == b.maxLeafSize
+				&& a.traversalCost == b.traversalCost && a.intersectionCost == b.intersectionCost;
+		}
+
+		template<typename T>
+		void AddSection(Header& header, Section section, const std::vector<T>& elements, uint64_t& fileSize)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Cached arrays are copied as raw bytes");
+			static_assert(alignof(T) <= sectionAlignment);
+
+			fileSize = (fileSize + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+			header.sections[section] = { fileSize, elements.size() };
+			fileSize += elements.size() * sizeof(T);
+		}
+
+		template<typename T>
+		void WriteSection(std::ofstream& file, const Header& header, Section section, const std::vector<T>& elements)
+		{
+			//Zero padding up to the aligned offset
+			static constexpr char padding[sectionAlignment]{};
+			uint64_t const position{ static_cast<uint64_t>(file.tellp()) };
+			file.write(padding, static_cast<std::streamsize>(header.sections[section].offset - position));
+			file.write(reinterpret_cast<const char*>(elements.data()), static_cast<std::streamsize>(elements.size() * sizeof(T)));
+		}
+
+		template<typename T>
+		bool ReadSection(const MappedFile& file, const Header& header, Section section, std::vector<T>& elements)
+		{
+			SectionRange const range{ header.sections[section] };
+			if (range.offset % sectionAlignment != 0 || range.offset > file.GetSize()
+				|| range.count > (file.GetSize() - range.offset) / sizeof(T))
+			{
+				return false;
+			}
+
+			auto const pFirst{ reinterpret_cast<const T*>(file.GetData() + range.offset) };
+			elements.assign(pFirst, pFirst + range.count);
+			return true;
+		}
+
+		//Writes everything InitializeBVH produced for mesh, sourceFilename is the file it was loaded from
+		inline bool Write(const std::string& filename, const std::string& sourceFilename, const TriangleMesh& mesh)
+		{
+			Header header{};
+			GetSourceStamp(sourceFilename, header.sourceSize, header.sourceWriteTime);
+			StoreTransforms(mesh, header.transforms);
+			//Member by member, copying the struct would bring its padding along
+			header.bvhSettings.splitMethod = mesh.bvhSettings.splitMethod;
+			header.bvhSettings.layout = mesh.bvhSettings.layout;
+			header.bvhSettings.binCount = mesh.bvhSettings.binCount;
+			header.bvhSettings.maxLeafSize = mesh.bvhSettings.maxLeafSize;
+			header.bvhSettings.traversalCost = mesh.bvhSettings.traversalCost;
+			header.bvhSettings.intersectionCost = mesh.bvhSettings.intersectionCost;
+			header.bvhSettings.threadCount = mesh.bvhSettings.threadCount;
+			header.bvhBuildCost = mesh.bvhBuildCost;
+			header.minAABB = mesh.minAABB;
+			header.maxAABB = mesh.maxAABB;
+			header.transformedMinAABB = mesh.transformedMinAABB;
+			header.transformedMaxAABB = mesh.transformedMaxAABB;
+
+			uint64_t fileSize{ sizeof(Header) };
+			AddSection(header, Positions, mesh.positions, fileSize);
+			AddSection(header, Normals, mesh.normals, fileSize);
+			AddSection(header, Indices, mesh.indices, fileSize);
+			AddSection(header, VertexNormals, mesh.vertexNormals, fileSize);
+			AddSection(header, UVs, mesh.uvs, fileSize);
+			AddSection(header, TransformedPositions, mesh.transformedPositions, fileSize);
+			AddSection(header, TransformedNormals, mesh.transformedNormals, fileSize);
+			AddSection(header, Triangles, mesh.triangles, fileSize);
+			AddSection(header, Nodes, mesh.bvh, fileSize);
+			AddSection(header, Nodes4, mesh.bvh4, fileSize);
+			AddSection(header, Nodes8, mesh.bvh8, fileSize);
+			AddSection(header, NodesQuantized4, mesh.bvhQuantized4, fileSize);
+
+			std::ofstream file(filename, std::ios::binary);
+			if (!file)
+				return false;
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			WriteSection(file, header, Positions, mesh.positions);
+			WriteSection(file, header, Normals, mesh.normals);
+			WriteSection(file, header, Indices, mesh.indices);
+			WriteSection(file, header, VertexNormals, mesh.vertexNormals);
+			WriteSection(file, header, UVs, mesh.uvs);
+			WriteSection(file, header, TransformedPositions, mesh.transformedPositions);
+			WriteSection(file, header, TransformedNormals, mesh.transformedNormals);
+			WriteSection(file, header, Triangles, mesh.triangles);
+			WriteSection(file, header, Nodes, mesh.bvh);
+			WriteSection(file, header, Nodes4, mesh.bvh4);
+			WriteSection(file, header, Nodes8, mesh.bvh8);
+			WriteSection(file, header, NodesQuantized4, mesh.bvhQuantized4);
+
+			return static_cast<bool>(file);
+		}
+
+		//Fills mesh from the cache when it is current: same format version and source file, and built with mesh's transforms and settings
+		//Returns false without touching the geometry otherwise, the caller then loads the source as usual
+		inline bool Load(const std::string& filename, const std::string& sourceFilename, TriangleMesh& mesh, const BVHBuildSettings& settings = {})
+		{
+			MappedFile const file{ filename };
+			if (!file.IsOpen() || file.GetSize() < sizeof(Header))
+				return false;
+
+			//The mapping is page aligned, but copy the header anyway so it does not depend on that
+			Header header{};
+			std::memcpy(&header, file.GetData(), sizeof(Header));
+
+			Header const expected{};
+			if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0
+				|| header.version != formatVersion || header.sectionCount != SectionCount)
+				return false;
+
+			uint64_t sourceSize{};
+			int64_t sourceWriteTime{};
+			GetSourceStamp(sourceFilename, sourceSize, sourceWriteTime);
+			if (sourceSize != header.sourceSize || sourceWriteTime != header.sourceWriteTime)
+				return false;
+
+			float transforms[3][16]{};
+			StoreTransforms(mesh, transforms);
+			if (std::memcmp(transforms, header.transforms, sizeof(transforms)) != 0 || !AreEqual(settings, header.bvhSettings))
+				return false;
+
+			TriangleMesh loaded{};
+			if (!ReadSection(file, header, Positions, loaded.positions)
+				|| !ReadSection(file, header, Normals, loaded.normals)
+				|| !ReadSection(file, header, Indices, loaded.indices)
+				|| !ReadSection(file, header, VertexNormals, loaded.vertexNormals)
+				|| !ReadSection(file, header, UVs, loaded.uvs)
+				|| !ReadSection(file, header, TransformedPositions, loaded.transformedPositions)
+				|| !ReadSection(file, header, TransformedNormals, loaded.transformedNormals)
+				|| !ReadSection(file, header, Triangles, loaded.triangles)
+				|| !ReadSection(file, header, Nodes, loaded.bvh)
+				|| !ReadSection(file, header, Nodes4, loaded.bvh4)
+				|| !ReadSection(file, header, Nodes8, loaded.bvh8)
+				|| !ReadSection(file, header, NodesQuantized4, loaded.bvhQuantized4))
+				return false;
+
+			mesh.positions = std::move(loaded.positions);
+			mesh.normals = std::move(loaded.normals);
+			mesh.indices = std::move(loaded.indices);
+			mesh.vertexNormals = std::move(loaded.vertexNormals);
+			mesh.uvs = std::move(loaded.uvs);
+			mesh.transformedPositions = std::move(loaded.transformedPositions);
+			mesh.transformedNormals = std::move(loaded.transformedNormals);
+			mesh.triangles = std::move(loaded.triangles);
+			mesh.bvh = std::move(loaded.bvh);
+			mesh.bvh4 = std::move(loaded.bvh4);
+			mesh.bvh8 = std::move(loaded.bvh8);
+			mesh.bvhQuantized4 = std::move(loaded.bvhQuantized4);
+
+			mesh.bvhSettings = header.bvhSettings;
+			mesh.bvhBuildCost = header.bvhBuildCost;
+			mesh.minAABB = header.minAABB;
+			mesh.maxAABB = header.maxAABB;
+			mesh.transformedMinAABB = header.transformedMinAABB;
+			mesh.transformedMaxAABB = header.transformedMaxAABB;
+			mesh.isDirty = false;
+
+			return true;
+		}
+
+		//Cache file next to the source, named after what it was built with so differently placed copies of one OBJ each keep their own
+		inline std::string GetCacheFilename(const std::string& sourceFilename, const TriangleMesh& mesh, const BVHBuildSettings& settings)
+		{
+			float transforms[3][16]{};
+			StoreTransforms(mesh, transforms);
+
+			//FNV-1a
+			uint64_t hash{ 14695981039346656037ull };
+			auto const addBytes{ [&hash](const void* pData, size_t size)
+			{
+				for (size_t i{ 0 }; i < size; ++i)
+				{
+					hash = (hash ^ static_cast<const uint8_t*>(pData)[i]) * 1099511628211ull;
+				}
+			} };
+			addBytes(transforms, sizeof(transforms));
+			addBytes(&settings.splitMethod, sizeof(settings.splitMethod));
+			addBytes(&settings.layout, sizeof(settings.layout));
+			addBytes(&settings.binCount, sizeof(settings.binCount));
+			addBytes(&settings.maxLeafSize, sizeof(settings.maxLeafSize));
+			addBytes(&settings.traversalCost, sizeof(settings.traversalCost));
+			addBytes(&settings.intersectionCost, sizeof(settings.intersectionCost));
+
+			char name[17]{};
+			std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+			return sourceFilename + "." + name + ".meshcache";
+		}
+
+		//Set the mesh transforms first; loads the matching cache when it is current
+		//Otherwise parses the OBJ, updates the transforms, builds the BVH and writes the cache for the next run
+		inline bool LoadOBJ(const std::string& objFilename, TriangleMesh& mesh, const BVHBuildSettings& settings = {})
+		{
+			std::string const cacheFilename{ GetCacheFilename(objFilename, mesh, settings) };
+			if (Load(cacheFilename, objFilename, mesh, settings))
+				return true;
+
+			if (!Utils::ParseOBJ(objFilename, mesh))
+				return false;
+
+			mesh.UpdateAABB();
+			mesh.UpdateTransforms(true);
+			mesh.InitializeBVH(settings);
+
+			//A failed write only costs the next run a parse
+			Write(cacheFilename, objFilename, mesh);
+			return true;
+		}
+	}
+}
+
+#endif
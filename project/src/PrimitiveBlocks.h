@@ -0,0 +1,314 @@
+#ifndef PRIMITIVEBLOCKS_H
+#define PRIMITIVEBLOCKS_H
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cfloat>
+#include <limits>
+#include <stdint.h>
+
+#include "MathSIMD.h"
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Up to 8 spheres stored SoA, a single ray is tested against all of them at once (one AVX or two SSE iterations)
+	//Unused slots keep a NaN origin, every comparison on them fails so they never report a hit
+	struct alignas(32) SphereBlock final
+	{
+		static constexpr uint32_t width{ 8 };
+
+		float originX[width];
+		float originY[width];
+		float originZ[width];
+		float radius[width];
+		MaterialId materialIndex[width];
+		uint32_t count{ 0 }; //slots [0, count) are in use
+
+		SphereBlock()
+		{
+			for (uint32_t i{ 0 }; i < width; ++i)
+			{
+				originX[i] = originY[i] = originZ[i] = std::numeric_limits<float>::quiet_NaN();
+				radius[i] = 0.f;
+				materialIndex[i] = 0;
+			}
+		}
+
+		void Add(const Sphere& sphere)
+		{
+			assert(count < width);
+
+			uint32_t const i{ count++ };
+			originX[i] = sphere.origin.x;
+			originY[i] = sphere.origin.y;
+			originZ[i] = sphere.origin.z;
+			radius[i] = sphere.radius;
+			materialIndex[i] = sphere.materialIndex;
+		}
+
+		Sphere Get(uint32_t slot) const
+		{
+			return { { originX[slot], originY[slot], originZ[slot] }, radius[slot], materialIndex[slot] };
+		}
+
+		//Same quadratic as GeometryUtils::HitTest_Sphere for every slot, evaluated in the same order so t matches bit for bit
+		//Writes the hit distance of every slot to pT (FLT_MAX where it misses) and returns the slots hit within [ray.min, ray.max]
+		uint32_t Intersect(const Ray& ray, float* pT) const;
+	};
+
+	//Up to 8 planes stored SoA, same layout rules as SphereBlock
+	struct alignas(32) PlaneBlock final
+	{
+		static constexpr uint32_t width{ 8 };
+
+		float originX[width];
+		float originY[width];
+		float originZ[width];
+		float normalX[width];
+		float normalY[width];
+		float normalZ[width];
+		MaterialId materialIndex[width];
+		uint32_t count{ 0 }; //slots [0, count) are in use
+
+		PlaneBlock()
+		{
+			for (uint32_t i{ 0 }; i < width; ++i)
+			{
+				originX[i] = originY[i] = originZ[i] = std::numeric_limits<float>::quiet_NaN();
+				normalX[i] = normalY[i] = normalZ[i] = 0.f;
+				materialIndex[i] = 0;
+			}
+		}
+
+		void Add(const Plane& plane)
+		{
+			assert(count < width);
+
+			uint32_t const i{ count++ };
+			originX[i] = plane.origin.x;
+			originY[i] = plane.origin.y;
+			originZ[i] = plane.origin.z;
+			normalX[i] = plane.normal.x;
+			normalY[i] = plane.normal.y;
+			normalZ[i] = plane.normal.z;
+			materialIndex[i] = plane.materialIndex;
+		}
+
+		Plane Get(uint32_t slot) const
+		{
+			return { { originX[slot], originY[slot], originZ[slot] }, { normalX[slot], normalY[slot], normalZ[slot] }, materialIndex[slot] };
+		}
+
+		//Writes the hit distance of every slot to pT (FLT_MAX where it misses) and returns the slots hit within [ray.min, ray.max]
+		uint32_t Intersect(const Ray& ray, float* pT) const;
+	};
+
+	//Slot with the smallest distance among hitMask, the lowest slot wins a tie so the order matches a front to back loop
+	//pT has to hold FLT_MAX for every slot outside of hitMask, as Intersect leaves it
+	inline uint32_t ClosestSlot(const float* pT, uint32_t hitMask)
+	{
+		assert(hitMask != 0);
+
+#if defined(DAE_MATH_AVX)
+		__m256 const t{ _mm256_loadu_ps(pT) };
+		__m256 closest{ _mm256_min_ps(t, _mm256_permute2f128_ps(t, t, 1)) };
+		closest = _mm256_min_ps(closest, _mm256_shuffle_ps(closest, closest, _MM_SHUFFLE(1, 0, 3, 2)));
+		closest = _mm256_min_ps(closest, _mm256_shuffle_ps(closest, closest, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		uint32_t const closestMask{ static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(t, closest, _CMP_EQ_OQ))) & hitMask };
+#elif defined(DAE_MATH_SSE)
+		__m128 const low{ _mm_loadu_ps(pT) };
+		__m128 const high{ _mm_loadu_ps(pT + 4) };
+		__m128 closest{ _mm_min_ps(low, high) };
+		closest = _mm_min_ps(closest, _mm_shuffle_ps(closest, closest, _MM_SHUFFLE(1, 0, 3, 2)));
+		closest = _mm_min_ps(closest, _mm_shuffle_ps(closest, closest, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		uint32_t const closestMask{ (static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpeq_ps(low, closest)))
+			| static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpeq_ps(high, closest))) << 4) & hitMask };
+#else
+		float closest{ FLT_MAX };
+		for (uint32_t mask{ hitMask }; mask; mask &= mask - 1)
+		{
+			closest = std::min(closest, pT[std::countr_zero(mask)]);
+		}
+
+		uint32_t closestMask{ 0 };
+		for (uint32_t mask{ hitMask }; mask; mask &= mask - 1)
+		{
+			uint32_t const slot{ static_cast<uint32_t>(std::countr_zero(mask)) };
+			closestMask |= static_cast<uint32_t>(pT[slot] == closest) << slot;
+		}
+#endif
+
+		return static_cast<uint32_t>(std::countr_zero(closestMask));
+	}
+
+#if defined(DAE_MATH_SSE) && !defined(DAE_MATH_AVX)
+	namespace simd
+	{
+		//Sphere slots [first, first + 4) of a block, t receives the distance or FLT_MAX; returns the 4 bit hit mask
+		inline uint32_t IntersectSpheres4(const SphereBlock& block, uint32_t first, const Ray& ray, float* pT)
+		{
+			__m128 const two{ _mm_set1_ps(2.f) };
+			__m128 const four{ _mm_set1_ps(4.f) };
+			__m128 const dx{ _mm_set1_ps(ray.direction.x) };
+			__m128 const dy{ _mm_set1_ps(ray.direction.y) };
+			__m128 const dz{ _mm_set1_ps(ray.direction.z) };
+			__m128 const tMin{ _mm_set1_ps(ray.min) };
+			__m128 const tMax{ _mm_set1_ps(ray.max) };
+
+			__m128 const ocx{ _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(block.originX + first)) };
+			__m128 const ocy{ _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(block.originY + first)) };
+			__m128 const ocz{ _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(block.originZ + first)) };
+			__m128 const r{ _mm_load_ps(block.radius + first) };
+
+			__m128 const a{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)) };
+			__m128 const b{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(two, dx), ocx), _mm_mul_ps(_mm_mul_ps(two, dy), ocy)), _mm_mul_ps(_mm_mul_ps(two, dz), ocz)) };
+			__m128 const c{ _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), _mm_mul_ps(r, r)) };
+			__m128 const d{ _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(_mm_mul_ps(four, a), c)) };
+
+			__m128 const root{ _mm_sqrt_ps(d) };
+			__m128 const negB{ _mm_xor_ps(b, _mm_set1_ps(-0.f)) };
+			__m128 const t1{ _mm_mul_ps(_mm_div_ps(_mm_sub_ps(negB, root), two), a) };
+			__m128 const t2{ _mm_mul_ps(_mm_div_ps(_mm_add_ps(negB, root), two), a) };
+
+			//The near root unless it is out of range, like the scalar test
+			__m128 const inside1{ _mm_and_ps(_mm_cmpge_ps(t1, tMin), _mm_cmple_ps(t1, tMax)) };
+			__m128 const inside2{ _mm_and_ps(_mm_cmpge_ps(t2, tMin), _mm_cmple_ps(t2, tMax)) };
+			__m128 const t{ _mm_or_ps(_mm_and_ps(inside1, t1), _mm_andnot_ps(inside1, t2)) };
+			__m128 const hit{ _mm_and_ps(_mm_or_ps(inside1, inside2), _mm_cmpgt_ps(d, _mm_setzero_ps())) };
+
+			_mm_storeu_ps(pT, _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, _mm_set1_ps(FLT_MAX))));
+			return static_cast<uint32_t>(_mm_movemask_ps(hit));
+		}
+
+		//Plane slots [first, first + 4) of a block, t receives the distance or FLT_MAX; returns the 4 bit hit mask
+		inline uint32_t IntersectPlanes4(const PlaneBlock& block, uint32_t first, const Ray& ray, float* pT)
+		{
+			__m128 const nx{ _mm_load_ps(block.normalX + first) };
+			__m128 const ny{ _mm_load_ps(block.normalY + first) };
+			__m128 const nz{ _mm_load_ps(block.normalZ + first) };
+
+			__m128 const numerator{ _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.originX + first), _mm_set1_ps(ray.origin.x)), nx),
+				_mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.originY + first), _mm_set1_ps(ray.origin.y)), ny)),
+				_mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.originZ + first), _mm_set1_ps(ray.origin.z)), nz)) };
+			__m128 const denominator{ _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(ray.direction.x), nx),
+				_mm_mul_ps(_mm_set1_ps(ray.direction.y), ny)),
+				_mm_mul_ps(_mm_set1_ps(ray.direction.z), nz)) };
+			__m128 const t{ _mm_div_ps(numerator, denominator) };
+
+			__m128 const hit{ _mm_and_ps(_mm_cmpge_ps(t, _mm_set1_ps(ray.min)), _mm_cmple_ps(t, _mm_set1_ps(ray.max))) };
+
+			_mm_storeu_ps(pT, _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, _mm_set1_ps(FLT_MAX))));
+			return static_cast<uint32_t>(_mm_movemask_ps(hit));
+		}
+	}
+#endif
+
+	inline uint32_t SphereBlock::Intersect(const Ray& ray, float* pT) const
+	{
+#if defined(DAE_MATH_AVX)
+		__m256 const two{ _mm256_set1_ps(2.f) };
+		__m256 const four{ _mm256_set1_ps(4.f) };
+		__m256 const dx{ _mm256_set1_ps(ray.direction.x) };
+		__m256 const dy{ _mm256_set1_ps(ray.direction.y) };
+		__m256 const dz{ _mm256_set1_ps(ray.direction.z) };
+		__m256 const tMin{ _mm256_set1_ps(ray.min) };
+		__m256 const tMax{ _mm256_set1_ps(ray.max) };
+
+		__m256 const ocx{ _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(originX)) };
+		__m256 const ocy{ _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(originY)) };
+		__m256 const ocz{ _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(originZ)) };
+		__m256 const r{ _mm256_load_ps(radius) };
+
+		__m256 const a{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)) };
+		__m256 const b{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(two, dx), ocx), _mm256_mul_ps(_mm256_mul_ps(two, dy), ocy)), _mm256_mul_ps(_mm256_mul_ps(two, dz), ocz)) };
+		__m256 const c{ _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)), _mm256_mul_ps(r, r)) };
+		__m256 const d{ _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(_mm256_mul_ps(four, a), c)) };
+
+		__m256 const root{ _mm256_sqrt_ps(d) };
+		__m256 const negB{ _mm256_xor_ps(b, _mm256_set1_ps(-0.f)) };
+		__m256 const t1{ _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(negB, root), two), a) };
+		__m256 const t2{ _mm256_mul_ps(_mm256_div_ps(_mm256_add_ps(negB, root), two), a) };
+
+		//The near root unless it is out of range, like the scalar test
+		__m256 const inside1{ _mm256_and_ps(_mm256_cmp_ps(t1, tMin, _CMP_GE_OQ), _mm256_cmp_ps(t1, tMax, _CMP_LE_OQ)) };
+		__m256 const inside2{ _mm256_and_ps(_mm256_cmp_ps(t2, tMin, _CMP_GE_OQ), _mm256_cmp_ps(t2, tMax, _CMP_LE_OQ)) };
+		__m256 const t{ _mm256_blendv_ps(t2, t1, inside1) };
+		__m256 const hit{ _mm256_and_ps(_mm256_or_ps(inside1, inside2), _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GT_OQ)) };
+
+		_mm256_storeu_ps(pT, _mm256_blendv_ps(_mm256_set1_ps(FLT_MAX), t, hit));
+		return static_cast<uint32_t>(_mm256_movemask_ps(hit));
+#elif defined(DAE_MATH_SSE)
+		return simd::IntersectSpheres4(*this, 0, ray, pT) | simd::IntersectSpheres4(*this, 4, ray, pT + 4) << 4;
+#else
+		uint32_t hitMask{ 0 };
+		for (uint32_t i{ 0 }; i < width; ++i)
+		{
+			Vector3 const oc{ ray.origin - Vector3{ originX[i], originY[i], originZ[i] } };
+
+			float const a{ Vector3::Dot(ray.direction, ray.direction) };
+			float const b{ Vector3::Dot(2 * ray.direction, oc) };
+			float const c{ Vector3::Dot(oc, oc) - radius[i] * radius[i] };
+			float const d{ b * b - 4 * a * c };
+
+			float t{ (-b - std::sqrt(d)) / 2 * a };
+			if (!(t >= ray.min && t <= ray.max))
+			{
+				t = (-b + std::sqrt(d)) / 2 * a;
+			}
+
+			bool const hit{ d > 0 && t >= ray.min && t <= ray.max };
+			pT[i] = hit ? t : FLT_MAX;
+			hitMask |= static_cast<uint32_t>(hit) << i;
+		}
+		return hitMask;
+#endif
+	}
+
+	inline uint32_t PlaneBlock::Intersect(const Ray& ray, float* pT) const
+	{
+#if defined(DAE_MATH_AVX)
+		__m256 const nx{ _mm256_load_ps(normalX) };
+		__m256 const ny{ _mm256_load_ps(normalY) };
+		__m256 const nz{ _mm256_load_ps(normalZ) };
+
+		__m256 const numerator{ _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(originX), _mm256_set1_ps(ray.origin.x)), nx),
+			_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(originY), _mm256_set1_ps(ray.origin.y)), ny)),
+			_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(originZ), _mm256_set1_ps(ray.origin.z)), nz)) };
+		__m256 const denominator{ _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(_mm256_set1_ps(ray.direction.x), nx),
+			_mm256_mul_ps(_mm256_set1_ps(ray.direction.y), ny)),
+			_mm256_mul_ps(_mm256_set1_ps(ray.direction.z), nz)) };
+		__m256 const t{ _mm256_div_ps(numerator, denominator) };
+
+		__m256 const hit{ _mm256_and_ps(_mm256_cmp_ps(t, _mm256_set1_ps(ray.min), _CMP_GE_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(ray.max), _CMP_LE_OQ)) };
+
+		_mm256_storeu_ps(pT, _mm256_blendv_ps(_mm256_set1_ps(FLT_MAX), t, hit));
+		return static_cast<uint32_t>(_mm256_movemask_ps(hit));
+#elif defined(DAE_MATH_SSE)
+		return simd::IntersectPlanes4(*this, 0, ray, pT) | simd::IntersectPlanes4(*this, 4, ray, pT + 4) << 4;
+#else
+		uint32_t hitMask{ 0 };
+		for (uint32_t i{ 0 }; i < width; ++i)
+		{
+			Vector3 const origin{ originX[i], originY[i], originZ[i] };
+			Vector3 const normal{ normalX[i], normalY[i], normalZ[i] };
+
+			float const t{ Vector3::Dot((origin - ray.origin), normal) / Vector3::Dot(ray.direction, normal) };
+
+			bool const hit{ t >= ray.min && t <= ray.max };
+			pT[i] = hit ? t : FLT_MAX;
+			hitMask |= static_cast<uint32_t>(hit) << i;
+		}
+		return hitMask;
+#endif
+	}
+}
+
+#endif
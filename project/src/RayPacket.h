@@ -0,0 +1,795 @@
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <stdint.h>
+
+#include "MathSIMD.h"
+#include "DataTypes.h"
+#include "PrimitiveBlocks.h"
+#include "Utils.h"
+
+namespace dae
+{
+	//Up to Width coherent rays traced together, camera rays of neighbouring pixels or the shadow rays of one hit
+	//The rays are stored SoA so every per lane loop maps onto SIMD registers, the results are ordinary HitRecords
+	template<uint32_t Width>
+	struct alignas(64) RayPacket final
+	{
+		static_assert(Width == 4 || Width == 8 || Width == 16, "Packets are 4, 8 or 16 rays wide");
+
+		float originX[Width];
+		float originY[Width];
+		float originZ[Width];
+		float directionX[Width];
+		float directionY[Width];
+		float directionZ[Width];
+		float invDirectionX[Width];
+		float invDirectionY[Width];
+		float invDirectionZ[Width];
+		float min[Width];
+		float max[Width];
+
+		HitRecord hits[Width];
+		uint32_t count{ 0 }; //lanes [0, count) are in use
+
+		//Interval bounds of all origins and inverse directions, a box outside of them is missed by every ray
+		float frustumOriginMin[3];
+		float frustumOriginMax[3];
+		float frustumInvDirMin[3];
+		float frustumInvDirMax[3];
+		bool hasFrustum{ false };
+
+		void Reset()
+		{
+			count = 0;
+			hasFrustum = false;
+		}
+
+		void Add(const Ray& ray)
+		{
+			assert(count < Width);
+
+			uint32_t const i{ count++ };
+			originX[i] = ray.origin.x;
+			originY[i] = ray.origin.y;
+			originZ[i] = ray.origin.z;
+			directionX[i] = ray.direction.x;
+			directionY[i] = ray.direction.y;
+			directionZ[i] = ray.direction.z;
+			min[i] = ray.min;
+			max[i] = ray.max;
+			hits[i] = HitRecord{};
+		}
+
+		Ray GetRay(uint32_t lane) const
+		{
+			return { { originX[lane], originY[lane], originZ[lane] }, { directionX[lane], directionY[lane], directionZ[lane] }, min[lane], max[lane] };
+		}
+
+		uint32_t GetLaneMask() const { return (1u << count) - 1; }
+
+		//Call once after the last Add, before any packet test
+		//Unused lanes get a degenerate ray that misses everything, then the inverse directions and the frustum are computed
+		void Finalize()
+		{
+			for (uint32_t i{ count }; i < Width; ++i)
+			{
+				originX[i] = originY[i] = originZ[i] = 0.f;
+				directionX[i] = directionY[i] = directionZ[i] = 1.f;
+				min[i] = 0.f;
+				max[i] = -1.f;
+			}
+
+			for (uint32_t i{ 0 }; i < Width; ++i)
+			{
+				invDirectionX[i] = 1.f / directionX[i];
+				invDirectionY[i] = 1.f / directionY[i];
+				invDirectionZ[i] = 1.f / directionZ[i];
+			}
+
+			ComputeFrustum();
+		}
+
+		//Only usable when every ray points the same way along each axis, a mixed sign makes the interval unbounded
+		void ComputeFrustum()
+		{
+			float const* const origins[3]{ originX, originY, originZ };
+			float const* const directions[3]{ directionX, directionY, directionZ };
+			float const* const invDirections[3]{ invDirectionX, invDirectionY, invDirectionZ };
+
+			hasFrustum = count > 1;
+			for (uint32_t axis{ 0 }; axis < 3 && hasFrustum; ++axis)
+			{
+				frustumOriginMin[axis] = frustumOriginMax[axis] = origins[axis][0];
+				frustumInvDirMin[axis] = frustumInvDirMax[axis] = invDirections[axis][0];
+
+				bool const positive{ directions[axis][0] > 0.f };
+				for (uint32_t i{ 0 }; i < count; ++i)
+				{
+					if (directions[axis][i] == 0.f || (directions[axis][i] > 0.f) != positive)
+					{
+						hasFrustum = false;
+						break;
+					}
+
+					frustumOriginMin[axis] = std::min(frustumOriginMin[axis], origins[axis][i]);
+					frustumOriginMax[axis] = std::max(frustumOriginMax[axis], origins[axis][i]);
+					frustumInvDirMin[axis] = std::min(frustumInvDirMin[axis], invDirections[axis][i]);
+					frustumInvDirMax[axis] = std::max(frustumInvDirMax[axis], invDirections[axis][i]);
+				}
+			}
+		}
+
+		//Interval arithmetic slab test, true when no ray of the packet can hit the box before maxDistance
+		bool FrustumMisses(const Vector3& bmin, const Vector3& bmax, float maxDistance) const
+		{
+			if (!hasFrustum)
+			{
+				return false;
+			}
+
+			float entry{ -FLT_MAX };
+			float exit{ FLT_MAX };
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				bool const positive{ frustumInvDirMin[axis] > 0.f };
+				float const nearSlab{ positive ? bmin[axis] : bmax[axis] };
+				float const farSlab{ positive ? bmax[axis] : bmin[axis] };
+
+				float const invMin{ frustumInvDirMin[axis] };
+				float const invMax{ frustumInvDirMax[axis] };
+
+				float const nearLow{ nearSlab - frustumOriginMax[axis] };
+				float const nearHigh{ nearSlab - frustumOriginMin[axis] };
+				float const farLow{ farSlab - frustumOriginMax[axis] };
+				float const farHigh{ farSlab - frustumOriginMin[axis] };
+
+				entry = std::max(entry, std::min(std::min(nearLow * invMin, nearLow * invMax), std::min(nearHigh * invMin, nearHigh * invMax)));
+				exit = std::min(exit, std::max(std::max(farLow * invMin, farLow * invMax), std::max(farHigh * invMin, farHigh * invMax)));
+			}
+
+			return entry > exit || exit < 0.f || entry > maxDistance;
+		}
+
+		//Slab test of every lane in laneMask against one box, tMax is the per lane far limit; returns the lanes that hit
+		uint32_t IntersectAABB(const Vector3& bmin, const Vector3& bmax, const float* tMax, uint32_t laneMask) const;
+	};
+
+	template<uint32_t Width>
+	inline uint32_t RayPacket<Width>::IntersectAABB(const Vector3& bmin, const Vector3& bmax, const float* tMax, uint32_t laneMask) const
+	{
+		uint32_t mask{ 0 };
+
+#if defined(DAE_MATH_SSE)
+		__m128 const minX{ _mm_set1_ps(bmin.x) };
+		__m128 const minY{ _mm_set1_ps(bmin.y) };
+		__m128 const minZ{ _mm_set1_ps(bmin.z) };
+		__m128 const maxX{ _mm_set1_ps(bmax.x) };
+		__m128 const maxY{ _mm_set1_ps(bmax.y) };
+		__m128 const maxZ{ _mm_set1_ps(bmax.z) };
+
+		for (uint32_t i{ 0 }; i < Width; i += 4)
+		{
+			__m128 const ox{ _mm_load_ps(originX + i) };
+			__m128 const oy{ _mm_load_ps(originY + i) };
+			__m128 const oz{ _mm_load_ps(originZ + i) };
+			__m128 const idx{ _mm_load_ps(invDirectionX + i) };
+			__m128 const idy{ _mm_load_ps(invDirectionY + i) };
+			__m128 const idz{ _mm_load_ps(invDirectionZ + i) };
+
+			__m128 const tx1{ _mm_mul_ps(_mm_sub_ps(minX, ox), idx) };
+			__m128 const tx2{ _mm_mul_ps(_mm_sub_ps(maxX, ox), idx) };
+			__m128 const ty1{ _mm_mul_ps(_mm_sub_ps(minY, oy), idy) };
+			__m128 const ty2{ _mm_mul_ps(_mm_sub_ps(maxY, oy), idy) };
+			__m128 const tz1{ _mm_mul_ps(_mm_sub_ps(minZ, oz), idz) };
+			__m128 const tz2{ _mm_mul_ps(_mm_sub_ps(maxZ, oz), idz) };
+
+			__m128 const tmin{ _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)), _mm_max_ps(_mm_min_ps(tz1, tz2), _mm_load_ps(min + i))) };
+			__m128 const tmax{ _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_min_ps(_mm_max_ps(tz1, tz2), _mm_loadu_ps(tMax + i))) };
+
+			mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tmin, tmax))) << i;
+		}
+#else
+		for (uint32_t i{ 0 }; i < Width; ++i)
+		{
+			float const tx1{ (bmin.x - originX[i]) * invDirectionX[i] };
+			float const tx2{ (bmax.x - originX[i]) * invDirectionX[i] };
+			float const ty1{ (bmin.y - originY[i]) * invDirectionY[i] };
+			float const ty2{ (bmax.y - originY[i]) * invDirectionY[i] };
+			float const tz1{ (bmin.z - originZ[i]) * invDirectionZ[i] };
+			float const tz2{ (bmax.z - originZ[i]) * invDirectionZ[i] };
+
+			float const tmin{ std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), min[i])) };
+			float const tmax{ std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), tMax[i])) };
+
+			mask |= static_cast<uint32_t>(tmin <= tmax) << i;
+		}
+#endif
+
+		return mask & laneMask;
+	}
+
+	namespace GeometryUtils
+	{
+#pragma region Packet HitTests
+		//Every lane runs the exact arithmetic of the single ray tests, so a packet finds the same hits as tracing its rays one by one
+		//Each group of 4 lanes is loaded once and walks every slot of the block, broadcasting the slot straight from the SoA arrays
+		//Lanes that hit closer than pClosestT take firstIdx + slot as their closest primitive; only the distance and the index are kept,
+		//the caller fills each lane's HitRecord once after the last block, like GetClosestHit does for a single ray
+		//pClosestT and pClosestIdx hold Width entries and are 16 byte aligned, unused lanes carry degenerate rays that never hit
+		template<uint32_t Width>
+		inline void HitTest_SphereBlock(const SphereBlock& block, uint32_t firstIdx, const RayPacket<Width>& packet, float* pClosestT, uint32_t* pClosestIdx)
+		{
+#if defined(DAE_MATH_SSE)
+			__m128 const two{ _mm_set1_ps(2.f) };
+			__m128 const four{ _mm_set1_ps(4.f) };
+			__m128 const zero{ _mm_setzero_ps() };
+			__m128 const signBit{ _mm_set1_ps(-0.f) };
+
+			for (uint32_t i{ 0 }; i < Width; i += 4)
+			{
+				__m128 const ox{ _mm_load_ps(packet.originX + i) };
+				__m128 const oy{ _mm_load_ps(packet.originY + i) };
+				__m128 const oz{ _mm_load_ps(packet.originZ + i) };
+				__m128 const dx{ _mm_load_ps(packet.directionX + i) };
+				__m128 const dy{ _mm_load_ps(packet.directionY + i) };
+				__m128 const dz{ _mm_load_ps(packet.directionZ + i) };
+				__m128 const tMin{ _mm_load_ps(packet.min + i) };
+				__m128 const tMax{ _mm_load_ps(packet.max + i) };
+				__m128 const a{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)) };
+
+				__m128 closestT{ _mm_load_ps(pClosestT + i) };
+				__m128 closestIdx{ _mm_load_ps(reinterpret_cast<const float*>(pClosestIdx + i)) };
+
+				for (uint32_t slot{ 0 }; slot < block.count; ++slot)
+				{
+					__m128 const ocx{ _mm_sub_ps(ox, _mm_set1_ps(block.originX[slot])) };
+					__m128 const ocy{ _mm_sub_ps(oy, _mm_set1_ps(block.originY[slot])) };
+					__m128 const ocz{ _mm_sub_ps(oz, _mm_set1_ps(block.originZ[slot])) };
+
+					__m128 const b{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(two, dx), ocx), _mm_mul_ps(_mm_mul_ps(two, dy), ocy)), _mm_mul_ps(_mm_mul_ps(two, dz), ocz)) };
+					__m128 const c{ _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), _mm_set1_ps(block.radius[slot] * block.radius[slot])) };
+					__m128 const d{ _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(_mm_mul_ps(four, a), c)) };
+
+					__m128 const root{ _mm_sqrt_ps(d) };
+					__m128 const negB{ _mm_xor_ps(b, signBit) };
+					__m128 const t1{ _mm_mul_ps(_mm_div_ps(_mm_sub_ps(negB, root), two), a) };
+					__m128 const t2{ _mm_mul_ps(_mm_div_ps(_mm_add_ps(negB, root), two), a) };
+
+					//Take the far root where the near one is out of range, then keep the lanes whose root is in range and closer
+					__m128 const outside1{ _mm_or_ps(_mm_cmpgt_ps(t1, tMax), _mm_cmplt_ps(t1, tMin)) };
+					__m128 const t{ _mm_or_ps(_mm_and_ps(outside1, t2), _mm_andnot_ps(outside1, t1)) };
+					__m128 const outside{ _mm_or_ps(_mm_cmpgt_ps(t, tMax), _mm_cmplt_ps(t, tMin)) };
+					__m128 const hit{ _mm_andnot_ps(outside, _mm_and_ps(_mm_cmpgt_ps(d, zero), _mm_cmplt_ps(t, closestT))) };
+
+					__m128 const index{ _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(firstIdx + slot))) };
+					closestT = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, closestT));
+					closestIdx = _mm_or_ps(_mm_and_ps(hit, index), _mm_andnot_ps(hit, closestIdx));
+				}
+
+				_mm_store_ps(pClosestT + i, closestT);
+				_mm_store_ps(reinterpret_cast<float*>(pClosestIdx + i), closestIdx);
+			}
+#else
+			for (uint32_t i{ 0 }; i < packet.count; ++i)
+			{
+				Ray const ray{ packet.GetRay(i) };
+
+				for (uint32_t slot{ 0 }; slot < block.count; ++slot)
+				{
+					Sphere const sphere{ block.Get(slot) };
+
+					auto const a{ Vector3::Dot(ray.direction, ray.direction) };
+					auto const b{ Vector3::Dot(2 * ray.direction , (ray.origin - sphere.origin)) };
+					auto const c{ Vector3::Dot(ray.origin - sphere.origin, ray.origin - sphere.origin) - sphere.radius * sphere.radius };
+
+					auto const d{ b * b - 4 * a * c };
+					if (d <= 0)
+					{
+						continue;
+					}
+
+					float t{ (-b - std::sqrt(d)) / 2 * a };
+					if (t > ray.max || t < ray.min)
+					{
+						t = (-b + std::sqrt(d)) / 2 * a;
+					}
+
+					if (t > ray.max || t < ray.min || !(t < pClosestT[i]))
+					{
+						continue;
+					}
+
+					pClosestT[i] = t;
+					pClosestIdx[i] = firstIdx + slot;
+				}
+			}
+#endif
+		}
+
+		template<uint32_t Width>
+		inline void HitTest_PlaneBlock(const PlaneBlock& block, uint32_t firstIdx, const RayPacket<Width>& packet, float* pClosestT, uint32_t* pClosestIdx)
+		{
+#if defined(DAE_MATH_SSE)
+			for (uint32_t i{ 0 }; i < Width; i += 4)
+			{
+				__m128 const ox{ _mm_load_ps(packet.originX + i) };
+				__m128 const oy{ _mm_load_ps(packet.originY + i) };
+				__m128 const oz{ _mm_load_ps(packet.originZ + i) };
+				__m128 const dx{ _mm_load_ps(packet.directionX + i) };
+				__m128 const dy{ _mm_load_ps(packet.directionY + i) };
+				__m128 const dz{ _mm_load_ps(packet.directionZ + i) };
+				__m128 const tMin{ _mm_load_ps(packet.min + i) };
+				__m128 const tMax{ _mm_load_ps(packet.max + i) };
+
+				__m128 closestT{ _mm_load_ps(pClosestT + i) };
+				__m128 closestIdx{ _mm_load_ps(reinterpret_cast<const float*>(pClosestIdx + i)) };
+
+				for (uint32_t slot{ 0 }; slot < block.count; ++slot)
+				{
+					__m128 const normalX{ _mm_set1_ps(block.normalX[slot]) };
+					__m128 const normalY{ _mm_set1_ps(block.normalY[slot]) };
+					__m128 const normalZ{ _mm_set1_ps(block.normalZ[slot]) };
+
+					__m128 const numerator{ _mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(block.originX[slot]), ox), normalX),
+						_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(block.originY[slot]), oy), normalY)),
+						_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(block.originZ[slot]), oz), normalZ)) };
+					__m128 const denominator{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, normalX), _mm_mul_ps(dy, normalY)), _mm_mul_ps(dz, normalZ)) };
+					__m128 const t{ _mm_div_ps(numerator, denominator) };
+
+					__m128 const outside{ _mm_or_ps(_mm_cmplt_ps(t, tMin), _mm_cmpgt_ps(t, tMax)) };
+					__m128 const hit{ _mm_andnot_ps(outside, _mm_cmplt_ps(t, closestT)) };
+
+					__m128 const index{ _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(firstIdx + slot))) };
+					closestT = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, closestT));
+					closestIdx = _mm_or_ps(_mm_and_ps(hit, index), _mm_andnot_ps(hit, closestIdx));
+				}
+
+				_mm_store_ps(pClosestT + i, closestT);
+				_mm_store_ps(reinterpret_cast<float*>(pClosestIdx + i), closestIdx);
+			}
+#else
+			for (uint32_t i{ 0 }; i < packet.count; ++i)
+			{
+				Vector3 const origin{ packet.originX[i], packet.originY[i], packet.originZ[i] };
+				Vector3 const direction{ packet.directionX[i], packet.directionY[i], packet.directionZ[i] };
+
+				for (uint32_t slot{ 0 }; slot < block.count; ++slot)
+				{
+					Plane const plane{ block.Get(slot) };
+
+					float const t{ Vector3::Dot((plane.origin - origin), plane.normal) / Vector3::Dot(direction, plane.normal) };
+					if (t < packet.min[i] || t > packet.max[i] || !(t < pClosestT[i]))
+					{
+						continue;
+					}
+
+					pClosestT[i] = t;
+					pClosestIdx[i] = firstIdx + slot;
+				}
+			}
+#endif
+		}
+
+		//Moller-Trumbore for every lane at once, branch free so the lane loop vectorizes
+		//Returns the lanes that hit within [min, tMax] and writes their distance and barycentrics; invertCulling as in the single ray test
+		template<uint32_t Width>
+		inline uint32_t IntersectTriangle(const TriangleIntersectionData& triangle, const RayPacket<Width>& packet, const float* tMax, float* tHit, float* uHit, float* vHit, bool invertCulling = false)
+		{
+			TriangleCullMode const cullMode{ !invertCulling ? triangle.cullMode
+				: triangle.cullMode == TriangleCullMode::BackFaceCulling ? TriangleCullMode::FrontFaceCulling
+				: triangle.cullMode == TriangleCullMode::FrontFaceCulling ? TriangleCullMode::BackFaceCulling
+				: triangle.cullMode };
+
+			uint32_t mask{ 0 };
+			for (uint32_t i{ 0 }; i < Width; ++i)
+			{
+				float const dx{ packet.directionX[i] };
+				float const dy{ packet.directionY[i] };
+				float const dz{ packet.directionZ[i] };
+
+				float const dotProd{ triangle.normal.x * dx + triangle.normal.y * dy + triangle.normal.z * dz };
+				bool const culled{ (cullMode == TriangleCullMode::BackFaceCulling && dotProd > 0.f)
+					|| (cullMode == TriangleCullMode::FrontFaceCulling && dotProd < 0.f) };
+
+				//pvec = direction x edge2
+				float const px{ dy * triangle.edge2.z - dz * triangle.edge2.y };
+				float const py{ dz * triangle.edge2.x - dx * triangle.edge2.z };
+				float const pz{ dx * triangle.edge2.y - dy * triangle.edge2.x };
+
+				float const det{ triangle.edge1.x * px + triangle.edge1.y * py + triangle.edge1.z * pz };
+				float const invDet{ 1.f / det };
+
+				float const tx{ packet.originX[i] - triangle.v0.x };
+				float const ty{ packet.originY[i] - triangle.v0.y };
+				float const tz{ packet.originZ[i] - triangle.v0.z };
+
+				float const u{ (tx * px + ty * py + tz * pz) * invDet };
+
+				//qvec = tvec x edge1
+				float const qx{ ty * triangle.edge1.z - tz * triangle.edge1.y };
+				float const qy{ tz * triangle.edge1.x - tx * triangle.edge1.z };
+				float const qz{ tx * triangle.edge1.y - ty * triangle.edge1.x };
+
+				float const v{ (dx * qx + dy * qy + dz * qz) * invDet };
+				float const t{ (triangle.edge2.x * qx + triangle.edge2.y * qy + triangle.edge2.z * qz) * invDet };
+
+				bool const hit{ !culled && !AreEqual(det, 0.f, 1e-12f)
+					&& u >= 0.f && u <= 1.f && v >= 0.f && u + v <= 1.f
+					&& t >= packet.min[i] && t <= tMax[i] };
+
+				tHit[i] = t;
+				uHit[i] = u;
+				vHit[i] = v;
+				mask |= static_cast<uint32_t>(hit) << i;
+			}
+
+			return mask;
+		}
+
+		//Lanes in laneMask that hit closer than their current closest hit take triangleIdx as their new one, tMax follows
+		template<uint32_t Width>
+		inline void HitTest_Triangle(const TriangleIntersectionData& triangle, uint32_t triangleIdx, const RayPacket<Width>& packet, float* tMax, TriangleHit* pClosest, uint32_t laneMask)
+		{
+			float tHit[Width];
+			float uHit[Width];
+			float vHit[Width];
+			uint32_t mask{ IntersectTriangle(triangle, packet, tMax, tHit, uHit, vHit) & laneMask };
+
+			while (mask)
+			{
+				uint32_t const i{ static_cast<uint32_t>(std::countr_zero(mask)) };
+				mask &= mask - 1;
+
+				if (!(tHit[i] < pClosest[i].t))
+				{
+					continue;
+				}
+
+				pClosest[i] = { tHit[i], uHit[i], vHit[i], triangleIdx };
+				tMax[i] = tHit[i];
+			}
+		}
+
+		//Masked packet traversal of the binary mesh BVH, a node is visited while any lane still overlaps it
+		//Whole packets are first culled against the node with the interval frustum; once only a few lanes are left
+		//the rest of the subtree is cheaper with the single ray traversal, so those lanes continue on their own
+		//Meshes built with a wide or quantized layout are traced lane by lane through that layout instead
+		template<uint32_t Width>
+		inline void HitTest_MeshBVH(const TriangleMesh& mesh, RayPacket<Width>& packet)
+		{
+			if (mesh.bvhSettings.layout != BVHLayout::Binary)
+			{
+				for (uint32_t i{ 0 }; i < packet.count; ++i)
+				{
+					Ray ray{ packet.GetRay(i) };
+					ray.max = std::min(ray.max, packet.hits[i].t);
+
+					TriangleHit temp{ };
+					if (GeometryUtils::HitTest_MeshBVH(ray, mesh, temp) && temp.t < packet.hits[i].t)
+					{
+						FillHitRecord(mesh, ray, temp, packet.hits[i]);
+					}
+				}
+				return;
+			}
+
+			static constexpr uint32_t divergenceThreshold{ Width / 4 };
+
+			struct StackEntry final
+			{
+				uint32_t nodeIdx;
+				uint32_t laneMask;
+			};
+
+			//Both children are pushed, so one more than the depth
+			static constexpr uint32_t maxStackSize{ BVHNode::maxDepth + 1 };
+			StackEntry stack[maxStackSize];
+			uint32_t stackSize{ 0 };
+
+			//Far limit per lane, shrinks with every closer hit
+			alignas(64) float tMax[Width];
+			for (uint32_t i{ 0 }; i < Width; ++i)
+			{
+				tMax[i] = std::min(packet.max[i], packet.hits[i].t);
+			}
+
+			//Closest triangle per lane, only lanes that found one get their hit record rebuilt at the end
+			TriangleHit closest[Width];
+			for (uint32_t i{ 0 }; i < Width; ++i)
+			{
+				closest[i].t = packet.hits[i].t;
+			}
+
+			//Lead ray direction, decides which child is visited first
+			float const leadDirection[3]{ packet.directionX[0], packet.directionY[0], packet.directionZ[0] };
+
+			stack[stackSize++] = { 0, packet.GetLaneMask() };
+			while (stackSize > 0)
+			{
+				StackEntry const entry{ stack[--stackSize] };
+				BVHNode const& node{ mesh.bvh[entry.nodeIdx] };
+
+				float farthest{ 0.f };
+				for (uint32_t i{ 0 }; i < Width; ++i)
+				{
+					farthest = (entry.laneMask & (1u << i)) ? std::max(farthest, tMax[i]) : farthest;
+				}
+
+				if (packet.FrustumMisses(node.aabbMin, node.aabbMax, farthest))
+				{
+					continue;
+				}
+
+				uint32_t const laneMask{ packet.IntersectAABB(node.aabbMin, node.aabbMax, tMax, entry.laneMask) };
+				if (laneMask == 0)
+				{
+					continue;
+				}
+
+				if (static_cast<uint32_t>(std::popcount(laneMask)) <= divergenceThreshold)
+				{
+					for (uint32_t mask{ laneMask }; mask; mask &= mask - 1)
+					{
+						uint32_t const i{ static_cast<uint32_t>(std::countr_zero(mask)) };
+
+						Ray ray{ packet.GetRay(i) };
+						ray.max = tMax[i];
+
+						TriangleHit temp{ };
+						if (GeometryUtils::HitTest_BVH(ray, mesh, mesh.bvh, entry.nodeIdx, temp) && temp.t < closest[i].t)
+						{
+							closest[i] = temp;
+							tMax[i] = temp.t;
+						}
+					}
+					continue;
+				}
+
+				if (node.IsLeaf())
+				{
+					for (uint32_t t{ node.leftFirst }; t < node.leftFirst + node.triangleCount; ++t)
+					{
+						HitTest_Triangle(mesh.triangles[t], t, packet, tMax, closest, laneMask);
+					}
+					continue;
+				}
+
+				//Near child on top of the stack, split along the axis where the children are furthest apart
+				BVHNode const& left{ mesh.bvh[node.leftFirst] };
+				BVHNode const& right{ mesh.bvh[node.leftFirst + 1] };
+				Vector3 const separation{ (right.aabbMin + right.aabbMax) - (left.aabbMin + left.aabbMax) };
+
+				int axis{ 0 };
+				for (int a{ 1 }; a < 3; ++a)
+				{
+					axis = std::abs(separation[a]) > std::abs(separation[axis]) ? a : axis;
+				}
+
+				bool const leftIsNear{ (leadDirection[axis] > 0.f) == (separation[axis] > 0.f) };
+
+				assert(stackSize + 2 <= maxStackSize && "BVH is deeper than the traversal stack");
+				stack[stackSize++] = { leftIsNear ? node.leftFirst + 1 : node.leftFirst, laneMask };
+				stack[stackSize++] = { leftIsNear ? node.leftFirst : node.leftFirst + 1, laneMask };
+			}
+
+			for (uint32_t i{ 0 }; i < packet.count; ++i)
+			{
+				if (closest[i].DidHit())
+				{
+					FillHitRecord(mesh, packet.GetRay(i), closest[i], packet.hits[i]);
+				}
+			}
+		}
+
+		//ANY-HIT (SHADOW RAYS)
+		//Each test only looks at the lanes in laneMask and returns the ones that are blocked
+
+		//Same quadratic as HitTest_Sphere, evaluated for 4 lanes at once in the same order so the answers match bit for bit
+		template<uint32_t Width>
+		inline uint32_t OcclusionTest_Sphere(const Sphere& sphere, const RayPacket<Width>& packet, uint32_t laneMask)
+		{
+			uint32_t occluded{ 0 };
+
+#if defined(DAE_MATH_SSE)
+			__m128 const sphereX{ _mm_set1_ps(sphere.origin.x) };
+			__m128 const sphereY{ _mm_set1_ps(sphere.origin.y) };
+			__m128 const sphereZ{ _mm_set1_ps(sphere.origin.z) };
+			__m128 const radiusSquared{ _mm_set1_ps(sphere.radius * sphere.radius) };
+			__m128 const two{ _mm_set1_ps(2.f) };
+			__m128 const four{ _mm_set1_ps(4.f) };
+			__m128 const zero{ _mm_setzero_ps() };
+			__m128 const signBit{ _mm_set1_ps(-0.f) };
+
+			for (uint32_t i{ 0 }; i < Width; i += 4)
+			{
+				if (((laneMask >> i) & 0xF) == 0)
+				{
+					continue;
+				}
+
+				__m128 const dx{ _mm_load_ps(packet.directionX + i) };
+				__m128 const dy{ _mm_load_ps(packet.directionY + i) };
+				__m128 const dz{ _mm_load_ps(packet.directionZ + i) };
+				__m128 const ocx{ _mm_sub_ps(_mm_load_ps(packet.originX + i), sphereX) };
+				__m128 const ocy{ _mm_sub_ps(_mm_load_ps(packet.originY + i), sphereY) };
+				__m128 const ocz{ _mm_sub_ps(_mm_load_ps(packet.originZ + i), sphereZ) };
+
+				__m128 const a{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)) };
+				__m128 const b{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(two, dx), ocx), _mm_mul_ps(_mm_mul_ps(two, dy), ocy)), _mm_mul_ps(_mm_mul_ps(two, dz), ocz)) };
+				__m128 const c{ _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), radiusSquared) };
+				__m128 const d{ _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(_mm_mul_ps(four, a), c)) };
+
+				//Lanes with d <= 0 get a NaN root, the mask below drops them anyway
+				__m128 const root{ _mm_sqrt_ps(d) };
+				__m128 const negB{ _mm_xor_ps(b, signBit) };
+				__m128 const t1{ _mm_mul_ps(_mm_div_ps(_mm_sub_ps(negB, root), two), a) };
+				__m128 const t2{ _mm_mul_ps(_mm_div_ps(_mm_add_ps(negB, root), two), a) };
+
+				__m128 const tMin{ _mm_load_ps(packet.min + i) };
+				__m128 const tMax{ _mm_load_ps(packet.max + i) };
+				__m128 const outside1{ _mm_or_ps(_mm_cmpgt_ps(t1, tMax), _mm_cmplt_ps(t1, tMin)) };
+				__m128 const outside2{ _mm_or_ps(_mm_cmpgt_ps(t2, tMax), _mm_cmplt_ps(t2, tMin)) };
+				__m128 const hit{ _mm_andnot_ps(_mm_and_ps(outside1, outside2), _mm_cmpgt_ps(d, zero)) };
+
+				occluded |= static_cast<uint32_t>(_mm_movemask_ps(hit)) << i;
+			}
+#else
+			for (uint32_t mask{ laneMask }; mask; mask &= mask - 1)
+			{
+				uint32_t const i{ static_cast<uint32_t>(std::countr_zero(mask)) };
+				occluded |= static_cast<uint32_t>(HitTest_Sphere(sphere, packet.GetRay(i))) << i;
+			}
+#endif
+
+			return occluded & laneMask;
+		}
+
+		template<uint32_t Width>
+		inline uint32_t OcclusionTest_Plane(const Plane& plane, const RayPacket<Width>& packet, uint32_t laneMask)
+		{
+			uint32_t occluded{ 0 };
+
+#if defined(DAE_MATH_SSE)
+			__m128 const planeX{ _mm_set1_ps(plane.origin.x) };
+			__m128 const planeY{ _mm_set1_ps(plane.origin.y) };
+			__m128 const planeZ{ _mm_set1_ps(plane.origin.z) };
+			__m128 const normalX{ _mm_set1_ps(plane.normal.x) };
+			__m128 const normalY{ _mm_set1_ps(plane.normal.y) };
+			__m128 const normalZ{ _mm_set1_ps(plane.normal.z) };
+
+			for (uint32_t i{ 0 }; i < Width; i += 4)
+			{
+				__m128 const numerator{ _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_sub_ps(planeX, _mm_load_ps(packet.originX + i)), normalX),
+					_mm_mul_ps(_mm_sub_ps(planeY, _mm_load_ps(packet.originY + i)), normalY)),
+					_mm_mul_ps(_mm_sub_ps(planeZ, _mm_load_ps(packet.originZ + i)), normalZ)) };
+				__m128 const denominator{ _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_load_ps(packet.directionX + i), normalX),
+					_mm_mul_ps(_mm_load_ps(packet.directionY + i), normalY)),
+					_mm_mul_ps(_mm_load_ps(packet.directionZ + i), normalZ)) };
+				__m128 const t{ _mm_div_ps(numerator, denominator) };
+
+				__m128 const outside{ _mm_or_ps(_mm_cmplt_ps(t, _mm_load_ps(packet.min + i)), _mm_cmpgt_ps(t, _mm_load_ps(packet.max + i))) };
+				occluded |= static_cast<uint32_t>(_mm_movemask_ps(outside) ^ 0xF) << i;
+			}
+#else
+			for (uint32_t i{ 0 }; i < Width; ++i)
+			{
+				Vector3 const origin{ packet.originX[i], packet.originY[i], packet.originZ[i] };
+				Vector3 const direction{ packet.directionX[i], packet.directionY[i], packet.directionZ[i] };
+
+				float const t{ Vector3::Dot((plane.origin - origin), plane.normal) / Vector3::Dot(direction, plane.normal) };
+				occluded |= static_cast<uint32_t>(!(t < packet.min[i] || t > packet.max[i])) << i;
+			}
+#endif
+
+			return occluded & laneMask;
+		}
+
+		//Same traversal as HitTest_MeshBVH, lanes drop out as soon as they are blocked and the whole packet stops once all are
+		//Wide and quantized layouts are tested lane by lane like there
+		template<uint32_t Width>
+		inline uint32_t OcclusionTest_MeshBVH(const TriangleMesh& mesh, const RayPacket<Width>& packet, uint32_t laneMask)
+		{
+			if (mesh.bvhSettings.layout != BVHLayout::Binary)
+			{
+				uint32_t occluded{ 0 };
+				for (uint32_t mask{ laneMask }; mask; mask &= mask - 1)
+				{
+					uint32_t const i{ static_cast<uint32_t>(std::countr_zero(mask)) };
+					occluded |= static_cast<uint32_t>(GeometryUtils::HitTest_MeshBVH(packet.GetRay(i), mesh)) << i;
+				}
+				return occluded;
+			}
+
+			static constexpr uint32_t divergenceThreshold{ Width / 4 };
+
+			struct StackEntry final
+			{
+				uint32_t nodeIdx;
+				uint32_t laneMask;
+			};
+
+			//Both children are pushed, so one more than the depth
+			static constexpr uint32_t maxStackSize{ BVHNode::maxDepth + 1 };
+			StackEntry stack[maxStackSize];
+			uint32_t stackSize{ 0 };
+
+			float farthest{ 0.f };
+			for (uint32_t i{ 0 }; i < Width; ++i)
+			{
+				farthest = (laneMask & (1u << i)) ? std::max(farthest, packet.max[i]) : farthest;
+			}
+
+			float const leadDirection[3]{ packet.directionX[0], packet.directionY[0], packet.directionZ[0] };
+
+			uint32_t occluded{ 0 };
+			stack[stackSize++] = { 0, laneMask };
+			while (stackSize > 0 && occluded != laneMask)
+			{
+				StackEntry const entry{ stack[--stackSize] };
+				BVHNode const& node{ mesh.bvh[entry.nodeIdx] };
+
+				uint32_t const activeMask{ entry.laneMask & ~occluded };
+				if (activeMask == 0 || packet.FrustumMisses(node.aabbMin, node.aabbMax, farthest))
+				{
+					continue;
+				}
+
+				uint32_t const hitMask{ packet.IntersectAABB(node.aabbMin, node.aabbMax, packet.max, activeMask) };
+				if (hitMask == 0)
+				{
+					continue;
+				}
+
+				if (static_cast<uint32_t>(std::popcount(hitMask)) <= divergenceThreshold)
+				{
+					for (uint32_t mask{ hitMask }; mask; mask &= mask - 1)
+					{
+						uint32_t const i{ static_cast<uint32_t>(std::countr_zero(mask)) };
+						occluded |= static_cast<uint32_t>(GeometryUtils::HitTest_BVH(packet.GetRay(i), mesh, mesh.bvh, entry.nodeIdx)) << i;
+					}
+					continue;
+				}
+
+				if (node.IsLeaf())
+				{
+					float tHit[Width];
+					float uHit[Width];
+					float vHit[Width];
+					for (uint32_t t{ node.leftFirst }; t < node.leftFirst + node.triangleCount; ++t)
+					{
+						occluded |= IntersectTriangle(mesh.triangles[t], packet, packet.max, tHit, uHit, vHit, true) & hitMask;
+					}
+					continue;
+				}
+
+				BVHNode const& left{ mesh.bvh[node.leftFirst] };
+				BVHNode const& right{ mesh.bvh[node.leftFirst + 1] };
+				Vector3 const separation{ (right.aabbMin + right.aabbMax) - (left.aabbMin + left.aabbMax) };
+
+				int axis{ 0 };
+				for (int a{ 1 }; a < 3; ++a)
+				{
+					axis = std::abs(separation[a]) > std::abs(separation[axis]) ? a : axis;
+				}
+
+				bool const leftIsNear{ (leadDirection[axis] > 0.f) == (separation[axis] > 0.f) };
+
+				assert(stackSize + 2 <= maxStackSize && "BVH is deeper than the traversal stack");
+				stack[stackSize++] = { leftIsNear ? node.leftFirst + 1 : node.leftFirst, hitMask };
+				stack[stackSize++] = { leftIsNear ? node.leftFirst : node.leftFirst + 1, hitMask };
+			}
+
+			return occluded;
+		}
+#pragma endregion
+	}
+}
+
+#endif
@@ -1,6 +1,8 @@
 //External includes
+#ifndef DAE_HEADLESS
 #include "SDL.h"
 #include "SDL_surface.h"
+#endif
 
 //Project includes
 #include "Renderer.h"
@@ -10,107 +12,400 @@
 #include "Material.h"
 #include "Scene.h"
 #include "Utils.h"
+#include "TileScheduler.h"
+#include "Sampling.h"
+#include "RayPacket.h"
 
 #include <algorithm>
-#include <corecrt_io.h>
-#include <execution>
-
-#include "SDL_egl.h"
-
+#include <atomic>
+#include <numeric>
 
 using namespace dae;
 
-Renderer::Renderer(SDL_Window * pWindow) :
+//Samples of one tile, traced and shaded stage by stage instead of pixel by pixel
+struct Renderer::Wavefront final
+{
+	static constexpr uint32_t packetWidth{ 8 };
+
+	//Accumulators and sample limits of the tile's pixels, row by row
+	std::vector<PixelAccumulator> tilePixels{};
+	std::vector<uint32_t> sampleLimits{};
+
+	//One entry per sample of the current pass
+	std::vector<uint32_t> tileSamples{}; //index into tilePixels
+	std::vector<uint32_t> pixels{}; //image pixel index
+	std::vector<uint32_t> samples{}; //sample index within the pixel
+	std::vector<PCG32> rngs{};
+	std::vector<ColorRGB> colors{};
+
+	//One entry per sample whose primary ray hit something
+	std::vector<uint32_t> hitSamples{}; //index into the sample arrays
+	std::vector<HitRecord> hits{};
+	std::vector<Vector3> viewDirs{};
+	std::vector<LightContribution> contributions{};
+	std::vector<ColorRGB> shade{};
+
+	//BRDF evaluations of the current light, bucketed per material
+	std::vector<ShadeQuery> queries{};
+	std::vector<ShadeQuery> sortedQueries{};
+	std::vector<ColorRGB> results{};
+	std::vector<uint32_t> materialOffsets{};
+
+	RayPacket<packetWidth> packet{};
+
+	void BeginPass()
+	{
+		tileSamples.clear();
+		pixels.clear();
+		samples.clear();
+		rngs.clear();
+		hitSamples.clear();
+		hits.clear();
+		viewDirs.clear();
+	}
+};
+
+#ifndef DAE_HEADLESS
+Renderer::Renderer(SDL_Window * pWindow, uint32_t threadCount) :
 	m_pWindow(pWindow),
-	m_pBuffer(SDL_GetWindowSurface(pWindow))
+	m_pBuffer(SDL_GetWindowSurface(pWindow)),
+	m_pScheduler(std::make_unique<TileScheduler>(threadCount))
 {
 	//Initialize
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
 	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+}
+#endif
 
-	m_Pixels.resize(m_Width * m_Height);
-	std::iota(m_Pixels.begin(), m_Pixels.end(), 0);
+Renderer::Renderer(int width, int height, uint32_t threadCount) :
+	m_Framebuffer(static_cast<size_t>(width) * height),
+	m_Width(width),
+	m_Height(height),
+	m_pScheduler(std::make_unique<TileScheduler>(threadCount))
+{
+	m_pBufferPixels = m_Framebuffer.data();
 }
 
-void Renderer::Render(Scene* pScene) const
+Renderer::~Renderer() = default;
+
+void Renderer::Render(Scene* pScene)
 {
 	Camera& camera{ pScene->GetCamera() };
-	auto const& lights { pScene->GetLights() };
 
 	float const aspectRatio{ m_Width / static_cast<float>(m_Height) };
 	float const fov{ tan(camera.fovAngle * TO_RADIANS/2) };
 
 	Matrix const cameraToWorld{ camera.CalculateCameraToWorld() };
-	
-	std::for_each(std::execution::par_unseq, m_Pixels.begin(), m_Pixels.end(), [&](int const idx)
+
+	if (m_ProgressiveEnabled)
 	{
-		ColorRGB finalColor{ };
+		bool const viewChanged{ pScene != m_pAccumulatedScene
+			|| pScene->GetVersion() != m_AccumulatedSceneVersion
+			|| camera.fovAngle != m_AccumulatedFov
+			|| !(cameraToWorld == m_AccumulatedCameraToWorld) };
 
-		int const px{ idx % m_Width };
-		int const py{ idx / m_Width };
+		if (viewChanged || m_AccumulatedFrames == 0)
+		{
+			m_AccumulationBuffer.assign(static_cast<size_t>(m_Width) * m_Height, PixelAccumulator{});
+			m_AccumulatedFrames = 0;
 
-		for (uint32_t currSample{ 0 }; currSample < m_SampleCount; ++currSample)
+			m_pAccumulatedScene = pScene;
+			m_AccumulatedSceneVersion = pScene->GetVersion();
+			m_AccumulatedFov = camera.fovAngle;
+			m_AccumulatedCameraToWorld = cameraToWorld;
+		}
+	}
+
+	std::atomic<uint64_t> frameSamples{ 0 };
+	std::atomic<uint64_t> imageSamples{ 0 };
+
+	uint32_t const tileCountX{ (static_cast<uint32_t>(m_Width) + m_TileSize - 1) / m_TileSize };
+	uint32_t const tileCountY{ (static_cast<uint32_t>(m_Height) + m_TileSize - 1) / m_TileSize };
+
+	m_pScheduler->Run(tileCountX * tileCountY, [&](uint32_t const tileIdx)
+	{
+		//Scratch buffers are kept per thread, so after the first tiles nothing gets allocated anymore
+		thread_local Wavefront wave{};
+
+		int const tileX{ static_cast<int>((tileIdx % tileCountX) * m_TileSize) };
+		int const tileY{ static_cast<int>((tileIdx / tileCountX) * m_TileSize) };
+		int const tileEndX{ std::min(tileX + static_cast<int>(m_TileSize), m_Width) };
+		int const tileEndY{ std::min(tileY + static_cast<int>(m_TileSize), m_Height) };
+		int const tileWidth{ tileEndX - tileX };
+
+		auto const toPixelIdx{ [&](uint32_t tilePixel)
+		{
+			return static_cast<uint32_t>((tileX + static_cast<int>(tilePixel) % tileWidth) + ((tileY + static_cast<int>(tilePixel) / tileWidth) * m_Width));
+		} };
+
+		wave.tilePixels.clear();
+		wave.sampleLimits.clear();
+		for (int py{ tileY }; py < tileEndY; ++py)
 		{
-			//Offset from center of pixel depending on the current sample
-			auto const offset{ SampleRay(currSample) };
+			for (int px{ tileX }; px < tileEndX; ++px)
+			{
+				PixelAccumulator const pixel{ m_ProgressiveEnabled ? m_AccumulationBuffer[px + (py * m_Width)] : PixelAccumulator{} };
+
+				uint32_t sampleLimit{ pixel.sampleCount + m_SampleCount };
+				if (m_AdaptiveEnabled)
+				{
+					sampleLimit = m_ProgressiveEnabled ? std::min(sampleLimit, m_AdaptiveMaxSamples) : m_AdaptiveMaxSamples;
+				}
 
-			float const x{ ((2 * (px + .5f + offset.x) / static_cast<float>(m_Width) - 1) * aspectRatio * fov) };
-			float const y{ ((1 - 2 * (py + .5f + offset.y) / static_cast<float>(m_Height)) * fov) };
+				wave.tilePixels.push_back(pixel);
+				wave.sampleLimits.push_back(sampleLimit);
+			}
+		}
 
-			Vector3 const dirViewSpace{ x , y, 1.f };
-			Vector3 const dirWorldSpace{ (cameraToWorld.TransformVector(dirViewSpace)).Normalized() };
+		uint64_t tileFrameSamples{ 0 };
+		uint64_t tileImageSamples{ 0 };
 
-			Ray const viewRay{ cameraToWorld.GetTranslation() , dirWorldSpace };
+		//Every pass traces one more sample for each pixel that still needs one, until none do
+		while (true)
+		{
+			wave.BeginPass();
+			for (uint32_t tilePixel{ 0 }; tilePixel < wave.tilePixels.size(); ++tilePixel)
+			{
+				PixelAccumulator const& pixel{ wave.tilePixels[tilePixel] };
+				if (pixel.sampleCount < wave.sampleLimits[tilePixel] && !(m_AdaptiveEnabled && HasConverged(pixel)))
+				{
+					uint32_t const pixelIdx{ toPixelIdx(tilePixel) };
+					wave.tileSamples.push_back(tilePixel);
+					wave.pixels.push_back(pixelIdx);
+					wave.samples.push_back(pixel.sampleCount);
+					wave.rngs.push_back(PCG32::ForSample(pixelIdx, pixel.sampleCount, m_Seed));
+				}
+			}
 
-			HitRecord closestHit{ };
-			pScene->GetClosestHit(viewRay, closestHit);
+			uint32_t const sampleCount{ static_cast<uint32_t>(wave.pixels.size()) };
+			if (sampleCount == 0)
+			{
+				break;
+			}
 
-			if (closestHit.didHit)
+			wave.colors.assign(sampleCount, ColorRGB{});
+
+			//Primary rays, traced a packet at a time; only the samples that hit something go on to shading
+			for (uint32_t first{ 0 }; first < sampleCount; first += Wavefront::packetWidth)
 			{
-				for (auto const& light : lights)
+				uint32_t const last{ std::min(first + Wavefront::packetWidth, sampleCount) };
+				auto& packet{ wave.packet };
+				packet.Reset();
+
+				for (uint32_t s{ first }; s < last; ++s)
+				{
+					uint32_t const pixelIdx{ wave.pixels[s] };
+					int const px{ static_cast<int>(pixelIdx % m_Width) };
+					int const py{ static_cast<int>(pixelIdx / m_Width) };
+					SampleState const sample{ pixelIdx, wave.samples[s], wave.rngs[s] };
+
+					//Offset from center of pixel depending on the current sample
+					auto const offset{ SampleRay(sample) };
+
+					float const x{ ((2 * (px + .5f + offset.x) / static_cast<float>(m_Width) - 1) * aspectRatio * fov) };
+					float const y{ ((1 - 2 * (py + .5f + offset.y) / static_cast<float>(m_Height)) * fov) };
+
+					Vector3 const dirViewSpace{ x , y, 1.f };
+					Vector3 const dirWorldSpace{ (cameraToWorld.TransformVector(dirViewSpace)).Normalized() };
+
+					packet.Add(Ray{ cameraToWorld.GetTranslation() , dirWorldSpace });
+				}
+
+				if (m_PacketTracingEnabled)
+				{
+					packet.Finalize();
+					pScene->GetClosestHits(packet);
+				}
+				else
 				{
-					finalColor += CalculateIllumination(pScene, light, closestHit, viewRay.direction);
+					for (uint32_t i{ 0 }; i < packet.count; ++i)
+					{
+						pScene->GetClosestHit(packet.GetRay(i), packet.hits[i]);
+					}
+				}
+
+				for (uint32_t i{ 0 }; i < packet.count; ++i)
+				{
+					if (packet.hits[i].didHit)
+					{
+						wave.hitSamples.push_back(first + i);
+						wave.hits.push_back(packet.hits[i]);
+						wave.viewDirs.push_back({ packet.directionX[i], packet.directionY[i], packet.directionZ[i] });
+					}
 				}
 			}
+
+			ShadeWavefront(pScene, wave);
+
+			for (uint32_t s{ 0 }; s < sampleCount; ++s)
+			{
+				ColorRGB const& sampleColor{ wave.colors[s] };
+				float const luminance{ .2126f * sampleColor.r + .7152f * sampleColor.g + .0722f * sampleColor.b };
+
+				PixelAccumulator& pixel{ wave.tilePixels[wave.tileSamples[s]] };
+				pixel.sum += sampleColor;
+				pixel.luminanceSum += luminance;
+				pixel.luminanceSquaredSum += luminance * luminance;
+				++pixel.sampleCount;
+			}
+
+			tileFrameSamples += sampleCount;
 		}
 
-		BoxFilter(finalColor);
-		finalColor.MaxToOne();
+		for (uint32_t tilePixel{ 0 }; tilePixel < wave.tilePixels.size(); ++tilePixel)
+		{
+			PixelAccumulator const& pixel{ wave.tilePixels[tilePixel] };
+			uint32_t const pixelIdx{ toPixelIdx(tilePixel) };
+
+			tileImageSamples += pixel.sampleCount;
+
+			if (m_ProgressiveEnabled)
+			{
+				m_AccumulationBuffer[pixelIdx] = pixel;
+			}
+
+			//Box filter
+			ColorRGB finalColor{ pixel.sampleCount > 0 ? pixel.sum / static_cast<float>(pixel.sampleCount) : ColorRGB{} };
+			finalColor.MaxToOne();
 
-		//Different forms of mapping the final colour
-		//ReinhardJolieToneMap(finalColor);
-		//ACESAproxToneMap(finalColor);
+			//Different forms of mapping the final colour
+			//ReinhardJolieToneMap(finalColor);
+			//ACESAproxToneMap(finalColor);
 
-		m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-			static_cast<uint8_t>(finalColor.r * 255),
-			static_cast<uint8_t>(finalColor.g * 255),
-			static_cast<uint8_t>(finalColor.b * 255));
-			
+			m_pBufferPixels[pixelIdx] = MapColor(finalColor);
+		}
+
+		frameSamples += tileFrameSamples;
+		imageSamples += tileImageSamples;
 	});
 
+	float const pixelCount{ static_cast<float>(m_Width) * static_cast<float>(m_Height) };
+	m_FrameSampleCount = static_cast<float>(frameSamples.load()) / pixelCount;
+	m_AverageSampleCount = static_cast<float>(imageSamples.load()) / pixelCount;
+
+	if (m_ProgressiveEnabled)
+	{
+		++m_AccumulatedFrames;
+	}
+
 	//@END
+#ifndef DAE_HEADLESS
 	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+	if (m_pWindow)
+	{
+		SDL_UpdateWindowSurface(m_pWindow);
+	}
+#endif
+}
+
+void Renderer::SetThreadCount(uint32_t threadCount)
+{
+	m_pScheduler = std::make_unique<TileScheduler>(threadCount);
 }
 
-bool Renderer::SaveBufferToImage() const
+uint32_t Renderer::GetThreadCount() const
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	return m_pScheduler->GetThreadCount();
 }
 
-ColorRGB dae::Renderer::CalculateIllumination(Scene* pScene, const Light& light, const HitRecord& closestHit, const Vector3& viewDir) const noexcept
+std::vector<float> const& Renderer::GetTileTimes() const
 {
-	uint32_t hits{ 0 };
+	return m_pScheduler->GetTaskTimes();
+}
+
+void Renderer::PrintTileTimings() const
+{
+	auto const& tileTimes{ GetTileTimes() };
+	if (tileTimes.empty())
+	{
+		return;
+	}
 
-	float observedArea{ };
-	ColorRGB radiance{ };
+	auto const [minTime, maxTime] { std::minmax_element(tileTimes.begin(), tileTimes.end()) };
+	float const totalTime{ std::accumulate(tileTimes.begin(), tileTimes.end(), 0.f) };
 
-	ColorRGB shade{ };
+	std::cout << "Tiles: " << tileTimes.size() << " (" << m_TileSize << "x" << m_TileSize << ") on " << GetThreadCount() << " threads\n";
+	std::cout << "Tile time min/avg/max: " << *minTime << " / " << totalTime / tileTimes.size() << " / " << *maxTime << " ms\n";
+	std::cout << "Samples per pixel: " << m_FrameSampleCount << " this frame, " << m_AverageSampleCount << " in the image\n";
+}
 
+bool Renderer::SaveBufferToImage(const std::string& filename) const
+{
+#ifndef DAE_HEADLESS
+	if (m_pBuffer)
+	{
+		return SDL_SaveBMP(m_pBuffer, filename.c_str()) == 0;
+	}
+#endif
+
+	return Utils::WriteBMP(filename, m_pBufferPixels, m_Width, m_Height);
+}
+
+void dae::Renderer::ShadeWavefront(const Scene* pScene, Wavefront& wave) const noexcept
+{
+	auto const& lights{ pScene->GetLights() };
 	auto const& materials{ pScene->GetMaterials() };
+	uint32_t const hitCount{ static_cast<uint32_t>(wave.hits.size()) };
 
-	bool const hasNoSoftShadows{ !light.HasSoftShadows() };
-	if (hasNoSoftShadows)
+	for (uint32_t lightIdx{ 0 }; lightIdx < lights.size(); ++lightIdx)
+	{
+		Light const& light{ lights[lightIdx] };
+
+		wave.contributions.assign(hitCount, LightContribution{});
+		wave.shade.assign(hitCount, ColorRGB{});
+		wave.queries.clear();
+
+		for (uint32_t hitIdx{ 0 }; hitIdx < hitCount; ++hitIdx)
+		{
+			uint32_t const s{ wave.hitSamples[hitIdx] };
+			SampleState const sample{ wave.pixels[s], wave.samples[s], wave.rngs[s] };
+
+			GatherIllumination(pScene, light, lightIdx, wave.hits[hitIdx], wave.viewDirs[hitIdx], sample, hitIdx, wave.contributions[hitIdx], wave.queries);
+		}
+
+		//Counting sort on the material, stable so every hit still sums its light samples in the same order
+		uint32_t const queryCount{ static_cast<uint32_t>(wave.queries.size()) };
+		wave.materialOffsets.assign(materials.size() + 1, 0);
+		for (ShadeQuery const& query : wave.queries)
+		{
+			++wave.materialOffsets[wave.hits[query.id].materialIndex + 1];
+		}
+		std::partial_sum(wave.materialOffsets.begin(), wave.materialOffsets.end(), wave.materialOffsets.begin());
+
+		wave.sortedQueries.resize(queryCount);
+		for (ShadeQuery const& query : wave.queries)
+		{
+			wave.sortedQueries[wave.materialOffsets[wave.hits[query.id].materialIndex]++] = query;
+		}
+
+		//The offsets were advanced to the end of every bucket, so bucket m now spans [offsets[m - 1], offsets[m])
+		wave.results.resize(queryCount);
+		for (uint32_t materialIdx{ 0 }, first{ 0 }; materialIdx < materials.size(); ++materialIdx)
+		{
+			uint32_t const last{ wave.materialOffsets[materialIdx] };
+			if (last > first)
+			{
+				ShadeBatch(materials[materialIdx], wave.sortedQueries.data() + first, last - first, wave.results.data() + first);
+			}
+			first = last;
+		}
+
+		for (uint32_t i{ 0 }; i < queryCount; ++i)
+		{
+			wave.shade[wave.sortedQueries[i].id] += wave.results[i];
+		}
+
+		for (uint32_t hitIdx{ 0 }; hitIdx < hitCount; ++hitIdx)
+		{
+			wave.colors[wave.hitSamples[hitIdx]] += ResolveIllumination(light, wave.contributions[hitIdx], wave.shade[hitIdx]);
+		}
+	}
+}
+
+void dae::Renderer::GatherIllumination(const Scene* pScene, const Light& light, uint32_t lightIdx, const HitRecord& closestHit, const Vector3& viewDir, const SampleState& sample,
+	uint32_t hitIdx, LightContribution& contribution, std::vector<ShadeQuery>& queries) const noexcept
+{
+	if (!light.HasSoftShadows())
 	{
 		auto const dirToLight{ GetDirectionToLight(light, light.origin, closestHit.origin) };
 		Ray const shadowRay{ closestHit.origin, dirToLight.first, 0.001f, dirToLight.second };
@@ -120,62 +415,78 @@ ColorRGB dae::Renderer::CalculateIllumination(Scene* pScene, const Light& light,
 			auto const o{ GetObservedArea(light, dirToLight.first, closestHit.normal) };
 			if (o <= 0.f)
 			{
-				return {};
+				return;
 			}
 
-			observedArea = o;
-			radiance = GetRadiance(light, light.origin, closestHit);
-			shade = materials[closestHit.materialIndex]->Shade(closestHit, dirToLight.first, -viewDir);
+			contribution.observedArea = o;
+			contribution.radiance = GetRadiance(light, light.origin, closestHit);
+			queries.push_back(ShadeQuery{ closestHit.normal, dirToLight.first, -viewDir, hitIdx });
 		}
+
+		return;
 	}
-	else
+
+	//Only triangular area lights can be sampled so far
+	if (light.shape != LightShape::Triangular)
 	{
-		for (uint32_t sample{ 0 }; sample < m_LightSamples; ++sample)
-		{
-			switch (light.shape)
-			{
-			case LightShape::None:
-				continue;
+		return;
+	}
 
-			case LightShape::Triangular:
-			{
-				auto const pointOnTriangle{ GeometryUtils::GetRandomTriangleSample(light.vertices[0], light.vertices[1], light.vertices[2])};
-				//auto const pointOnTriangle{ GeometryUtils::GetUniformTriangleSample(light.vertices[0], light.vertices[1], light.vertices[2], m_LightSamples, sample) };
+	//The light samples go out in batches, their shadow rays are traced together and come back as one bitmask
+	static constexpr uint32_t maxBatchSize{ 32 };
+	Vector3 pointsOnLight[maxBatchSize];
+	std::pair<Vector3, float> dirsToLight[maxBatchSize];
+	Ray shadowRays[maxBatchSize];
 
-				auto const dirToLight{ GetDirectionToLight(light, pointOnTriangle, closestHit.origin) };
+	for (uint32_t firstSample{ 0 }; firstSample < m_LightSamples; firstSample += maxBatchSize)
+	{
+		uint32_t const batchSize{ std::min(m_LightSamples - firstSample, maxBatchSize) };
 
-				if (m_ShadowsEnabled)
-				{
-					Ray const shadowRay{ closestHit.origin, dirToLight.first, 0.001f, dirToLight.second };
-					if (pScene->DoesHit(shadowRay))
-					{
-						++hits;
-						continue;
-					}
-				}
+		for (uint32_t i{ 0 }; i < batchSize; ++i)
+		{
+			auto const uv{ SampleLight(sample, lightIdx, firstSample + i) };
+			pointsOnLight[i] = GeometryUtils::GetTriangleSample(light.vertices[0], light.vertices[1], light.vertices[2], uv.x, uv.y);
+			//pointsOnLight[i] = GeometryUtils::GetUniformTriangleSample(light.vertices[0], light.vertices[1], light.vertices[2], m_LightSamples, sample);
 
-				auto const o{ GetObservedArea(light, dirToLight.first, closestHit.normal) };
-				if (o > 0.f)
-				{
-					observedArea += o;
-					radiance += GetRadiance(light, pointOnTriangle, closestHit);
-					shade += materials[closestHit.materialIndex]->Shade(closestHit, dirToLight.first, -viewDir);
-				}
+			dirsToLight[i] = GetDirectionToLight(light, pointsOnLight[i], closestHit.origin);
+			shadowRays[i] = Ray{ closestHit.origin, dirsToLight[i].first, 0.001f, dirsToLight[i].second };
+		}
 
-				break;
+		uint32_t const occluded{ m_ShadowsEnabled ? pScene->DoesHit(shadowRays, batchSize) : 0u };
+
+		for (uint32_t i{ 0 }; i < batchSize; ++i)
+		{
+			if (occluded & (1u << i))
+			{
+				++contribution.occludedSamples;
+				continue;
 			}
+
+			auto const o{ GetObservedArea(light, dirsToLight[i].first, closestHit.normal) };
+			if (o > 0.f)
+			{
+				contribution.observedArea += o;
+				contribution.radiance += GetRadiance(light, pointsOnLight[i], closestHit);
+				queries.push_back(ShadeQuery{ closestHit.normal, dirsToLight[i].first, -viewDir, hitIdx });
 			}
 		}
+	}
+}
 
-		if (m_LightSamples > hits)
-		{
-			observedArea /= static_cast<float>(m_LightSamples);
-			radiance /= static_cast<float>(m_LightSamples);
-			shade /= static_cast<float>(m_LightSamples);
-		}
+ColorRGB dae::Renderer::ResolveIllumination(const Light& light, const LightContribution& contribution, ColorRGB shade) const noexcept
+{
+	float observedArea{ contribution.observedArea };
+	ColorRGB radiance{ contribution.radiance };
+
+	bool const hasNoSoftShadows{ !light.HasSoftShadows() };
+	if (!hasNoSoftShadows && m_LightSamples > contribution.occludedSamples)
+	{
+		observedArea /= static_cast<float>(m_LightSamples);
+		radiance /= static_cast<float>(m_LightSamples);
+		shade /= static_cast<float>(m_LightSamples);
 	}
 
-	float const illuminationFactor{ !m_ShadowsEnabled || hasNoSoftShadows ? 1.f : 1.f - (static_cast<float>(hits) / static_cast<float>(m_LightSamples)) };
+	float const illuminationFactor{ !m_ShadowsEnabled || hasNoSoftShadows ? 1.f : 1.f - (static_cast<float>(contribution.occludedSamples) / static_cast<float>(m_LightSamples)) };
 
 	switch (m_CurrLightMode)
 	{
@@ -202,27 +513,90 @@ ColorRGB dae::Renderer::CalculateIllumination(Scene* pScene, const Light& light,
 	return {};
 }
 
-Vector3 dae::Renderer::SampleRay(uint32_t currSample) const noexcept
+Vector3 dae::Renderer::SampleRay(const SampleState& sample) const noexcept
 {
+	Vector3 offset{};
+
 	switch(m_CurrSampleMode)
 	{
 	case SampleMode::RandomSquare:
-		return SampleRandomSquare();
+		return SampleRandomSquare(sample.rng);
 	case SampleMode::UniformSquare:
+		//The grid only has m_SampleCount cells, samples past it (later progressive frames, adaptive sampling) jitter randomly
+		if (sample.sampleIdx >= m_SampleCount)
+		{
+			return SampleRandomSquare(sample.rng);
+		}
+
 		if (m_SampleCount == 1)
 		{
 			return {};
 		}
 
-		return SampleUniformSquare(currSample);
+		return SampleUniformSquare(sample.sampleIdx);
+	case SampleMode::Sobol:
+		offset = Sampling::Sobol2D(sample.sampleIdx, GetSamplerSeed(sample.pixelIdx, 0));
+		break;
+	case SampleMode::Halton:
+		offset = Sampling::Halton2D(sample.sampleIdx, 0, GetSamplerSeed(sample.pixelIdx, 0));
+		break;
+	case SampleMode::BlueNoise:
+		offset = Sampling::BlueNoise2D(sample.sampleIdx, sample.pixelIdx % m_Width, sample.pixelIdx / m_Width, 0);
+		break;
 	default: 
 		return {};
 	}
+
+	return { offset.x - .5f, offset.y - .5f, 0.f };
+}
+
+Vector3 dae::Renderer::SampleLight(const SampleState& sample, uint32_t lightIdx, uint32_t lightSample) const noexcept
+{
+	//Every light gets its own 2D pair, pair 0 is the pixel position
+	uint32_t const dimensionPair{ lightIdx + 1 };
+	uint32_t const index{ sample.sampleIdx * m_LightSamples + lightSample };
+
+	switch (m_CurrSampleMode)
+	{
+	case SampleMode::Sobol:
+		return Sampling::Sobol2D(index, GetSamplerSeed(sample.pixelIdx, dimensionPair));
+	case SampleMode::Halton:
+		return Sampling::Halton2D(index, dimensionPair, GetSamplerSeed(sample.pixelIdx, dimensionPair));
+	case SampleMode::BlueNoise:
+		return Sampling::BlueNoise2D(index, sample.pixelIdx % m_Width, sample.pixelIdx / m_Width, dimensionPair);
+	default:
+		return { sample.rng.NextFloat(), sample.rng.NextFloat(), 0.f };
+	}
+}
+
+uint32_t dae::Renderer::GetSamplerSeed(uint32_t pixelIdx, uint32_t dimensionPair) const noexcept
+{
+	uint64_t const key{ (static_cast<uint64_t>(m_Seed) << 32) | pixelIdx };
+	return static_cast<uint32_t>(PCG32::SplitMix64(key ^ (static_cast<uint64_t>(dimensionPair) * 0x9E3779B97F4A7C15ull)));
+}
+
+const char* dae::Renderer::GetSampleModeName() const noexcept
+{
+	switch (m_CurrSampleMode)
+	{
+	case SampleMode::RandomSquare:
+		return "Random";
+	case SampleMode::UniformSquare:
+		return "Uniform grid";
+	case SampleMode::Sobol:
+		return "Owen scrambled Sobol";
+	case SampleMode::Halton:
+		return "Halton";
+	case SampleMode::BlueNoise:
+		return "Blue noise";
+	default:
+		return "Unknown";
+	}
 }
 
-Vector3 dae::Renderer::SampleRandomSquare() const noexcept
+Vector3 dae::Renderer::SampleRandomSquare(PCG32& rng) const noexcept
 {
-	return {Random(0.f, 1.f) - .5f, Random(0.f, 1.f) - .5f, 0.f};
+	return { rng.NextFloat() - .5f, rng.NextFloat() - .5f, 0.f };
 }
 
 Vector3 dae::Renderer::SampleUniformSquare(uint32_t currSample) const noexcept
@@ -254,7 +628,34 @@ Vector3 dae::Renderer::SampleUniformSquare(uint32_t currSample) const noexcept
 	};
 }
 
-void dae::Renderer::BoxFilter(ColorRGB& c) const noexcept
+bool dae::Renderer::HasConverged(const PixelAccumulator& pixel) const noexcept
 {
-	c /= m_SampleCount;
+	if (pixel.sampleCount < m_AdaptiveMinSamples)
+	{
+		return false;
+	}
+
+	float const sampleCount{ static_cast<float>(pixel.sampleCount) };
+	float const mean{ pixel.luminanceSum / sampleCount };
+	float const variance{ std::max(pixel.luminanceSquaredSum / sampleCount - mean * mean, 0.f) * sampleCount / (sampleCount - 1.f) };
+	float const standardError{ std::sqrt(variance / sampleCount) };
+
+	//Relative to the brightness, but dark pixels are not pushed to an impossible absolute error and clamped pixels can't get brighter
+	return standardError <= m_AdaptiveErrorThreshold * std::clamp(mean, .1f, 1.f);
+}
+
+uint32_t dae::Renderer::MapColor(const ColorRGB& c) const noexcept
+{
+	auto const r{ static_cast<uint8_t>(c.r * 255) };
+	auto const g{ static_cast<uint8_t>(c.g * 255) };
+	auto const b{ static_cast<uint8_t>(c.b * 255) };
+
+#ifndef DAE_HEADLESS
+	if (m_pBuffer)
+	{
+		return SDL_MapRGB(m_pBuffer->format, r, g, b);
+	}
+#endif
+
+	return 0xFF000000 | (r << 16) | (g << 8) | b;
 }
@@ -1,33 +1,52 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 #include <iostream>
 
+#include "ColorRGB.h"
+#include "Matrix.h"
+
 struct SDL_Window;
 struct SDL_Surface;
 
 namespace dae
 {
-	class ColorRGB;
-	class Vector3;
 	class Scene;
 	struct Light;
 	struct HitRecord;
+	class TileScheduler;
+	struct PCG32;
+	struct ShadeQuery;
 
 	class Renderer final
 	{
 	public:
-		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+#ifndef DAE_HEADLESS
+		Renderer(SDL_Window* pWindow, uint32_t threadCount = 0);
+#endif
+		//Offscreen renderer that draws into an in-memory framebuffer, needs no window
+		Renderer(int width, int height, uint32_t threadCount = 0);
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
-		bool SaveBufferToImage() const;
+		//With progressive rendering on, every call adds m_SampleCount samples per pixel to the accumulation buffer
+		//Moving the camera, changing the scene or any render setting starts the accumulation over
+		void Render(Scene* pScene);
+
+		//Returns true when the image was written
+		bool SaveBufferToImage(const std::string& filename = "RayTracing_Buffer.bmp") const;
+
+		//0xAARRGGBB offscreen, the window surface format otherwise
+		uint32_t const* GetBuffer() const noexcept { return m_pBufferPixels; }
+		int GetWidth() const noexcept { return m_Width; }
+		int GetHeight() const noexcept { return m_Height; }
 
 		void CycleLighMode() noexcept
 		{
@@ -35,9 +54,25 @@ namespace dae
 			++curr %= static_cast<uint8_t>(LightMode::COUNT);
 
 			m_CurrLightMode = static_cast<LightMode>(curr);
+			ResetAccumulation();
 		}
 
-		void ToggleShadows() noexcept { m_ShadowsEnabled = !m_ShadowsEnabled; }
+		void ToggleShadows() noexcept { m_ShadowsEnabled = !m_ShadowsEnabled; ResetAccumulation(); }
+		void SetShadowsEnabled(bool enabled) noexcept { m_ShadowsEnabled = enabled; ResetAccumulation(); }
+
+		//Pixel sampling pattern, the low discrepancy modes also drive the area light samples
+		enum class SampleMode : uint8_t
+		{
+			RandomSquare,
+			UniformSquare,
+			Sobol, //Owen scrambled
+			Halton,
+			BlueNoise, //Sobol shifted by a tiled blue noise mask
+			COUNT
+		};
+
+		void SetSampleMode(SampleMode mode) noexcept { m_CurrSampleMode = mode; ResetAccumulation(); }
+		const char* GetSampleModeName() const noexcept;
 
 		void CycleSampleMode() noexcept
 		{
@@ -45,22 +80,96 @@ namespace dae
 			++curr %= static_cast<uint8_t>(SampleMode::COUNT);
 
 			m_CurrSampleMode = static_cast<SampleMode>(curr);
+			ResetAccumulation();
 		}
 
-		void IncreaseSamples() noexcept { m_SampleCount *= 2; }
-		void DecreaseSamples() noexcept { m_SampleCount = std::max<uint32_t>(m_SampleCount / 2, 1); }
+		void IncreaseSamples() noexcept { m_SampleCount *= 2; ResetAccumulation(); }
+		void DecreaseSamples() noexcept { m_SampleCount = std::max<uint32_t>(m_SampleCount / 2, 1); ResetAccumulation(); }
+		void SetSampleCount(uint32_t sampleCount) noexcept { m_SampleCount = std::max<uint32_t>(sampleCount, 1); ResetAccumulation(); }
+
+		void ToggleProgressive() noexcept { m_ProgressiveEnabled = !m_ProgressiveEnabled; ResetAccumulation(); }
+		void SetProgressiveEnabled(bool enabled) noexcept { m_ProgressiveEnabled = enabled; ResetAccumulation(); }
+		void ResetAccumulation() noexcept { m_AccumulatedFrames = 0; }
+
+		//A pixel stops sampling once it has minSamples and its estimated error is below errorThreshold, or when it reaches maxSamples
+		//Without progressive rendering every frame samples each pixel until it stops,
+		//with progressive rendering every frame adds up to m_SampleCount samples to the pixels that have not stopped yet
+		void ToggleAdaptiveSampling() noexcept { m_AdaptiveEnabled = !m_AdaptiveEnabled; ResetAccumulation(); }
+		void SetAdaptiveSampling(bool enabled, uint32_t minSamples = 4, uint32_t maxSamples = 64, float errorThreshold = .05f) noexcept
+		{
+			m_AdaptiveEnabled = enabled;
+			m_AdaptiveMinSamples = std::max<uint32_t>(minSamples, 2);
+			m_AdaptiveMaxSamples = std::max(maxSamples, m_AdaptiveMinSamples);
+			m_AdaptiveErrorThreshold = errorThreshold;
+			ResetAccumulation();
+		}
+
+		//Camera rays are traced in packets of neighbouring samples, switching it off traces them one by one (same image)
+		void TogglePacketTracing() noexcept { m_PacketTracingEnabled = !m_PacketTracingEnabled; }
+		void SetPacketTracingEnabled(bool enabled) noexcept { m_PacketTracingEnabled = enabled; }
+		bool IsPacketTracingEnabled() const noexcept { return m_PacketTracingEnabled; }
+
+		//Samples per pixel in the current image, and how many of them were traced during the last frame
+		float GetAverageSampleCount() const noexcept { return m_AverageSampleCount; }
+		float GetFrameSampleCount() const noexcept { return m_FrameSampleCount; }
+
+		//0 uses every hardware thread
+		void SetThreadCount(uint32_t threadCount);
+		uint32_t GetThreadCount() const;
+
+		//Tiles are square, 16 or 32 keeps neighbouring rays on the same core
+		void SetTileSize(uint32_t tileSize) noexcept { m_TileSize = std::max<uint32_t>(tileSize, 1); }
+		uint32_t GetTileSize() const noexcept { return m_TileSize; }
+
+		//Every random number of a sample derives from (seed, pixel, sample index), so renders are reproducible per pixel
+		void SetSeed(uint32_t seed) noexcept { m_Seed = seed; ResetAccumulation(); }
+
+		//Render time in milliseconds of every tile of the last frame, row by row
+		std::vector<float> const& GetTileTimes() const;
+		void PrintTileTimings() const;
 
 	private:
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pBuffer{};
 		uint32_t* m_pBufferPixels{};
+		std::vector<uint32_t> m_Framebuffer{}; //Only used without a window
 
 		int m_Width{};
 		int m_Height{};
 
-		//Has to be updated when window is resized (not possible at the moment)
-		std::vector<uint32_t> m_Pixels{ };
+		std::unique_ptr<TileScheduler> m_pScheduler{};
+		uint32_t m_TileSize{ 32 };
+
+		//Running sums of the samples of one pixel, enough to get the mean and variance of its luminance
+		struct PixelAccumulator final
+		{
+			ColorRGB sum{};
+			float luminanceSum{ 0.f };
+			float luminanceSquaredSum{ 0.f };
+			uint32_t sampleCount{ 0 };
+		};
+
+		//Progressive rendering, every pixel's samples since the last reset
+		std::vector<PixelAccumulator> m_AccumulationBuffer{};
+		uint32_t m_AccumulatedFrames{ 0 };
+		bool m_ProgressiveEnabled{ true }; //Switched on/off with F8
+
+		bool m_AdaptiveEnabled{ false }; //Switched on/off with F9
+		uint32_t m_AdaptiveMinSamples{ 4 };
+		uint32_t m_AdaptiveMaxSamples{ 64 };
+		float m_AdaptiveErrorThreshold{ .05f }; //Standard error of the mean relative to the pixel brightness
+
+		bool m_PacketTracingEnabled{ true }; //Switched on/off with F10
+
+		float m_AverageSampleCount{ 0.f };
+		float m_FrameSampleCount{ 0.f };
+
+		//State the accumulation was started with, a change means the old samples are invalid
+		Scene const* m_pAccumulatedScene{};
+		uint32_t m_AccumulatedSceneVersion{ 0 };
+		Matrix m_AccumulatedCameraToWorld{};
+		float m_AccumulatedFov{ 0.f };
 
 		enum class LightMode : uint8_t
 		{
@@ -73,23 +182,48 @@ namespace dae
 		LightMode m_CurrLightMode{ LightMode::Combined }; //Cycle through with F3
 		bool m_ShadowsEnabled{ true }; //Switched on/off with F2
 
-		enum class SampleMode : uint8_t
-		{
-			RandomSquare,
-			UniformSquare,
-			COUNT
-		};
 		SampleMode m_CurrSampleMode{ SampleMode::UniformSquare }; //Cycle through with F4
 		uint32_t m_SampleCount{ 1 }; //Samples per pixel; Decrease with F5, Increase with F6
 		uint32_t m_LightSamples{ 10 }; //Samples per light (if applicable)
+		uint32_t m_Seed{ 0 };
+
+		//The sample being traced, low discrepancy samplers index their sequences with it
+		struct SampleState final
+		{
+			uint32_t pixelIdx;
+			uint32_t sampleIdx;
+			PCG32& rng;
+		};
+
+		//Light arriving at one hit from one light, the BRDF part is left to a batched shading pass
+		struct LightContribution final
+		{
+			float observedArea{ 0.f };
+			ColorRGB radiance{};
+			uint32_t occludedSamples{ 0 };
+		};
+
+		//All samples of a tile in flight, see Renderer.cpp
+		struct Wavefront;
+
+		//Shades every hit of the wavefront light by light, the BRDFs of all hits with the same material are evaluated as one batch
+		void ShadeWavefront(const Scene* pScene, Wavefront& wave) const noexcept;
+
+		//Traces the shadow rays of one light and queues a ShadeQuery, tagged with hitIdx, for every lit light sample
+		void GatherIllumination(const Scene* pScene, const Light& light, uint32_t lightIdx, const HitRecord& closestHit, const Vector3& viewDir, const SampleState& sample,
+			uint32_t hitIdx, LightContribution& contribution, std::vector<ShadeQuery>& queries) const noexcept;
 
-		[[nodiscard]] ColorRGB CalculateIllumination(Scene* pScene, const Light& light, const HitRecord& closestHit, const Vector3& viewDir) const noexcept;
+		//Combines the gathered light with the summed BRDF results according to the light mode
+		[[nodiscard]] ColorRGB ResolveIllumination(const Light& light, const LightContribution& contribution, ColorRGB shade) const noexcept;
 
-		Vector3 SampleRay(uint32_t currSample) const noexcept;
+		Vector3 SampleRay(const SampleState& sample) const noexcept;
+		Vector3 SampleLight(const SampleState& sample, uint32_t lightIdx, uint32_t lightSample) const noexcept;
+		uint32_t GetSamplerSeed(uint32_t pixelIdx, uint32_t dimensionPair) const noexcept;
+		bool HasConverged(const PixelAccumulator& pixel) const noexcept;
 
-		Vector3 SampleRandomSquare() const noexcept;
+		Vector3 SampleRandomSquare(PCG32& rng) const noexcept;
 		Vector3 SampleUniformSquare(uint32_t currSample) const noexcept;
 
-		void BoxFilter(ColorRGB& c) const noexcept;
+		uint32_t MapColor(const ColorRGB& c) const noexcept;
 	};
 }
@@ -0,0 +1,283 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+#include "Vector3.h"
+
+namespace dae
+{
+	//Low discrepancy 2D point sets for pixel and light sampling, all points are in [0, 1)^2 and returned as (x, y, 0)
+	//Every generator takes the sample index and a seed, the seed decorrelates pixels and the different 2D pairs of one sample
+	namespace Sampling
+	{
+#pragma region Helpers
+		constexpr float ToUnitFloat(uint32_t x) noexcept
+		{
+			return static_cast<float>(x >> 8) * (1.f / 16777216.f);
+		}
+
+		constexpr uint32_t ReverseBits(uint32_t x) noexcept
+		{
+			x = (x << 16) | (x >> 16);
+			x = ((x & 0x00FF00FFu) << 8) | ((x & 0xFF00FF00u) >> 8);
+			x = ((x & 0x0F0F0F0Fu) << 4) | ((x & 0xF0F0F0F0u) >> 4);
+			x = ((x & 0x33333333u) << 2) | ((x & 0xCCCCCCCCu) >> 2);
+			x = ((x & 0x55555555u) << 1) | ((x & 0xAAAAAAAAu) >> 1);
+			return x;
+		}
+
+		constexpr uint32_t HashCombine(uint32_t seed, uint32_t value) noexcept
+		{
+			return seed ^ (value + 0x9E3779B9u + (seed << 6) + (seed >> 2));
+		}
+
+		//Hash based Owen scrambling (Burley 2020, "Practical Hash-based Owen Scrambling")
+		//Flipping bit i depends only on the bits above it, which keeps the stratification of a (0, 2) sequence
+		constexpr uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed) noexcept
+		{
+			x += seed;
+			x ^= x * 0x6C50B47Cu;
+			x ^= x * 0xB82F1E52u;
+			x ^= x * 0xC7AFE638u;
+			x ^= x * 0x8D22F6E6u;
+			return x;
+		}
+
+		constexpr uint32_t NestedUniformScramble(uint32_t x, uint32_t seed) noexcept
+		{
+			return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+		}
+#pragma endregion
+
+#pragma region Sobol
+		//Generator matrix of the second Sobol dimension (primitive polynomial x + 1), the first is the bit reversal
+		constexpr std::array<uint32_t, 32> g_SobolDirections{ []()
+			{
+				std::array<uint32_t, 32> directions{};
+				directions[0] = 1u << 31;
+				for (uint32_t i{ 1 }; i < 32; ++i)
+				{
+					directions[i] = directions[i - 1] ^ (directions[i - 1] >> 1);
+				}
+				return directions;
+			}() };
+
+		constexpr uint32_t SobolDimension1(uint32_t index) noexcept
+		{
+			uint32_t x{ 0 };
+			for (uint32_t bit{ 0 }; index != 0; index >>= 1, ++bit)
+			{
+				if (index & 1)
+				{
+					x ^= g_SobolDirections[bit];
+				}
+			}
+			return x;
+		}
+
+		//Owen scrambled and shuffled 2D Sobol
+		constexpr Vector3 Sobol2D(uint32_t index, uint32_t seed) noexcept
+		{
+			index = NestedUniformScramble(index, seed);
+
+			uint32_t const x{ NestedUniformScramble(ReverseBits(index), HashCombine(seed, 0)) };
+			uint32_t const y{ NestedUniformScramble(SobolDimension1(index), HashCombine(seed, 1)) };
+
+			return { ToUnitFloat(x), ToUnitFloat(y), 0.f };
+		}
+#pragma endregion
+
+#pragma region Halton
+		constexpr std::array<uint32_t, 16> g_Primes{ 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53 };
+
+		constexpr float RadicalInverse(uint32_t index, uint32_t base) noexcept
+		{
+			float const invBase{ 1.f / static_cast<float>(base) };
+			float invBaseN{ 1.f };
+			uint32_t reversed{ 0 };
+
+			while (index > 0)
+			{
+				uint32_t const next{ index / base };
+				reversed = reversed * base + (index - next * base);
+				invBaseN *= invBase;
+				index = next;
+			}
+
+			float const result{ static_cast<float>(reversed) * invBaseN };
+			return result < 1.f ? result : 0x1.fffffep-1f;
+		}
+
+		//dimensionPair picks the bases, pair 0 is (2, 3); the seed rotates the point set per pixel (Cranley-Patterson)
+		constexpr Vector3 Halton2D(uint32_t index, uint32_t dimensionPair, uint32_t seed) noexcept
+		{
+			uint32_t const baseIdx{ (dimensionPair * 2) % static_cast<uint32_t>(g_Primes.size()) };
+
+			float x{ RadicalInverse(index, g_Primes[baseIdx]) + ToUnitFloat(HashCombine(seed, 0) * 0x9E3779B1u) };
+			float y{ RadicalInverse(index, g_Primes[baseIdx + 1]) + ToUnitFloat(HashCombine(seed, 1) * 0x9E3779B1u) };
+
+			x -= x >= 1.f ? 1.f : 0.f;
+			y -= y >= 1.f ? 1.f : 0.f;
+
+			return { x, y, 0.f };
+		}
+#pragma endregion
+
+#pragma region Blue Noise
+		//Tileable blue noise dither mask, every texel holds a unique rank in [0, size * size)
+		//Generated once with Ulichney's void and cluster method, the first call pays the ~50 ms
+		class BlueNoiseMask final
+		{
+		public:
+			static constexpr uint32_t size{ 64 };
+
+			static BlueNoiseMask const& Get()
+			{
+				static BlueNoiseMask const mask{};
+				return mask;
+			}
+
+			uint32_t GetRank(uint32_t x, uint32_t y) const noexcept { return m_Ranks[(x % size) + (y % size) * size]; }
+			float GetValue(uint32_t x, uint32_t y) const noexcept { return (static_cast<float>(GetRank(x, y)) + .5f) / static_cast<float>(size * size); }
+
+		private:
+			std::vector<uint32_t> m_Ranks{};
+
+			BlueNoiseMask()
+			{
+				constexpr uint32_t pixelCount{ size * size };
+				constexpr float sigma{ 1.5f };
+
+				//Toroidal gaussian for every offset, energy(p) = sum of kernel(p - q) over all set q
+				std::vector<float> kernel(pixelCount);
+				for (uint32_t y{ 0 }; y < size; ++y)
+				{
+					for (uint32_t x{ 0 }; x < size; ++x)
+					{
+						float const dx{ static_cast<float>(std::min(x, size - x)) };
+						float const dy{ static_cast<float>(std::min(y, size - y)) };
+						kernel[x + y * size] = std::exp(-(dx * dx + dy * dy) / (2.f * sigma * sigma));
+					}
+				}
+
+				std::vector<uint8_t> pattern(pixelCount, 0);
+				std::vector<float> energy(pixelCount, 0.f);
+
+				auto const toggle{ [&](uint32_t idx, bool set)
+					{
+						pattern[idx] = set ? 1 : 0;
+						float const sign{ set ? 1.f : -1.f };
+
+						uint32_t const px{ idx % size };
+						uint32_t const py{ idx / size };
+						for (uint32_t y{ 0 }; y < size; ++y)
+						{
+							for (uint32_t x{ 0 }; x < size; ++x)
+							{
+								uint32_t const kx{ (x + size - px) % size };
+								uint32_t const ky{ (y + size - py) % size };
+								energy[x + y * size] += sign * kernel[kx + ky * size];
+							}
+						}
+					} };
+
+				//Tightest cluster is the set pixel with the highest energy, largest void the empty pixel with the lowest
+				auto const findExtreme{ [&](uint8_t value, bool highest)
+					{
+						uint32_t best{ pixelCount };
+						for (uint32_t i{ 0 }; i < pixelCount; ++i)
+						{
+							if (pattern[i] != value)
+							{
+								continue;
+							}
+
+							if (best == pixelCount || (highest ? energy[i] > energy[best] : energy[i] < energy[best]))
+							{
+								best = i;
+							}
+						}
+						return best;
+					} };
+
+				//Initial binary pattern, a tenth of the pixels set at random (fixed seed so the mask is the same every run)
+				uint32_t const initialCount{ pixelCount / 10 };
+				uint32_t state{ 0x12345678u };
+				for (uint32_t placed{ 0 }; placed < initialCount;)
+				{
+					state = state * 1664525u + 1013904223u;
+					uint32_t const idx{ (state >> 8) % pixelCount };
+					if (!pattern[idx])
+					{
+						toggle(idx, true);
+						++placed;
+					}
+				}
+
+				//Move points from clusters into voids until that stops changing anything
+				for (uint32_t iteration{ 0 }; iteration < pixelCount; ++iteration)
+				{
+					uint32_t const cluster{ findExtreme(1, true) };
+					toggle(cluster, false);
+
+					uint32_t const largestVoid{ findExtreme(0, false) };
+					toggle(largestVoid, true);
+
+					if (largestVoid == cluster)
+					{
+						break;
+					}
+				}
+
+				m_Ranks.assign(pixelCount, 0);
+
+				std::vector<uint8_t> const prototype{ pattern };
+				std::vector<float> const prototypeEnergy{ energy };
+
+				//Phase 1: rank the prototype points by removing the tightest cluster first
+				for (uint32_t rank{ initialCount }; rank > 0; --rank)
+				{
+					uint32_t const cluster{ findExtreme(1, true) };
+					toggle(cluster, false);
+					m_Ranks[cluster] = rank - 1;
+				}
+
+				//Phase 2: fill the largest voids for the remaining ranks
+				pattern = prototype;
+				energy = prototypeEnergy;
+				for (uint32_t rank{ initialCount }; rank < pixelCount; ++rank)
+				{
+					uint32_t const largestVoid{ findExtreme(0, false) };
+					toggle(largestVoid, true);
+					m_Ranks[largestVoid] = rank;
+				}
+			}
+		};
+
+		//Sobol points shifted per pixel by the blue noise mask, the error between neighbouring pixels becomes high frequency
+		inline Vector3 BlueNoise2D(uint32_t index, uint32_t px, uint32_t py, uint32_t dimensionPair) noexcept
+		{
+			BlueNoiseMask const& mask{ BlueNoiseMask::Get() };
+
+			//Every dimension reads the mask at a different offset so x, y and the different pairs are not correlated
+			uint32_t const offsetX{ dimensionPair * 23 + 7 };
+			uint32_t const offsetY{ dimensionPair * 41 + 19 };
+
+			float x{ ToUnitFloat(ReverseBits(index)) + mask.GetValue(px + offsetX, py) };
+			float y{ ToUnitFloat(SobolDimension1(index)) + mask.GetValue(px, py + offsetY) };
+
+			x -= x >= 1.f ? 1.f : 0.f;
+			y -= y >= 1.f ? 1.f : 0.f;
+
+			return { x, y, 0.f };
+		}
+#pragma endregion
+	}
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "Scene.h"
 #include "Utils.h"
+#include "MeshCache.h"
+#include "RayPacket.h"
 #include "Material.h"
 #include "Light.h"
 #include "BVH.h"
@@ -8,164 +10,370 @@
 #include <ranges>
 #include <algorithm>
 
-#include "SDL_egl.h"
 
 namespace dae
 {
 #pragma region Base Scene
 	//Initialize Scene with Default Solid Color Material (RED)
 	Scene::Scene() :
-		m_Materials({ new Material_SolidColor({1,0,0}) })
+		m_Materials({ Material::CreateSolidColor({1,0,0}) })
 	{
-		m_SphereGeometries.reserve(32);
-		m_PlaneGeometries.reserve(32);
+		m_SphereBlocks.reserve(4);
+		m_PlaneBlocks.reserve(4);
 		m_TriangleMeshGeometries.reserve(32);
+		m_InstancedMeshes.reserve(32);
 		m_Lights.reserve(32);
 	}
 
-	Scene::~Scene()
+	Scene::~Scene() = default;
+
+	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
-		for (auto& pMaterial : m_Materials)
+		//The loops below only narrow down the closest distance and what sits there,
+		//the surface (position, normal, material) is reconstructed once for the winner at the end
+		enum class HitType : uint8_t
+		{
+			None,
+			Sphere,
+			Plane,
+			Mesh,
+			Instance
+		};
+
+		HitType closestType{ HitType::None };
+		float closestT{ FLT_MAX };
+		SphereBlock const* pClosestSphereBlock{ nullptr };
+		PlaneBlock const* pClosestPlaneBlock{ nullptr };
+		uint32_t closestSlot{ 0 };
+		TriangleMesh const* pClosestMesh{ nullptr };
+		TriangleHit closestTriangle{ };
+
+		float t[SphereBlock::width];
+		for (auto const& block : m_SphereBlocks)
 		{
-			delete pMaterial;
-			pMaterial = nullptr;
+			uint32_t const hitMask{ block.Intersect(ray, t) };
+			if (hitMask == 0)
+			{
+				continue;
+			}
+
+			uint32_t const slot{ ClosestSlot(t, hitMask) };
+			if (t[slot] < closestT)
+			{
+				closestT = t[slot];
+				closestType = HitType::Sphere;
+				pClosestSphereBlock = &block;
+				closestSlot = slot;
+			}
 		}
 
-		m_Materials.clear();
-	}
+		for (auto const& block : m_PlaneBlocks)
+		{
+			uint32_t const hitMask{ block.Intersect(ray, t) };
+			if (hitMask == 0)
+			{
+				continue;
+			}
 
-	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
-	{
-		constexpr bool useBVH{ false };
+			uint32_t const slot{ ClosestSlot(t, hitMask) };
+			if (t[slot] < closestT)
+			{
+				closestT = t[slot];
+				closestType = HitType::Plane;
+				pClosestPlaneBlock = &block;
+				closestSlot = slot;
+			}
+		}
+
+		//Anything behind the closest hit so far can be culled by the BVH traversal
+		Ray meshRay{ ray };
+		for (auto const& mesh : m_TriangleMeshGeometries)
+		{
+			meshRay.max = std::min(ray.max, closestT);
 
-		HitRecord closestHitRecord{ };
+			TriangleHit temp{ };
+			bool const didHit{ mesh.bvh.empty() ? GeometryUtils::HitTest_TriangleMesh(mesh, meshRay, temp)
+												: GeometryUtils::HitTest_MeshBVH(meshRay, mesh, temp) };
+			if (didHit && temp.t < closestT)
+			{
+				closestT = temp.t;
+				closestType = HitType::Mesh;
+				pClosestMesh = &mesh;
+				closestTriangle = temp;
+			}
+		}
 
-		for(auto const& sphere : m_SphereGeometries)
+		if (!m_MeshInstances.empty())
 		{
-			HitRecord temp{ };
-			if (GeometryUtils::HitTest_Sphere(sphere, ray, temp))
+			meshRay.max = std::min(ray.max, closestT);
+
+			TriangleHit temp{ };
+			if (GeometryUtils::HitTest_TLAS(meshRay, m_TLAS, m_MeshInstances, m_InstancedMeshes, temp) && temp.t < closestT)
 			{
-				if (temp.t < closestHitRecord.t)
-				{
-					closestHitRecord = temp;
-				}
+				closestT = temp.t;
+				closestType = HitType::Instance;
+				closestTriangle = temp;
 			}
 		}
 
-		for (auto const& plane : m_PlaneGeometries)
+		closestHit = HitRecord{ };
+		switch (closestType)
+		{
+		case HitType::Sphere:
+			GeometryUtils::FillHitRecord(pClosestSphereBlock->Get(closestSlot), ray, closestT, closestHit);
+			break;
+		case HitType::Plane:
+			GeometryUtils::FillHitRecord(pClosestPlaneBlock->Get(closestSlot), ray, closestT, closestHit);
+			break;
+		case HitType::Mesh:
+			GeometryUtils::FillHitRecord(*pClosestMesh, ray, closestTriangle, closestHit);
+			break;
+		case HitType::Instance:
 		{
-			HitRecord temp{ };
-			if (GeometryUtils::HitTest_Plane(plane, ray, temp))
+			MeshInstance const& instance{ m_MeshInstances[closestTriangle.instanceIdx] };
+			GeometryUtils::FillHitRecord(instance, m_InstancedMeshes[instance.meshIndex], ray, closestTriangle, closestHit);
+			break;
+		}
+		case HitType::None:
+		default:
+			break;
+		}
+	}
+
+	template<uint32_t Width>
+	void Scene::GetClosestHits(RayPacket<Width>& packet) const
+	{
+		//Spheres and planes only track the distance and primitive of every lane, the hit records are filled once at the end
+		//Primitive indices count block slots, spheres first and planes after them
+		static constexpr uint32_t noPrimitive{ UINT32_MAX };
+		uint32_t const firstPlaneIdx{ static_cast<uint32_t>(m_SphereBlocks.size()) * SphereBlock::width };
+
+		alignas(64) float closestT[Width];
+		alignas(64) uint32_t closestIdx[Width];
+		for (uint32_t i{ 0 }; i < Width; ++i)
+		{
+			closestT[i] = packet.hits[i].t;
+			closestIdx[i] = noPrimitive;
+		}
+
+		//The packet lanes are the SIMD dimension, every 4 lanes walk the slots of a block broadcast from its SoA arrays
+		for (uint32_t blockIdx{ 0 }; blockIdx < m_SphereBlocks.size(); ++blockIdx)
+		{
+			GeometryUtils::HitTest_SphereBlock(m_SphereBlocks[blockIdx], blockIdx * SphereBlock::width, packet, closestT, closestIdx);
+		}
+
+		for (uint32_t blockIdx{ 0 }; blockIdx < m_PlaneBlocks.size(); ++blockIdx)
+		{
+			GeometryUtils::HitTest_PlaneBlock(m_PlaneBlocks[blockIdx], firstPlaneIdx + blockIdx * PlaneBlock::width, packet, closestT, closestIdx);
+		}
+
+		for (uint32_t i{ 0 }; i < packet.count; ++i)
+		{
+			uint32_t const primitiveIdx{ closestIdx[i] };
+			if (primitiveIdx == noPrimitive)
 			{
-				if (temp.t < closestHitRecord.t)
-				{
-					closestHitRecord = temp;
-				}
+				continue;
+			}
+
+			if (primitiveIdx < firstPlaneIdx)
+			{
+				SphereBlock const& block{ m_SphereBlocks[primitiveIdx / SphereBlock::width] };
+				GeometryUtils::FillHitRecord(block.Get(primitiveIdx % SphereBlock::width), packet.GetRay(i), closestT[i], packet.hits[i]);
+			}
+			else
+			{
+				PlaneBlock const& block{ m_PlaneBlocks[(primitiveIdx - firstPlaneIdx) / PlaneBlock::width] };
+				GeometryUtils::FillHitRecord(block.Get((primitiveIdx - firstPlaneIdx) % PlaneBlock::width), packet.GetRay(i), closestT[i], packet.hits[i]);
 			}
 		}
 
-		if (useBVH)
+		for (auto const& mesh : m_TriangleMeshGeometries)
 		{
-			for (const auto& mesh : m_TriangleMeshGeometries)
+			if (!mesh.bvh.empty())
 			{
-				HitRecord temp{ };
-				if (GeometryUtils::HitTest_BVH(ray, mesh, mesh.bvh, 0, temp))
+				GeometryUtils::HitTest_MeshBVH(mesh, packet);
+				continue;
+			}
+
+			for (uint32_t i{ 0 }; i < packet.count; ++i)
+			{
+				Ray meshRay{ packet.GetRay(i) };
+				meshRay.max = std::min(meshRay.max, packet.hits[i].t);
+
+				TriangleHit temp{ };
+				if (GeometryUtils::HitTest_TriangleMesh(mesh, meshRay, temp) && temp.t < packet.hits[i].t)
 				{
-					if (temp.t < closestHitRecord.t)
-					{
-						closestHitRecord = temp;
-					}
+					GeometryUtils::FillHitRecord(mesh, meshRay, temp, packet.hits[i]);
 				}
 			}
 		}
-		else
+
+		//Instances each have their own transform, the packet falls apart into single rays there
+		if (!m_MeshInstances.empty())
 		{
-			for (auto const& mesh : m_TriangleMeshGeometries)
+			for (uint32_t i{ 0 }; i < packet.count; ++i)
 			{
-				HitRecord temp{ };
-				if (GeometryUtils::HitTest_TriangleMesh(mesh, ray, temp))
+				Ray meshRay{ packet.GetRay(i) };
+				meshRay.max = std::min(meshRay.max, packet.hits[i].t);
+
+				TriangleHit temp{ };
+				if (GeometryUtils::HitTest_TLAS(meshRay, m_TLAS, m_MeshInstances, m_InstancedMeshes, temp) && temp.t < packet.hits[i].t)
 				{
-					if (temp.t < closestHitRecord.t)
-					{
-						closestHitRecord = temp;
-					}
+					MeshInstance const& instance{ m_MeshInstances[temp.instanceIdx] };
+					GeometryUtils::FillHitRecord(instance, m_InstancedMeshes[instance.meshIndex], meshRay, temp, packet.hits[i]);
 				}
 			}
 		}
-
-		closestHit = closestHitRecord;
 	}
 
+	template void Scene::GetClosestHits(RayPacket<4>& packet) const;
+	template void Scene::GetClosestHits(RayPacket<8>& packet) const;
+	template void Scene::GetClosestHits(RayPacket<16>& packet) const;
+
 	bool Scene::DoesHit(const Ray& ray) const
 	{
-		constexpr bool useBVH{ false };
+		float t[SphereBlock::width];
+		for (auto const& block : m_SphereBlocks)
+		{
+			if (block.Intersect(ray, t))
+			{
+				return true;
+			}
+		}
 
-		for (auto const& sphere : m_SphereGeometries)
+		for (auto const& block : m_PlaneBlocks)
 		{
-			if (GeometryUtils::HitTest_Sphere(sphere, ray))
+			if (block.Intersect(ray, t))
 			{
 				return true;
 			}
 		}
 
-		for (auto const& plane : m_PlaneGeometries)
+		for (auto const& mesh : m_TriangleMeshGeometries)
 		{
-			if (GeometryUtils::HitTest_Plane(plane, ray))
+			bool const didHit{ mesh.bvh.empty() ? GeometryUtils::HitTest_TriangleMesh(mesh, ray)
+												: GeometryUtils::HitTest_MeshBVH(ray, mesh) };
+			if (didHit)
 			{
 				return true;
 			}
 		}
 
+		if (!m_MeshInstances.empty() && GeometryUtils::HitTest_TLAS(ray, m_TLAS, m_MeshInstances, m_InstancedMeshes))
+		{
+			return true;
+		}
 
-		if (useBVH)
+		return false;
+	}
+
+	uint32_t Scene::DoesHit(const Ray* pRays, uint32_t count) const
+	{
+		assert(count <= 32);
+
+		static constexpr uint32_t packetWidth{ 16 };
+
+		uint32_t occluded{ 0 };
+		for (uint32_t first{ 0 }; first < count; first += packetWidth)
 		{
-			for (const auto& mesh : m_TriangleMeshGeometries)
+			RayPacket<packetWidth> packet;
+			packet.Reset();
+			for (uint32_t i{ first }; i < std::min(first + packetWidth, count); ++i)
+			{
+				packet.Add(pRays[i]);
+			}
+			packet.Finalize();
+
+			//Lanes still looking for a blocker, every primitive type only tests those
+			uint32_t activeMask{ packet.GetLaneMask() };
+
+			for (auto const& block : m_SphereBlocks)
 			{
-				if (GeometryUtils::HitTest_BVH(ray, mesh, mesh.bvh, 0))
+				for (uint32_t slot{ 0 }; slot < block.count; ++slot)
 				{
-					return true;
+					activeMask &= ~GeometryUtils::OcclusionTest_Sphere(block.Get(slot), packet, activeMask);
 				}
 			}
-		}
-		else
-		{
+
+			for (auto const& block : m_PlaneBlocks)
+			{
+				for (uint32_t slot{ 0 }; slot < block.count; ++slot)
+				{
+					activeMask &= ~GeometryUtils::OcclusionTest_Plane(block.Get(slot), packet, activeMask);
+				}
+			}
+
 			for (auto const& mesh : m_TriangleMeshGeometries)
 			{
-				if (GeometryUtils::HitTest_TriangleMesh(mesh, ray))
+				if (activeMask == 0)
+				{
+					break;
+				}
+
+				if (!mesh.bvh.empty())
 				{
-					return true;
+					activeMask &= ~GeometryUtils::OcclusionTest_MeshBVH(mesh, packet, activeMask);
+					continue;
+				}
+
+				for (uint32_t mask{ activeMask }; mask; mask &= mask - 1)
+				{
+					uint32_t const i{ static_cast<uint32_t>(std::countr_zero(mask)) };
+					if (GeometryUtils::HitTest_TriangleMesh(mesh, packet.GetRay(i)))
+					{
+						activeMask &= ~(1u << i);
+					}
+				}
+			}
+
+			if (!m_MeshInstances.empty())
+			{
+				for (uint32_t mask{ activeMask }; mask; mask &= mask - 1)
+				{
+					uint32_t const i{ static_cast<uint32_t>(std::countr_zero(mask)) };
+					if (GeometryUtils::HitTest_TLAS(packet.GetRay(i), m_TLAS, m_MeshInstances, m_InstancedMeshes))
+					{
+						activeMask &= ~(1u << i);
+					}
 				}
 			}
-		}
 
+			occluded |= (packet.GetLaneMask() & ~activeMask) << first;
+		}
 
-		return false;
+		return occluded;
 	}
 
 #pragma region Scene Helpers
-	Sphere* Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
+	void Scene::AddSphere(const Vector3& origin, float radius, MaterialId materialIndex)
 	{
 		Sphere s;
 		s.origin = origin;
 		s.radius = radius;
 		s.materialIndex = materialIndex;
 
-		m_SphereGeometries.emplace_back(s);
-		return &m_SphereGeometries.back();
+		if (m_SphereBlocks.empty() || m_SphereBlocks.back().count == SphereBlock::width)
+		{
+			m_SphereBlocks.emplace_back();
+		}
+		m_SphereBlocks.back().Add(s);
 	}
 
-	Plane* Scene::AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex)
+	void Scene::AddPlane(const Vector3& origin, const Vector3& normal, MaterialId materialIndex)
 	{
 		Plane p;
 		p.origin = origin;
 		p.normal = normal;
 		p.materialIndex = materialIndex;
 
-		m_PlaneGeometries.emplace_back(p);
-		return &m_PlaneGeometries.back();
+		if (m_PlaneBlocks.empty() || m_PlaneBlocks.back().count == PlaneBlock::width)
+		{
+			m_PlaneBlocks.emplace_back();
+		}
+		m_PlaneBlocks.back().Add(p);
 	}
 
-	TriangleMesh* Scene::AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex)
+	TriangleMesh* Scene::AddTriangleMesh(TriangleCullMode cullMode, MaterialId materialIndex)
 	{
 		TriangleMesh m{};
 		m.cullMode = cullMode;
@@ -175,6 +383,35 @@ namespace dae
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	TriangleMesh* Scene::AddInstancedMesh(TriangleCullMode cullMode)
+	{
+		TriangleMesh m{};
+		m.cullMode = cullMode;
+
+		m_InstancedMeshes.emplace_back(m);
+		return &m_InstancedMeshes.back();
+	}
+
+	//The mesh has to be fully set up (transforms updated, BVH initialized) before instancing it
+	MeshInstance* Scene::AddMeshInstance(TriangleMesh const* pMesh, Matrix const& transform, MaterialId materialIndex)
+	{
+		assert(pMesh >= m_InstancedMeshes.data() && pMesh < m_InstancedMeshes.data() + m_InstancedMeshes.size());
+		assert(!pMesh->bvh.empty());
+
+		MeshInstance i{};
+		i.meshIndex = static_cast<uint32_t>(pMesh - m_InstancedMeshes.data());
+		i.materialIndex = materialIndex;
+		i.SetTransform(transform, *pMesh);
+
+		m_MeshInstances.emplace_back(i);
+		return &m_MeshInstances.back();
+	}
+
+	void Scene::BuildTLAS()
+	{
+		m_TLAS.Build(m_MeshInstances);
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -234,10 +471,10 @@ namespace dae
 		return &m_Lights.back();
 	}
 
-	unsigned char Scene::AddMaterial(Material* pMaterial)
+	MaterialId Scene::AddMaterial(const Material& material)
 	{
-		m_Materials.push_back(pMaterial);
-		return static_cast<unsigned char>(m_Materials.size() - 1);
+		m_Materials.push_back(material);
+		return static_cast<MaterialId>(m_Materials.size() - 1);
 	}
 #pragma endregion
 #pragma endregion
@@ -246,12 +483,12 @@ namespace dae
 	void Scene_W1::Initialize()
 	{
 		//default: Material id0 >> SolidColor Material (RED)
-		unsigned char constexpr matId_Solid_Red{ 0 };
-		unsigned char const matId_Solid_Blue{ AddMaterial(new Material_SolidColor{ colors::Blue }) };
+		MaterialId constexpr matId_Solid_Red{ 0 };
+		MaterialId const matId_Solid_Blue{ AddMaterial(Material::CreateSolidColor(colors::Blue)) };
 
-		unsigned char const matId_Solid_Yellow{ AddMaterial(new Material_SolidColor{ colors::Yellow }) };
-		unsigned char const matId_Solid_Green { AddMaterial(new Material_SolidColor{ colors::Green }) };
-		unsigned char const matId_Solid_Magenta{ AddMaterial(new Material_SolidColor{ colors::Magenta }) };
+		MaterialId const matId_Solid_Yellow{ AddMaterial(Material::CreateSolidColor(colors::Yellow)) };
+		MaterialId const matId_Solid_Green { AddMaterial(Material::CreateSolidColor(colors::Green)) };
+		MaterialId const matId_Solid_Magenta{ AddMaterial(Material::CreateSolidColor(colors::Magenta)) };
 
 		//Spheres
 		AddSphere({ -25.f, 0.f, 100.f }, 50.f, matId_Solid_Red);
@@ -273,12 +510,12 @@ namespace dae
 		m_Camera.fovAngle = 45.f;
 
 		//default: Material id0 >> SolidColor Material (RED)
-		unsigned char constexpr matId_Solid_Red{ 0 };
-		unsigned char const matId_Solid_Blue{ AddMaterial(new Material_SolidColor{ colors::Blue }) };
+		MaterialId constexpr matId_Solid_Red{ 0 };
+		MaterialId const matId_Solid_Blue{ AddMaterial(Material::CreateSolidColor(colors::Blue)) };
 
-		unsigned char const matId_Solid_Yellow{ AddMaterial(new Material_SolidColor{ colors::Yellow }) };
-		unsigned char const matId_Solid_Green{ AddMaterial(new Material_SolidColor{ colors::Green }) };
-		unsigned char const matId_Solid_Magenta{ AddMaterial(new Material_SolidColor{ colors::Magenta }) };
+		MaterialId const matId_Solid_Yellow{ AddMaterial(Material::CreateSolidColor(colors::Yellow)) };
+		MaterialId const matId_Solid_Green{ AddMaterial(Material::CreateSolidColor(colors::Green)) };
+		MaterialId const matId_Solid_Magenta{ AddMaterial(Material::CreateSolidColor(colors::Magenta)) };
 
 		//Planes
 		AddPlane({ -5.f, 0.f, 0.f }, { 1.f, 0.f,0.f }, matId_Solid_Green);
@@ -306,14 +543,14 @@ namespace dae
 		m_Camera.origin = { 0.f, 3.f, -9.f };
 		m_Camera.fovAngle = 45.f;
 
-		auto const matCT_GrayRoughMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f}, 1.f, 1.f }) };
-		auto const matCT_GrayMediumMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f}, 1.f, .6f }) };
-		auto const matCT_GraySmoothMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f}, 1.f, .1f }) };
-		auto const matCT_GrayRoughPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f}, 0.f, 1.f }) };
-		auto const matCT_GrayMediumPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f}, 0.f, .6f }) };
-		auto const matCT_GraySmoothPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f}, 0.f, .1f }) };
+		auto const matCT_GrayRoughMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, 1.f)) };
+		auto const matCT_GrayMediumMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, .6f)) };
+		auto const matCT_GraySmoothMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, .1f)) };
+		auto const matCT_GrayRoughPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f}, 0.f, 1.f)) };
+		auto const matCT_GrayMediumPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f}, 0.f, .6f)) };
+		auto const matCT_GraySmoothPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f}, 0.f, .1f)) };
 
-		auto const matLambertGrayBlue{ AddMaterial(new Material_Lambert{{.49f, .57f, .57f}, 1.f}) };
+		auto const matLambertGrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f}, 1.f)) };
 
 		//Planes
 		AddPlane({ 0.f, 0.f, 10.f }, { 0.f, 0.f,-1.f }, matLambertGrayBlue);
@@ -341,9 +578,9 @@ namespace dae
 		m_Camera.origin = { 0.f, 1.f, -5.f };
 		m_Camera.fovAngle = 45.f;
 
-		unsigned char const matId_Red{ AddMaterial(new Material_Lambert{ colors::Red, 1.f }) };
-		unsigned char const matId_Blue{ AddMaterial(new Material_LambertPhong{ colors::Blue, 1.f, 1.f, 60.f }) };
-		unsigned char const matId_Yellow{ AddMaterial(new Material_Lambert{ colors::Yellow, 1.f }) };
+		MaterialId const matId_Red{ AddMaterial(Material::CreateLambert(colors::Red, 1.f)) };
+		MaterialId const matId_Blue{ AddMaterial(Material::CreateLambertPhong(colors::Blue, 1.f, 1.f, 60.f)) };
+		MaterialId const matId_Yellow{ AddMaterial(Material::CreateLambert(colors::Yellow, 1.f)) };
 
 		//Spheres
 		AddSphere({ -.75f, 1.f, 0.f }, 1.f, matId_Red);
@@ -362,8 +599,8 @@ namespace dae
 		m_Camera.origin = { 0.f, 1.f, -5.f };
 		m_Camera.fovAngle = 45.f;
 
-		auto const matLambert_GrayBlue{ AddMaterial(new Material_Lambert{ {.49f, .57f, .57f }, 1.f}) };
-		auto const matLambert_White{ AddMaterial(new Material_Lambert{ colors::White, 1.f}) };
+		auto const matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f }, 1.f)) };
+		auto const matLambert_White{ AddMaterial(Material::CreateLambert(colors::White, 1.f)) };
 
 		AddPlane({ 0.f, 0.f, 10.f }, { 0.f, 0.f, -1.f }, matLambert_GrayBlue);
 		AddPlane({ 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, matLambert_GrayBlue);
@@ -376,6 +613,7 @@ namespace dae
 		m->AppendTriangle(baseTriangle, true);
 		m->Translate({ 0.f, .5f, 0.f });
 		m->UpdateTransforms();
+		m->InitializeBVH();
 
 		//Lights
 		AddPointLight({ 0.f, 5.f, 5.f }, 50.f, { 1.f, .61f, .45f });
@@ -388,8 +626,8 @@ namespace dae
 		m_Camera.origin = { 0.f, 1.f, -5.f };
 		m_Camera.fovAngle = 45.f;
 
-		auto const matLambert_GrayBlue{ AddMaterial(new Material_Lambert{ {.49f, .57f, .57f }, 1.f}) };
-		auto const matLambert_White{ AddMaterial(new Material_Lambert{ colors::White, 1.f}) };
+		auto const matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f }, 1.f)) };
+		auto const matLambert_White{ AddMaterial(Material::CreateLambert(colors::White, 1.f)) };
 
 		AddPlane({ 0.f, 0.f, 10.f }, { 0.f, 0.f, -1.f }, matLambert_GrayBlue);
 		AddPlane({ 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, matLambert_GrayBlue);
@@ -398,16 +636,14 @@ namespace dae
 		AddPlane({ -5.f, 0.f, 0.f }, { 1.f, 0.f, 0.f }, matLambert_GrayBlue);
 
 		auto pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		//Utils::ParseOBJ("resources/simple_cube.obj",
-		Utils::ParseOBJ("resources/simple_object.obj",
-			pMesh->positions,
-			pMesh->normals,
-			pMesh->indices);
+		//Utils::ParseOBJ("resources/simple_cube.obj", *pMesh);
+		Utils::ParseOBJ("resources/simple_object.obj", *pMesh);
 
 		pMesh->Scale({ .7f, .7f, .7f });
 		pMesh->Translate({ 0.f, 1.f, 0.f });
 
 		pMesh->UpdateTransforms();
+		pMesh->InitializeBVH();
 
 		//Lights
 		AddPointLight({ 0.f, 5.f, 5.f }, 50.f, { 1.f, .61f, .45f });
@@ -429,15 +665,15 @@ namespace dae
 		m_Camera.origin = { 0.f, 3.f, -9.f };
 		m_Camera.fovAngle = 45.f;
 
-		auto const matCT_GrayRoughMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f}, 1.f, 1.f }) };
-		auto const matCT_GrayMediumMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f}, 1.f, .6f }) };
-		auto const matCT_GraySmoothMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f}, 1.f, .1f }) };
-		auto const matCT_GrayRoughPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f}, 0.f, 1.f }) };
-		auto const matCT_GrayMediumPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f}, 0.f, .6f }) };
-		auto const matCT_GraySmoothPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f}, 0.f, .1f }) };
+		auto const matCT_GrayRoughMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, 1.f)) };
+		auto const matCT_GrayMediumMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, .6f)) };
+		auto const matCT_GraySmoothMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, .1f)) };
+		auto const matCT_GrayRoughPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f}, 0.f, 1.f)) };
+		auto const matCT_GrayMediumPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f}, 0.f, .6f)) };
+		auto const matCT_GraySmoothPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f}, 0.f, .1f)) };
 
-		auto const matLambert_GrayBlue{ AddMaterial(new Material_Lambert{ {.49f, .57f, .57f }, 1.f}) };
-		auto const matLambert_White{ AddMaterial(new Material_Lambert{ colors::White, 1.f}) };
+		auto const matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f }, 1.f)) };
+		auto const matLambert_White{ AddMaterial(Material::CreateLambert(colors::White, 1.f)) };
 
 		//Planes
 		AddPlane({ 0.f, 0.f, 10.f }, { 0.f, 0.f, -1.f }, matLambert_GrayBlue);
@@ -460,18 +696,21 @@ namespace dae
 		m->Translate({ -1.75f, 4.5f, 0.f });
 		m->UpdateAABB();
 		m->UpdateTransforms();
+		m->InitializeBVH();
 
 		m = AddTriangleMesh(TriangleCullMode::FrontFaceCulling, matLambert_White);
 		m->AppendTriangle(baseTriangle, true);
 		m->Translate({ 0.f, 4.5f, 0.f });
 		m->UpdateAABB();
 		m->UpdateTransforms();
+		m->InitializeBVH();
 
 		m = AddTriangleMesh(TriangleCullMode::NoCulling, matLambert_White);
 		m->AppendTriangle(baseTriangle, true);
 		m->Translate({ 1.75f, 4.5f, 0.f });
 		m->UpdateAABB();
 		m->UpdateTransforms();
+		m->InitializeBVH();
 
 		//Lights
 		AddPointLight({ 0.f, 5.f, 5.f }, 50.f, { 1.f, .61f, .45f });
@@ -489,6 +728,7 @@ namespace dae
 			m.RotateY(yawAngle);
 			m.UpdateTransforms();
 		}
+		MarkChanged();
 	}
 
 	void Scene_W4_BunnyScene::Initialize()
@@ -497,8 +737,8 @@ namespace dae
 		m_Camera.origin = { 0.f, 3.f, -9.f };
 		m_Camera.fovAngle = 45.f;
 
-		auto const matLambert_GrayBlue{ AddMaterial(new Material_Lambert{ {.49f, .57f, .57f }, 1.f}) };
-		auto const matLambert_White{ AddMaterial(new Material_Lambert{ colors::White, 1.f}) };
+		auto const matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f }, 1.f)) };
+		auto const matLambert_White{ AddMaterial(Material::CreateLambert(colors::White, 1.f)) };
 
 		AddPlane({ 0.f, 0.f, 10.f }, { 0.f, 0.f, -1.f }, matLambert_GrayBlue);
 		AddPlane({ 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, matLambert_GrayBlue);
@@ -524,20 +764,15 @@ namespace dae
 		//m->InitializeBVH();
 
 		auto pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("resources/lowpoly_bunny.obj",
-		//Utils::ParseOBJ("resources/simple_cube.obj",
-			pMesh->positions,
-			pMesh->normals,
-			pMesh->indices);
-
-		//pMesh->CalculateNormals();
-
 		pMesh->Scale({ 2.f, 2.f, 2.f });
 		pMesh->RotateY(TO_RADIANS * 180.f);
 
-		pMesh->UpdateAABB();
-		pMesh->UpdateTransforms(true);
-		pMesh->InitializeBVH();
+		BVHBuildSettings bvhSettings{};
+		bvhSettings.layout = BVHLayout::Wide4; //Binary / Wide4 / Wide8 / Quantized4 to compare traversal layouts
+
+		//Parses, transforms and builds the BVH on the first run only, after that it comes from the binary cache
+		MeshCache::LoadOBJ("resources/lowpoly_bunny.obj", *pMesh, bvhSettings);
+		//MeshCache::LoadOBJ("resources/simple_cube.obj", *pMesh, bvhSettings);
 
 
 		AddPointLight({ 0.f, 5.f, 5.f }, 50.f, { 1.f, .61f, .45f });
@@ -546,19 +781,55 @@ namespace dae
 	}
 #pragma endregion
 
+	void Scene_BunnyInstances::Initialize()
+	{
+		m_SceneName = "Bunny Instances";
+		m_Camera.origin = { 0.f, 3.f, -9.f };
+		m_Camera.fovAngle = 45.f;
+
+		auto const matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f }, 1.f)) };
+		auto const matLambert_White{ AddMaterial(Material::CreateLambert(colors::White, 1.f)) };
+		auto const matLambert_Yellow{ AddMaterial(Material::CreateLambert(colors::Yellow, 1.f)) };
+
+		AddPlane({ 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, matLambert_GrayBlue);
+
+		//One shared mesh, placed 1600 times
+		auto pMesh = AddInstancedMesh(TriangleCullMode::BackFaceCulling);
+		MeshCache::LoadOBJ("resources/lowpoly_bunny.obj", *pMesh);
+
+		constexpr int gridSize{ 40 };
+		constexpr float spacing{ 1.f };
+		for (int x{ 0 }; x < gridSize; ++x)
+		{
+			for (int z{ 0 }; z < gridSize; ++z)
+			{
+				Vector3 const position{ (x - gridSize / 2) * spacing, 0.f, z * spacing };
+				float const yaw{ (x * 7 + z * 13) * .37f };
+
+				Matrix const transform{ Matrix::CreateScale(.5f, .5f, .5f) * Matrix::CreateRotationY(yaw) * Matrix::CreateTranslation(position) };
+				AddMeshInstance(pMesh, transform, (x + z) % 2 ? matLambert_White : matLambert_Yellow);
+			}
+		}
+
+		BuildTLAS();
+
+		AddPointLight({ 0.f, 10.f, -5.f }, 150.f, { 1.f, .61f, .45f });
+		AddDirectionalLight(Vector3{ .3f, -1.f, .5f }.Normalized(), 1.f, colors::White);
+	}
+
 	void Scene_Softshadows::Initialize()
 	{
 		m_Camera.origin = { 0.f, 3.f, -9.f };
 		m_Camera.fovAngle = 45.f;
 
-		auto const matCT_GrayRoughMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f}, 1.f, 1.f }) };
-		auto const matCT_GrayMediumMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f}, 1.f, .6f }) };
-		auto const matCT_GraySmoothMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f}, 1.f, .1f }) };
-		auto const matCT_GrayRoughPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f}, 0.f, 1.f }) };
-		auto const matCT_GrayMediumPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f}, 0.f, .6f }) };
-		auto const matCT_GraySmoothPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f}, 0.f, .1f }) };
+		auto const matCT_GrayRoughMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, 1.f)) };
+		auto const matCT_GrayMediumMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, .6f)) };
+		auto const matCT_GraySmoothMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, .1f)) };
+		auto const matCT_GrayRoughPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f}, 0.f, 1.f)) };
+		auto const matCT_GrayMediumPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f}, 0.f, .6f)) };
+		auto const matCT_GraySmoothPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f}, 0.f, .1f)) };
 
-		auto const matLambert_GrayBlue{ AddMaterial(new Material_Lambert{ {.49f, .57f, .57f }, 1.f}) };
+		auto const matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f }, 1.f)) };
 
 		//Planes
 		AddPlane({ 0.f, 0.f, 10.f }, { 0.f, 0.f, -1.f }, matLambert_GrayBlue);
@@ -4,16 +4,17 @@
 
 #include "Maths.h"
 #include "DataTypes.h"
+#include "TLAS.h"
 #include "Light.h"
 #include "Camera.h"
+#include "Material.h"
+#include "PrimitiveBlocks.h"
 
 namespace dae
 {
 	//Forward Declarations
 	class Timer;
-	class Material;
-	struct Plane;
-	struct Sphere;
+	template<uint32_t Width> struct RayPacket;
 
 	//Scene Base Class
 	class Scene
@@ -35,32 +36,51 @@ namespace dae
 
 		Camera& GetCamera() { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
+		//Closest hit of every ray of a coherent packet, fills packet.hits; instantiated for 4, 8 and 16 wide packets
+		//Only meshes with a binary BVH are traversed as a packet, the other layouts and the instances are traced one ray at a time
+		template<uint32_t Width>
+		void GetClosestHits(RayPacket<Width>& packet) const;
 		[[nodiscard]] bool DoesHit(const Ray& ray) const;
+		//Any-hit test of count (at most 32) shadow rays traced as packets, bit i is set when pRays[i] is blocked
+		[[nodiscard]] uint32_t DoesHit(const Ray* pRays, uint32_t count) const;
 
-		std::vector<Plane> const& GetPlaneGeometries() const { return m_PlaneGeometries; }
-		std::vector<Sphere>const& GetSphereGeometries() const { return m_SphereGeometries; }
+		std::vector<PlaneBlock> const& GetPlaneBlocks() const { return m_PlaneBlocks; }
+		std::vector<SphereBlock> const& GetSphereBlocks() const { return m_SphereBlocks; }
 		std::vector<Light> const& GetLights() const { return m_Lights; }
-		std::vector<Material*> const& GetMaterials() const { return m_Materials; }
+		std::vector<Material> const& GetMaterials() const { return m_Materials; }
+
+		//Bumped whenever geometry, lights or materials change after Initialize, the camera is tracked separately
+		uint32_t GetVersion() const { return m_Version; }
 
 	protected:
 		std::string m_SceneName;
 
-		std::vector<Plane> m_PlaneGeometries{};
-		std::vector<Sphere> m_SphereGeometries{};
+		//Spheres and planes are packed SoA in blocks of 8, only the last block of each can be partially filled
+		std::vector<PlaneBlock> m_PlaneBlocks{};
+		std::vector<SphereBlock> m_SphereBlocks{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
+		std::vector<TriangleMesh> m_InstancedMeshes{}; //shared meshes, only traced through their instances
+		std::vector<MeshInstance> m_MeshInstances{};
+		TLAS m_TLAS{};
 		std::vector<Light> m_Lights{};
-		std::vector<Material*> m_Materials{};
+		std::vector<Material> m_Materials{};
 
 		Camera m_Camera{};
+		uint32_t m_Version{ 0 };
+
+		void MarkChanged() { ++m_Version; }
 
-		Sphere* AddSphere(Vector3 const& origin, float radius, unsigned char materialIndex = 0);
-		Plane* AddPlane(Vector3 const& origin, Vector3 const& normal, unsigned char materialIndex = 0);
-		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		void AddSphere(Vector3 const& origin, float radius, MaterialId materialIndex = 0);
+		void AddPlane(Vector3 const& origin, Vector3 const& normal, MaterialId materialIndex = 0);
+		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, MaterialId materialIndex = 0);
+		TriangleMesh* AddInstancedMesh(TriangleCullMode cullMode);
+		MeshInstance* AddMeshInstance(TriangleMesh const* pMesh, Matrix const& transform, MaterialId materialIndex = 0);
+		void BuildTLAS();
 
 		Light* AddPointLight(Vector3 const& origin, float intensity, ColorRGB const& color);
 		Light* AddAreaLight(Vector3 const& origin, float intensity, ColorRGB const& color, LightShape shape = LightShape::None, float radius = 0.f, std::vector<Vector3> const& vertices = {});
 		Light* AddDirectionalLight(Vector3 const& direction, float intensity, ColorRGB const& color);
-		unsigned char AddMaterial(Material* pMaterial);
+		MaterialId AddMaterial(const Material& material);
 	};
 
 	class Scene_W1 final : public Scene
@@ -177,6 +197,20 @@ namespace dae
 		void Initialize() override;
 	};
 
+	class Scene_BunnyInstances final : public Scene
+	{
+	public:
+		Scene_BunnyInstances() = default;
+		~Scene_BunnyInstances() override = default;
+
+		Scene_BunnyInstances(const Scene_BunnyInstances&) = delete;
+		Scene_BunnyInstances(Scene_BunnyInstances&&) noexcept = delete;
+		Scene_BunnyInstances& operator=(const Scene_BunnyInstances&) = delete;
+		Scene_BunnyInstances& operator=(Scene_BunnyInstances&&) noexcept = delete;
+
+		void Initialize() override;
+	};
+
 	class Scene_Softshadows final : public Scene
 	{
 	public:
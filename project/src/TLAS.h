@@ -0,0 +1,127 @@
+#ifndef TLAS_H
+#define TLAS_H
+
+#include <algorithm>
+#include <cassert>
+#include <stdint.h>
+#include <numeric>
+#include <vector>
+
+#include "BVH.h"
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Top level acceleration structure, a BVH over mesh instances instead of triangles
+	//Reuses BVHNode; in a leaf triangleCount is the amount of instances starting at leftFirst in instanceIndices
+	struct TLAS final
+	{
+		std::vector<BVHNode> nodes{}; //nodes[0] == root
+		std::vector<uint32_t> instanceIndices{};
+
+		void Build(const std::vector<MeshInstance>& instances)
+		{
+			nodes.clear();
+			instanceIndices.resize(instances.size());
+			std::iota(instanceIndices.begin(), instanceIndices.end(), 0);
+
+			if (instances.empty())
+			{
+				return;
+			}
+
+			//A binary tree over N leaves never needs more than 2N - 1 nodes
+			nodes.reserve(instances.size() * 2 - 1);
+			nodes.emplace_back(BVHNode{});
+			nodes[0].triangleCount = static_cast<uint32_t>(instances.size());
+
+			UpdateNodeBounds(instances, 0);
+			SubDivide(instances, 0, 0);
+		}
+
+	private:
+		static constexpr uint32_t m_MaxLeafSize{ 2 };
+
+		void UpdateNodeBounds(const std::vector<MeshInstance>& instances, uint32_t nodeIdx)
+		{
+			BVHNode& node{ nodes[nodeIdx] };
+			node.aabbMin = { 1e30f, 1e30f, 1e30f };
+			node.aabbMax = { -1e30f, -1e30f, -1e30f };
+
+			for (uint32_t i{ 0 }; i < node.triangleCount; ++i)
+			{
+				MeshInstance const& instance{ instances[instanceIndices[node.leftFirst + i]] };
+				node.aabbMin = Vector3::Min(node.aabbMin, instance.minAABB);
+				node.aabbMax = Vector3::Max(node.aabbMax, instance.maxAABB);
+			}
+		}
+
+		void SubDivide(const std::vector<MeshInstance>& instances, uint32_t nodeIdx, uint32_t depth)
+		{
+			BVHNode const& node{ nodes[nodeIdx] };
+			if (node.triangleCount <= m_MaxLeafSize || depth >= BVHNode::maxDepth)
+			{
+				return;
+			}
+
+			//Split the centroid bounds at the middle of their longest axis
+			AABB centroidBounds{};
+			for (uint32_t i{ 0 }; i < node.triangleCount; ++i)
+			{
+				MeshInstance const& instance{ instances[instanceIndices[node.leftFirst + i]] };
+				centroidBounds.Grow((instance.minAABB + instance.maxAABB) * .5f);
+			}
+
+			Vector3 const extent{ centroidBounds.max - centroidBounds.min };
+			int axis{ 0 };
+			if (extent.y > extent.x)
+			{
+				axis = 1;
+			}
+			if (extent.z > extent[axis])
+			{
+				axis = 2;
+			}
+
+			float const splitPos{ centroidBounds.min[axis] + extent[axis] * .5f };
+
+			auto const first{ instanceIndices.begin() + node.leftFirst };
+			auto const middle{ std::partition(first, first + node.triangleCount, [&](uint32_t instanceIdx)
+				{
+					MeshInstance const& instance{ instances[instanceIdx] };
+					return (instance.minAABB[axis] + instance.maxAABB[axis]) * .5f < splitPos;
+				}) };
+
+			uint32_t leftCount{ static_cast<uint32_t>(middle - first) };
+
+			//All centroids coincide, split the range in half instead
+			if (leftCount == 0 || leftCount == node.triangleCount)
+			{
+				leftCount = node.triangleCount / 2;
+			}
+
+			uint32_t const leftFirst{ node.leftFirst };
+			uint32_t const count{ node.triangleCount };
+
+			uint32_t const leftChildIdx{ static_cast<uint32_t>(nodes.size()) };
+			nodes.emplace_back(BVHNode{});
+			nodes.emplace_back(BVHNode{});
+
+			nodes[leftChildIdx].leftFirst = leftFirst;
+			nodes[leftChildIdx].triangleCount = leftCount;
+			nodes[leftChildIdx + 1].leftFirst = leftFirst + leftCount;
+			nodes[leftChildIdx + 1].triangleCount = count - leftCount;
+
+			nodes[nodeIdx].leftFirst = leftChildIdx;
+			nodes[nodeIdx].triangleCount = 0;
+
+			UpdateNodeBounds(instances, leftChildIdx);
+			UpdateNodeBounds(instances, leftChildIdx + 1);
+
+			SubDivide(instances, leftChildIdx, depth + 1);
+			SubDivide(instances, leftChildIdx + 1, depth + 1);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,147 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace dae;
+
+TileScheduler::TileScheduler(uint32_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	m_pQueues = std::make_unique<WorkQueue[]>(threadCount);
+
+	//Queue 0 belongs to the thread that calls Run
+	m_Workers.reserve(threadCount - 1);
+	for (uint32_t i{ 1 }; i < threadCount; ++i)
+	{
+		m_Workers.emplace_back(&TileScheduler::WorkerLoop, this, i);
+	}
+}
+
+TileScheduler::~TileScheduler()
+{
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_Stop = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (auto& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void TileScheduler::Run(uint32_t taskCount, const std::function<void(uint32_t)>& task)
+{
+	m_TaskTimes.assign(taskCount, 0.f);
+	if (taskCount == 0)
+	{
+		return;
+	}
+
+	//Hand out contiguous ranges so neighbouring tiles end up on the same thread
+	uint32_t const threadCount{ GetThreadCount() };
+	for (uint32_t i{ 0 }; i < threadCount; ++i)
+	{
+		uint32_t const first{ static_cast<uint32_t>(uint64_t{ taskCount } * i / threadCount) };
+		uint32_t const last{ static_cast<uint32_t>(uint64_t{ taskCount } * (i + 1) / threadCount) };
+
+		std::lock_guard lock{ m_pQueues[i].mutex };
+		for (uint32_t t{ first }; t < last; ++t)
+		{
+			m_pQueues[i].tasks.push_back(t);
+		}
+	}
+
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_pTask = &task;
+		m_ActiveWorkers = static_cast<uint32_t>(m_Workers.size());
+		++m_Generation;
+	}
+	m_WakeCondition.notify_all();
+
+	ExecuteTasks(0);
+
+	//Workers only finish once every queue is empty, so waiting for them waits for all tasks
+	std::unique_lock lock{ m_Mutex };
+	m_DoneCondition.wait(lock, [this]() { return m_ActiveWorkers == 0; });
+	m_pTask = nullptr;
+}
+
+void TileScheduler::WorkerLoop(uint32_t queueIdx)
+{
+	uint64_t generation{ 0 };
+	while (true)
+	{
+		{
+			std::unique_lock lock{ m_Mutex };
+			m_WakeCondition.wait(lock, [&]() { return m_Stop || m_Generation != generation; });
+
+			if (m_Stop)
+			{
+				return;
+			}
+
+			generation = m_Generation;
+		}
+
+		ExecuteTasks(queueIdx);
+
+		std::lock_guard lock{ m_Mutex };
+		if (--m_ActiveWorkers == 0)
+		{
+			m_DoneCondition.notify_one();
+		}
+	}
+}
+
+void TileScheduler::ExecuteTasks(uint32_t queueIdx)
+{
+	using Clock = std::chrono::steady_clock;
+
+	uint32_t task{};
+	while (PopTask(queueIdx, task))
+	{
+		auto const start{ Clock::now() };
+		(*m_pTask)(task);
+
+		//Every task index is popped exactly once, so no other thread writes this slot
+		m_TaskTimes[task] = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+	}
+}
+
+bool TileScheduler::PopTask(uint32_t queueIdx, uint32_t& task)
+{
+	{
+		WorkQueue& own{ m_pQueues[queueIdx] };
+		std::lock_guard lock{ own.mutex };
+		if (!own.tasks.empty())
+		{
+			task = own.tasks.front();
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+
+	//Steal from the back, the tiles furthest away from what the victim is working on
+	uint32_t const threadCount{ GetThreadCount() };
+	for (uint32_t i{ 1 }; i < threadCount; ++i)
+	{
+		WorkQueue& victim{ m_pQueues[(queueIdx + i) % threadCount] };
+		std::lock_guard lock{ victim.mutex };
+		if (!victim.tasks.empty())
+		{
+			task = victim.tasks.back();
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+//Standard includes
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	//Persistent thread pool that runs a batch of indexed tasks (render tiles) with work stealing
+	//Every worker starts with a contiguous range of tasks, once that runs dry it steals from the back of the other queues
+	class TileScheduler final
+	{
+	public:
+		//threadCount 0 uses every hardware thread, the calling thread counts as one of them
+		explicit TileScheduler(uint32_t threadCount = 0);
+		~TileScheduler();
+
+		TileScheduler(const TileScheduler&) = delete;
+		TileScheduler(TileScheduler&&) noexcept = delete;
+		TileScheduler& operator=(const TileScheduler&) = delete;
+		TileScheduler& operator=(TileScheduler&&) noexcept = delete;
+
+		//Calls task(i) once for every i in [0, taskCount) and blocks until all of them are done
+		void Run(uint32_t taskCount, const std::function<void(uint32_t)>& task);
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
+
+		//Duration in milliseconds of every task of the last Run
+		std::vector<float> const& GetTaskTimes() const { return m_TaskTimes; }
+
+	private:
+		struct alignas(64) WorkQueue final
+		{
+			std::mutex mutex{};
+			std::deque<uint32_t> tasks{};
+		};
+
+		std::vector<std::thread> m_Workers{};
+		std::unique_ptr<WorkQueue[]> m_pQueues{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+		uint64_t m_Generation{ 0 };
+		uint32_t m_ActiveWorkers{ 0 };
+		bool m_Stop{ false };
+
+		std::function<void(uint32_t)> const* m_pTask{};
+		std::vector<float> m_TaskTimes{};
+
+		void WorkerLoop(uint32_t queueIdx);
+		void ExecuteTasks(uint32_t queueIdx);
+		bool PopTask(uint32_t queueIdx, uint32_t& task);
+	};
+}
@@ -5,41 +5,98 @@
 #include "Maths.h"
 #include "Matrix.h"
 #include "DataTypes.h"
+#include "TLAS.h"
+#include "MappedFile.h"
 
-#include <random>
+#include <charconv>
+#include <cstring>
 #include <limits>
+#include <type_traits>
 
 //#include "SDL_egl.h"
 
 
 namespace dae
 {
-	template<typename T>
-	constexpr T Random(T min, T max) noexcept
-		requires (std::is_floating_point_v<T> || std::is_integral_v<T>)
+	//PCG32 (pcg-random.org), 16 bytes of state and a handful of instructions per draw
+	//Seed it from the pixel and sample index so a sample comes out the same whichever thread traces it
+	struct PCG32 final
 	{
-		if constexpr (std::is_floating_point_v<T>)
+		uint64_t state{ 0 };
+		uint64_t increment{ 1 };
+
+		constexpr PCG32() = default;
+		constexpr explicit PCG32(uint64_t seed, uint64_t sequence = 0) noexcept
 		{
-			thread_local std::uniform_real_distribution<T> distribution(min, max);
-			thread_local std::mt19937 generator;
+			increment = (sequence << 1) | 1;
+			NextUInt();
+			state += seed;
+			NextUInt();
+		}
 
-			return distribution(generator);
+		//Seeds independent generators for every pixel and sample, renderSeed changes the whole image
+		static constexpr PCG32 ForSample(uint32_t pixelIdx, uint32_t sampleIdx, uint32_t renderSeed = 0) noexcept
+		{
+			return PCG32{ SplitMix64((static_cast<uint64_t>(renderSeed) << 32) | sampleIdx), pixelIdx };
 		}
 
-		else if constexpr (std::is_integral_v<T>)
+		constexpr uint32_t NextUInt() noexcept
 		{
-			thread_local std::uniform_int_distribution<T> distribution(min, max);
-			thread_local std::mt19937 generator;
-			return distribution(generator);
+			uint64_t const oldState{ state };
+			state = oldState * 6364136223846793005ull + increment;
+
+			uint32_t const xorShifted{ static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u) };
+			uint32_t const rotation{ static_cast<uint32_t>(oldState >> 59u) };
+			return (xorShifted >> rotation) | (xorShifted << ((0u - rotation) & 31u));
 		}
 
-		return std::numeric_limits<T>::min();
-	}
+		//[0, 1)
+		constexpr float NextFloat() noexcept
+		{
+			return static_cast<float>(NextUInt() >> 8) * (1.f / 16777216.f);
+		}
+
+		//[min, max) for floating point, [min, max] for integers
+		template<typename T>
+		constexpr T Next(T min, T max) noexcept
+			requires (std::is_floating_point_v<T> || std::is_integral_v<T>)
+		{
+			if constexpr (std::is_floating_point_v<T>)
+			{
+				return min + static_cast<T>(NextFloat()) * (max - min);
+			}
+			else
+			{
+				uint64_t const range{ static_cast<uint64_t>(max) - static_cast<uint64_t>(min) + 1 };
+				return static_cast<T>(static_cast<uint64_t>(min) + ((static_cast<uint64_t>(NextUInt()) * range) >> 32));
+			}
+		}
+
+		static constexpr uint64_t SplitMix64(uint64_t x) noexcept
+		{
+			x += 0x9E3779B97F4A7C15ull;
+			x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+			x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+			return x ^ (x >> 31);
+		}
+	};
 
 	namespace GeometryUtils
 	{
 #pragma region Sphere HitTest
 		//SPHERE HIT-TESTS
+		//Hit record of a sphere hit at distance t, the block intersection loops only build it for the closest hit
+		inline void FillHitRecord(const Sphere& sphere, const Ray& ray, float t, HitRecord& hitRecord)
+		{
+			hitRecord.didHit = true;
+			hitRecord.materialIndex = sphere.materialIndex;
+			hitRecord.origin = ray.origin + t * ray.direction;
+
+			hitRecord.t = t;
+
+			hitRecord.normal = (hitRecord.origin - sphere.origin).Normalized();
+		}
+
 		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{			
 			auto const a{ Vector3::Dot(ray.direction, ray.direction) };
@@ -54,11 +111,12 @@ namespace dae
 				return false;
 			}
 
-			float t{ (-b - sqrt(d)) / 2 * a };
+			//std::sqrt keeps this in float everywhere, the unqualified call resolved to the double overload on GCC
+			float t{ (-b - std::sqrt(d)) / 2 * a };
 
 			if (t > ray.max || t < ray.min)
 			{
-				t = (-b + sqrt(d)) / 2 * a;
+				t = (-b + std::sqrt(d)) / 2 * a;
 			}
 
 			if (t > ray.max || t < ray.min)
@@ -72,14 +130,7 @@ namespace dae
 				return true;
 			}
 
-			hitRecord.didHit = true;
-			hitRecord.materialIndex = sphere.materialIndex;
-			hitRecord.origin = ray.origin + t * ray.direction;
-
-			hitRecord.t = t;
-
-			hitRecord.normal = (hitRecord.origin - sphere.origin).Normalized();
-
+			FillHitRecord(sphere, ray, t, hitRecord);
 			return true;
 		}
 
@@ -91,6 +142,18 @@ namespace dae
 #pragma endregion
 #pragma region Plane HitTest
 		//PLANE HIT-TESTS
+		inline void FillHitRecord(const Plane& plane, const Ray& ray, float t, HitRecord& hitRecord)
+		{
+			Vector3 const p{ ray.origin + ray.direction * t};
+
+			hitRecord.didHit = true;
+			hitRecord.materialIndex = plane.materialIndex;
+			hitRecord.origin = p;
+			
+			hitRecord.t = t;
+			hitRecord.normal = plane.normal;
+		}
+
 		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{	
 			float const t{ Vector3::Dot((plane.origin - ray.origin), plane.normal) / Vector3::Dot(ray.direction, plane.normal) };
@@ -105,15 +168,7 @@ namespace dae
 				return true;
 			}
 
-			Vector3 const p{ ray.origin + ray.direction * t};
-
-			hitRecord.didHit = true;
-			hitRecord.materialIndex = plane.materialIndex;
-			hitRecord.origin = p;
-			
-			hitRecord.t = t;
-			hitRecord.normal = plane.normal;
-
+			FillHitRecord(plane, ray, t, hitRecord);
 			return true;
 		}
 
@@ -226,8 +281,91 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_Triangle(triangle, ray, temp, true);
 		}
+
+		//Moller-Trumbore on precomputed edges, writes the distance and the barycentrics of v1 (u) and v2 (v)
+		//Culling follows HitTest_Triangle, invertCulling flips it for shadow rays that leave the surface
+		inline bool HitTest_Triangle(const TriangleIntersectionData& triangle, const Ray& ray, float& t, float& u, float& v, bool invertCulling = false)
+		{
+			float const dotProd{ Vector3::Dot(triangle.normal, ray.direction) };
+
+			switch (triangle.cullMode)
+			{
+			case TriangleCullMode::BackFaceCulling:
+				if (invertCulling ? dotProd < 0.f : dotProd > 0.f)
+				{
+					return false;
+				}
+				break;
+			case TriangleCullMode::FrontFaceCulling:
+				if (invertCulling ? dotProd > 0.f : dotProd < 0.f)
+				{
+					return false;
+				}
+				break;
+			case TriangleCullMode::NoCulling:
+			default:
+				break;
+			}
+
+			Vector3 const pvec{ Vector3::Cross(ray.direction, triangle.edge2) };
+			float const det{ Vector3::Dot(triangle.edge1, pvec) };
+
+			//Ray parallel to the triangle
+			if (AreEqual(det, 0.f, 1e-12f))
+			{
+				return false;
+			}
+
+			float const invDet{ 1.f / det };
+
+			Vector3 const tvec{ ray.origin - triangle.v0 };
+			u = Vector3::Dot(tvec, pvec) * invDet;
+			if (u < 0.f || u > 1.f)
+			{
+				return false;
+			}
+
+			Vector3 const qvec{ Vector3::Cross(tvec, triangle.edge1) };
+			v = Vector3::Dot(ray.direction, qvec) * invDet;
+			if (v < 0.f || u + v > 1.f)
+			{
+				return false;
+			}
+
+			t = Vector3::Dot(triangle.edge2, qvec) * invDet;
+			return t >= ray.min && t <= ray.max;
+		}
+
+		inline void FillHitRecord(const TriangleIntersectionData& triangle, const Ray& ray, float t, HitRecord& hitRecord)
+		{
+			hitRecord.origin = ray.origin + ray.direction * t;
+			hitRecord.normal = triangle.normal;
+			hitRecord.t = t;
+			hitRecord.didHit = true;
+			hitRecord.materialIndex = triangle.materialIndex;
+		}
+
+		inline bool HitTest_Triangle(const TriangleIntersectionData& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			float t{};
+			float u{};
+			float v{};
+			if (!HitTest_Triangle(triangle, ray, t, u, v, ignoreHitRecord))
+			{
+				return false;
+			}
+
+			FillHitRecord(triangle, ray, t, hitRecord);
+			return true;
+		}
 #pragma endregion
 #pragma region TriangeMesh HitTest
+		//Surface of the closest hit found in mesh, ray is the ray the triangle was hit with
+		inline void FillHitRecord(const TriangleMesh& mesh, const Ray& ray, const TriangleHit& hit, HitRecord& hitRecord)
+		{
+			FillHitRecord(mesh.triangles[hit.triangleIdx], ray, hit.t, hitRecord);
+		}
+
 		inline bool SlabTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
 		{
 			float const tx1{ (mesh.transformedMinAABB.x - ray.origin.x) / ray.direction.x };
@@ -251,45 +389,39 @@ namespace dae
 			return tmax > 0 && tmax >= tmin;
 		}
 
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		inline bool HitTest_TriangleRange(const TriangleMesh& mesh, uint32_t first, uint32_t count, Ray& closestRay, TriangleHit& closestHit, bool anyHit);
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, TriangleHit& hit, bool anyHit = false)
 		{
 			if (!SlabTest_TriangleMesh(mesh, ray))
 			{
 				return false;
 			}
 
-			HitRecord closestHitRecord{ };
+			Ray closestRay{ ray };
+			TriangleHit closestHit{ };
 
-			for (uint32_t i{ 0 }; i < mesh.indices.size(); i += 3) //Every 3 indices == a triangle
-			{
-				Triangle t{ mesh.transformedPositions[mesh.indices[i]],
-							mesh.transformedPositions[mesh.indices[i+1]],
-							mesh.transformedPositions[mesh.indices[i+2]],
-							mesh.transformedNormals[i/3]
-						 };
+			HitTest_TriangleRange(mesh, 0, static_cast<uint32_t>(mesh.triangles.size()), closestRay, closestHit, anyHit);
 
+			hit = closestHit;
+			return closestHit.DidHit();
+		}
 
-				t.cullMode = mesh.cullMode;
-				t.materialIndex = mesh.materialIndex;
-
-				HitRecord temp{  };
-				if (HitTest_Triangle(t, ray, temp, ignoreHitRecord))
-				{
-					if (temp.t < closestHitRecord.t)
-					{
-						closestHitRecord = temp;
-					}
-				}
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord)
+		{
+			TriangleHit hit{ };
+			if (!HitTest_TriangleMesh(mesh, ray, hit))
+			{
+				return false;
 			}
 
-			hitRecord = closestHitRecord;
-
-			return closestHitRecord.didHit;
+			FillHitRecord(mesh, ray, hit, hitRecord);
+			return true;
 		}
 
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
 		{
-			HitRecord temp{};
+			TriangleHit temp{};
 			return HitTest_TriangleMesh(mesh, ray, temp, true);
 		}
 #pragma endregion
@@ -318,66 +450,439 @@ namespace dae
 			return tmax >= tmin && tmin < ray.max && tmax > 0;
 		}
 
-		inline bool HitTest_BVH(const Ray& ray, const TriangleMesh& mesh, const std::vector<BVHNode>& bvh, uint32_t nodeIdx, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Returns the entry distance of the ray into the box, FLT_MAX on a miss or when the box lies beyond ray.max
+		inline float IntersectAABB_Distance(const Ray& ray, const Vector3& rayInvDir, const Vector3& bmin, const Vector3& bmax)
+		{
+			float const tx1{ (bmin.x - ray.origin.x) * rayInvDir.x };
+			float const tx2{ (bmax.x - ray.origin.x) * rayInvDir.x };
+
+			float tmin{ std::min(tx1, tx2) };
+			float tmax{ std::max(tx1, tx2) };
+
+			float const ty1{ (bmin.y - ray.origin.y) * rayInvDir.y };
+			float const ty2{ (bmax.y - ray.origin.y) * rayInvDir.y };
+
+			tmin = std::max(tmin, std::min(ty1, ty2));
+			tmax = std::min(tmax, std::max(ty1, ty2));
+
+			float const tz1{ (bmin.z - ray.origin.z) * rayInvDir.z };
+			float const tz2{ (bmax.z - ray.origin.z) * rayInvDir.z };
+
+			tmin = std::max(tmin, std::min(tz1, tz2));
+			tmax = std::min(tmax, std::max(tz1, tz2));
+
+			if (tmax >= tmin && tmin < ray.max && tmax > ray.min)
+			{
+				return tmin;
+			}
+
+			return FLT_MAX;
+		}
+
+		//Tests the triangles [first, first + count) of a BVH leaf, shrinking closestRay.max on every closer hit
+		//Only the distance, barycentrics and triangle index are kept; returns true when anyHit is set and any triangle was hit
+		inline bool HitTest_TriangleRange(const TriangleMesh& mesh, uint32_t first, uint32_t count, Ray& closestRay, TriangleHit& closestHit, bool anyHit)
+		{
+			for (uint32_t i{ first }; i < first + count; ++i)
+			{
+				float t{};
+				float u{};
+				float v{};
+				if (!HitTest_Triangle(mesh.triangles[i], closestRay, t, u, v, anyHit))
+				{
+					continue;
+				}
+
+				if (anyHit)
+				{
+					closestHit = { t, u, v, i };
+					return true;
+				}
+
+				if (t < closestHit.t)
+				{
+					closestHit = { t, u, v, i };
+					closestRay.max = t;
+				}
+			}
+
+			return false;
+		}
+
+		//Iterative traversal, nearest child first; nodes that start beyond the closest hit so far are skipped
+		//anyHit (shadow rays) returns on the first hit found
+		inline bool HitTest_BVH(const Ray& ray, const TriangleMesh& mesh, const std::vector<BVHNode>& bvh, uint32_t nodeIdx, TriangleHit& hit, bool anyHit = false)
 		{
-			const BVHNode& node{ bvh[nodeIdx] };
-			if (!IntersectAABB(ray, node.aabbMin, node.aabbMax)) 
+			struct StackEntry final
+			{
+				uint32_t nodeIdx;
+				float tEntry;
+			};
+
+			//One far child is pushed per level on the way down
+			static constexpr uint32_t maxStackSize{ BVHNode::maxDepth };
+			StackEntry stack[maxStackSize];
+			uint32_t stackSize{ 0 };
+
+			Vector3 const rayInvDir{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			//The max distance shrinks every time a closer triangle is found
+			Ray closestRay{ ray };
+			TriangleHit closestHit{ };
+
+			if (IntersectAABB_Distance(closestRay, rayInvDir, bvh[nodeIdx].aabbMin, bvh[nodeIdx].aabbMax) == FLT_MAX)
+			{
 				return false;
+			}
 
-			if (node.IsLeaf())
+			while (true)
 			{
-				HitRecord closestHitRecord{ };
+				const BVHNode& node{ bvh[nodeIdx] };
 
-				for (uint32_t i{ 0 }; i < node.triangleCount; ++i)
+				if (node.IsLeaf())
 				{
-					Triangle t{ mesh.transformedPositions[mesh.indices[(node.leftFirst + i) * 3]],
-								mesh.transformedPositions[mesh.indices[((node.leftFirst + i) *3) + 1]],
-								mesh.transformedPositions[mesh.indices[((node.leftFirst + i) *3) + 2]],
-								mesh.transformedNormals[(node.leftFirst + i)]
-					};
+					if (HitTest_TriangleRange(mesh, node.leftFirst, node.triangleCount, closestRay, closestHit, anyHit))
+					{
+						hit = closestHit;
+						return true;
+					}
+				}
+				else
+				{
+					uint32_t nearIdx{ node.leftFirst };
+					uint32_t farIdx{ node.leftFirst + 1 };
 
+					float nearDist{ IntersectAABB_Distance(closestRay, rayInvDir, bvh[nearIdx].aabbMin, bvh[nearIdx].aabbMax) };
+					float farDist{ IntersectAABB_Distance(closestRay, rayInvDir, bvh[farIdx].aabbMin, bvh[farIdx].aabbMax) };
 
-					t.cullMode = mesh.cullMode;
-					t.materialIndex = mesh.materialIndex;
+					if (nearDist > farDist)
+					{
+						std::swap(nearIdx, farIdx);
+						std::swap(nearDist, farDist);
+					}
 
-					HitRecord temp{  };
-					if (HitTest_Triangle(t, ray, temp, ignoreHitRecord))
+					if (nearDist != FLT_MAX)
 					{
-						if (temp.t < closestHitRecord.t)
+						if (farDist != FLT_MAX)
 						{
-							closestHitRecord = temp;
+							assert(stackSize < maxStackSize && "BVH is deeper than the traversal stack");
+							stack[stackSize++] = { farIdx, farDist };
 						}
+
+						nodeIdx = nearIdx;
+						continue;
 					}
 				}
 
-				hitRecord = closestHitRecord;
-				return closestHitRecord.didHit;
-			}
+				//Pop the next node that can still contain a closer hit
+				bool foundNode{ false };
+				while (stackSize > 0)
+				{
+					StackEntry const entry{ stack[--stackSize] };
+					if (entry.tEntry < closestRay.max)
+					{
+						nodeIdx = entry.nodeIdx;
+						foundNode = true;
+						break;
+					}
+				}
 
-			if (HitTest_BVH(ray, mesh, bvh, node.leftFirst, hitRecord, ignoreHitRecord))
-			{
-				return true;
+				if (!foundNode)
+				{
+					break;
+				}
 			}
-			if (HitTest_BVH(ray, mesh, bvh, node.leftFirst + 1, hitRecord, ignoreHitRecord))
+
+			hit = closestHit;
+			return closestHit.DidHit();
+		}
+
+		inline bool HitTest_BVH(const Ray& ray, const TriangleMesh& mesh, const std::vector<BVHNode>& bvh, uint32_t nodeIdx, HitRecord& hitRecord)
+		{
+			TriangleHit hit{ };
+			if (!HitTest_BVH(ray, mesh, bvh, nodeIdx, hit))
 			{
-				return true;
+				return false;
 			}
 
-			return false;
+			FillHitRecord(mesh, ray, hit, hitRecord);
+			return true;
 		}
 
 		inline bool HitTest_BVH(const Ray& ray, const TriangleMesh& mesh, const std::vector<BVHNode>& bvh, uint32_t nodeIdx)
 		{
-			HitRecord temp{  };
+			TriangleHit temp{  };
 			return HitTest_BVH(ray, mesh, bvh, nodeIdx, temp, true);
 		}
-#pragma endregion
 
-		[[nodiscard]] inline Vector3 GetRandomTriangleSample(const Vector3& A, const Vector3& B, const Vector3& C) noexcept
+		//Traversal of a collapsed BVH; all child boxes of a node are tested at once and the hit ones are visited nearest first
+		template<typename WideNode>
+		inline bool HitTest_WideBVH(const Ray& ray, const TriangleMesh& mesh, const std::vector<WideNode>& bvh, TriangleHit& hit, bool anyHit = false)
+		{
+			static constexpr uint32_t Width{ WideNode::width };
+
+			struct StackEntry final
+			{
+				uint32_t idx; //node index, or first triangle when count > 0
+				uint32_t count;
+				float tEntry;
+			};
+
+			//Every level on the way down leaves at most Width - 1 siblings behind, the last one pushes all Width
+			static constexpr uint32_t maxStackSize{ (Width - 1) * WideNode::maxDepth + 1 };
+			StackEntry stack[maxStackSize];
+			uint32_t stackSize{ 0 };
+
+			Vector3 const rayInvDir{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			Ray closestRay{ ray };
+			TriangleHit closestHit{ };
+
+			stack[stackSize++] = { 0, 0, ray.min };
+
+			while (stackSize > 0)
+			{
+				StackEntry const entry{ stack[--stackSize] };
+				if (entry.tEntry >= closestRay.max)
+				{
+					continue;
+				}
+
+				if (entry.count > 0)
+				{
+					if (HitTest_TriangleRange(mesh, entry.idx, entry.count, closestRay, closestHit, anyHit))
+					{
+						hit = closestHit;
+						return true;
+					}
+					continue;
+				}
+
+				WideNode const& node{ bvh[entry.idx] };
+
+				alignas(Width * sizeof(float)) float tEntry[Width];
+				uint32_t mask{ node.Intersect(closestRay.origin, rayInvDir, closestRay.min, closestRay.max, tEntry) };
+
+				//Sort the hit children far to near, so the nearest one ends up on top of the stack
+				uint32_t order[Width];
+				uint32_t hitCount{ 0 };
+				while (mask)
+				{
+					uint32_t slot{ 0 };
+					while (!(mask & (1u << slot)))
+					{
+						++slot;
+					}
+					mask &= mask - 1;
+
+					uint32_t j{ hitCount++ };
+					while (j > 0 && tEntry[order[j - 1]] < tEntry[slot])
+					{
+						order[j] = order[j - 1];
+						--j;
+					}
+					order[j] = slot;
+				}
+
+				assert(stackSize + hitCount <= maxStackSize && "BVH is deeper than the traversal stack");
+				for (uint32_t i{ 0 }; i < hitCount; ++i)
+				{
+					uint32_t const slot{ order[i] };
+					stack[stackSize++] = { node.child[slot], node.triangleCount[slot], tEntry[slot] };
+				}
+			}
+
+			hit = closestHit;
+			return closestHit.DidHit();
+		}
+
+		//Traces the mesh through whichever BVH layout it was built with
+		inline bool HitTest_MeshBVH(const Ray& ray, const TriangleMesh& mesh, TriangleHit& hit, bool anyHit = false)
+		{
+			switch (mesh.bvhSettings.layout)
+			{
+			case BVHLayout::Wide4:
+				return HitTest_WideBVH(ray, mesh, mesh.bvh4, hit, anyHit);
+			case BVHLayout::Wide8:
+				return HitTest_WideBVH(ray, mesh, mesh.bvh8, hit, anyHit);
+			case BVHLayout::Quantized4:
+				return HitTest_WideBVH(ray, mesh, mesh.bvhQuantized4, hit, anyHit);
+			case BVHLayout::Binary:
+			default:
+				return HitTest_BVH(ray, mesh, mesh.bvh, 0, hit, anyHit);
+			}
+		}
+
+		inline bool HitTest_MeshBVH(const Ray& ray, const TriangleMesh& mesh, HitRecord& hitRecord)
+		{
+			TriangleHit hit{ };
+			if (!HitTest_MeshBVH(ray, mesh, hit))
+			{
+				return false;
+			}
+
+			FillHitRecord(mesh, ray, hit, hitRecord);
+			return true;
+		}
+
+		inline bool HitTest_MeshBVH(const Ray& ray, const TriangleMesh& mesh)
+		{
+			TriangleHit temp{ };
+			return HitTest_MeshBVH(ray, mesh, temp, true);
+		}
+
+		//Tests one instance by moving the ray into the object space of its shared mesh
+		//The direction is not renormalized, so t is the same in both spaces
+		inline bool HitTest_MeshInstance(const Ray& ray, const MeshInstance& instance, const TriangleMesh& mesh, TriangleHit& hit, bool anyHit = false)
 		{
-			float u{ Random(0.f, 1.f) };
-			float v{ Random(0.f, 1.f) };
+			Ray localRay{ ray };
+			localRay.origin = instance.worldToObject.TransformPoint(ray.origin);
+			localRay.direction = instance.worldToObject.TransformVector(ray.direction);
+
+			return HitTest_MeshBVH(localRay, mesh, hit, anyHit);
+		}
+
+		//Surface of an instance hit in world space, the object space normal is only transformed for this one hit
+		inline void FillHitRecord(const MeshInstance& instance, const TriangleMesh& mesh, const Ray& ray, const TriangleHit& hit, HitRecord& hitRecord)
+		{
+			hitRecord.origin = ray.origin + ray.direction * hit.t;
+			hitRecord.normal = instance.normalToWorld.TransformVector(mesh.triangles[hit.triangleIdx].normal).Normalized();
+			hitRecord.t = hit.t;
+			hitRecord.didHit = true;
+			hitRecord.materialIndex = instance.materialIndex;
+		}
+
+		//Same traversal as HitTest_BVH, but the leaves hold instances that each have their own bottom level BVH
+		//hit.instanceIdx tells which instance the triangle belongs to
+		inline bool HitTest_TLAS(const Ray& ray, const TLAS& tlas, const std::vector<MeshInstance>& instances, const std::vector<TriangleMesh>& meshes, TriangleHit& hit, bool anyHit = false)
+		{
+			if (tlas.nodes.empty())
+			{
+				return false;
+			}
+
+			struct StackEntry final
+			{
+				uint32_t nodeIdx;
+				float tEntry;
+			};
 
+			static constexpr uint32_t maxStackSize{ BVHNode::maxDepth };
+			StackEntry stack[maxStackSize];
+			uint32_t stackSize{ 0 };
+
+			Vector3 const rayInvDir{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			Ray closestRay{ ray };
+			TriangleHit closestHit{ };
+
+			uint32_t nodeIdx{ 0 };
+			if (IntersectAABB_Distance(closestRay, rayInvDir, tlas.nodes[0].aabbMin, tlas.nodes[0].aabbMax) == FLT_MAX)
+			{
+				return false;
+			}
+
+			while (true)
+			{
+				const BVHNode& node{ tlas.nodes[nodeIdx] };
+
+				if (node.IsLeaf())
+				{
+					for (uint32_t i{ 0 }; i < node.triangleCount; ++i)
+					{
+						uint32_t const instanceIdx{ tlas.instanceIndices[node.leftFirst + i] };
+						MeshInstance const& instance{ instances[instanceIdx] };
+
+						TriangleHit temp{ };
+						if (HitTest_MeshInstance(closestRay, instance, meshes[instance.meshIndex], temp, anyHit))
+						{
+							temp.instanceIdx = instanceIdx;
+							if (anyHit)
+							{
+								hit = temp;
+								return true;
+							}
+
+							if (temp.t < closestHit.t)
+							{
+								closestHit = temp;
+								closestRay.max = temp.t;
+							}
+						}
+					}
+				}
+				else
+				{
+					uint32_t nearIdx{ node.leftFirst };
+					uint32_t farIdx{ node.leftFirst + 1 };
+
+					float nearDist{ IntersectAABB_Distance(closestRay, rayInvDir, tlas.nodes[nearIdx].aabbMin, tlas.nodes[nearIdx].aabbMax) };
+					float farDist{ IntersectAABB_Distance(closestRay, rayInvDir, tlas.nodes[farIdx].aabbMin, tlas.nodes[farIdx].aabbMax) };
+
+					if (nearDist > farDist)
+					{
+						std::swap(nearIdx, farIdx);
+						std::swap(nearDist, farDist);
+					}
+
+					if (nearDist != FLT_MAX)
+					{
+						if (farDist != FLT_MAX)
+						{
+							assert(stackSize < maxStackSize && "TLAS is deeper than the traversal stack");
+							stack[stackSize++] = { farIdx, farDist };
+						}
+
+						nodeIdx = nearIdx;
+						continue;
+					}
+				}
+
+				bool foundNode{ false };
+				while (stackSize > 0)
+				{
+					StackEntry const entry{ stack[--stackSize] };
+					if (entry.tEntry < closestRay.max)
+					{
+						nodeIdx = entry.nodeIdx;
+						foundNode = true;
+						break;
+					}
+				}
+
+				if (!foundNode)
+				{
+					break;
+				}
+			}
+
+			hit = closestHit;
+			return closestHit.DidHit();
+		}
+
+		inline bool HitTest_TLAS(const Ray& ray, const TLAS& tlas, const std::vector<MeshInstance>& instances, const std::vector<TriangleMesh>& meshes, HitRecord& hitRecord)
+		{
+			TriangleHit hit{ };
+			if (!HitTest_TLAS(ray, tlas, instances, meshes, hit))
+			{
+				return false;
+			}
+
+			MeshInstance const& instance{ instances[hit.instanceIdx] };
+			FillHitRecord(instance, meshes[instance.meshIndex], ray, hit, hitRecord);
+			return true;
+		}
+
+		inline bool HitTest_TLAS(const Ray& ray, const TLAS& tlas, const std::vector<MeshInstance>& instances, const std::vector<TriangleMesh>& meshes)
+		{
+			TriangleHit temp{ };
+			return HitTest_TLAS(ray, tlas, instances, meshes, temp, true);
+		}
+#pragma endregion
+
+		//Maps a point of the unit square onto the triangle, the half outside is mirrored back in
+		[[nodiscard]] inline Vector3 GetTriangleSample(const Vector3& A, const Vector3& B, const Vector3& C, float u, float v) noexcept
+		{
 			if (u + v > 1.0f)
 			{
 				u = 1.0f - u;
@@ -387,6 +892,14 @@ namespace dae
 			return (1 - u - v) * A + u * B + v * C;
 		}
 
+		[[nodiscard]] inline Vector3 GetRandomTriangleSample(const Vector3& A, const Vector3& B, const Vector3& C, PCG32& rng) noexcept
+		{
+			float const u{ rng.NextFloat() };
+			float const v{ rng.NextFloat() };
+
+			return GetTriangleSample(A, B, C, u, v);
+		}
+
 		[[nodiscard]] inline Vector3 GetUniformTriangleSample(const Vector3& A, const Vector3& B, const Vector3& C, uint32_t totSamples, uint32_t sample) noexcept
 		{
 			// Calculate the row and column for the grid in a square
@@ -408,76 +921,415 @@ namespace dae
 
 	namespace Utils
 	{
-		//Just parses vertices and indices
-#pragma warning(push)
-#pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+#pragma region OBJ
+		//Hand written parsing for ParseOBJ, it works on the mapped file so nothing goes through a stream or the locale
+		//Every parse function returns the position right after what it consumed, nullptr when there was nothing valid to parse
+		namespace OBJ
 		{
-			std::ifstream file(filename);
-			if (!file)
-				return false;
+			enum class LineType
+			{
+				Other,
+				Position, //v
+				Normal, //vn
+				UV, //vt
+				Face //f
+			};
+
+			//OBJ indices are 1 based, 0 means the corner did not reference that attribute
+			struct FaceCorner final
+			{
+				int64_t position{ 0 };
+				int64_t uv{ 0 };
+				int64_t normal{ 0 };
+			};
+
+			inline bool IsBlank(char c)
+			{
+				return c == ' ' || c == '\t' || c == '\r';
+			}
+
+			inline bool IsDigit(char c)
+			{
+				return c >= '0' && c <= '9';
+			}
+
+			inline const char* SkipBlanks(const char* p, const char* pEnd)
+			{
+				while (p < pEnd && IsBlank(*p))
+				{
+					++p;
+				}
+				return p;
+			}
+
+			inline const char* NextLine(const char* p, const char* pEnd)
+			{
+				auto const pNewLine{ static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(pEnd - p))) };
+				return pNewLine ? pNewLine + 1 : pEnd;
+			}
+
+			//Reads the keyword at the start of a line and moves p past it
+			inline LineType ParseLineType(const char*& p, const char* pEnd)
+			{
+				p = SkipBlanks(p, pEnd);
+				const char* const pKeyword{ p };
+				while (p < pEnd && !IsBlank(*p) && *p != '\n')
+				{
+					++p;
+				}
 
-			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
+				switch (p - pKeyword)
+				{
+				case 1:
+					if (pKeyword[0] == 'v') return LineType::Position;
+					if (pKeyword[0] == 'f') return LineType::Face;
+					break;
+				case 2:
+					if (pKeyword[0] == 'v' && pKeyword[1] == 'n') return LineType::Normal;
+					if (pKeyword[0] == 'v' && pKeyword[1] == 't') return LineType::UV;
+					break;
+				}
+				return LineType::Other;
+			}
+
+			inline const char* ParseInt(const char* p, const char* pEnd, int64_t& value)
 			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
-				//use conditional statements to process the different commands	
-				if (sCommand == "#")
+				bool const isNegative{ p < pEnd && *p == '-' };
+				if (p < pEnd && (*p == '-' || *p == '+'))
 				{
-					// Ignore Comment
+					++p;
 				}
-				else if (sCommand == "v")
+				if (p == pEnd || !IsDigit(*p))
 				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
+					return nullptr;
 				}
-				else if (sCommand == "f")
+
+				//Saturates far above any valid index, the caller rejects it as out of range
+				int64_t result{ 0 };
+				for (; p < pEnd && IsDigit(*p); ++p)
 				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
+					result = std::min(result * 10 + (*p - '0'), int64_t{ 1 } << 40);
+				}
+				value = isNegative ? -result : result;
+				return p;
+			}
+
+			//Numbers with at most 24 bits of digits and a small power of ten are exact as a float, one multiply or divide rounds them correctly
+			//Everything else (long mantissas, big exponents, inf, nan) goes through std::from_chars, so the result always matches strtof
+			inline const char* ParseFloat(const char* p, const char* pEnd, float& value)
+			{
+				const char* const pStart{ p };
 
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
+				bool const isNegative{ p < pEnd && *p == '-' };
+				if (p < pEnd && (*p == '-' || *p == '+'))
+				{
+					++p;
 				}
-				//read till end of line and ignore all remaining chars
-				file.ignore(1000, '\n');
 
-				if (file.eof())
-					break;
+				uint64_t mantissa{ 0 };
+				int exponent{ 0 };
+				bool hasDigits{ false };
+				bool isExact{ true };
+				for (; p < pEnd && IsDigit(*p); ++p)
+				{
+					hasDigits = true;
+					if (mantissa > (uint64_t{ 1 } << 24))
+					{
+						isExact = false;
+						continue;
+					}
+					mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				}
+				if (p < pEnd && *p == '.')
+				{
+					for (++p; p < pEnd && IsDigit(*p); ++p)
+					{
+						hasDigits = true;
+						if (mantissa > (uint64_t{ 1 } << 24))
+						{
+							isExact = false;
+							continue;
+						}
+						mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+						--exponent;
+					}
+				}
+				if (hasDigits && p < pEnd && (*p == 'e' || *p == 'E'))
+				{
+					int64_t power{};
+					const char* const pPower{ ParseInt(p + 1, pEnd, power) };
+					if (!pPower)
+					{
+						isExact = false;
+					}
+					else
+					{
+						p = pPower;
+						exponent += static_cast<int>(std::clamp(power, int64_t{ -1000 }, int64_t{ 1000 }));
+					}
+				}
+
+				static constexpr float powersOf10[]{ 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+				if (hasDigits && isExact && mantissa <= (uint64_t{ 1 } << 24) && exponent >= -10 && exponent <= 10)
+				{
+					float const f{ exponent < 0 ? static_cast<float>(mantissa) / powersOf10[-exponent] : static_cast<float>(mantissa) * powersOf10[exponent] };
+					value = isNegative ? -f : f;
+					return p;
+				}
+
+				//from_chars does not take a leading '+'
+				const char* const pNumber{ (pStart < pEnd && *pStart == '+') ? pStart + 1 : pStart };
+				auto const result{ std::from_chars(pNumber, pEnd, value) };
+				return result.ec == std::errc{} ? result.ptr : nullptr;
 			}
 
-			//Precompute normals
-			for (uint64_t index = 0; index < indices.size(); index += 3)
+			//v, v/vt, v//vn or v/vt/vn
+			inline const char* ParseFaceCorner(const char* p, const char* pEnd, FaceCorner& corner)
 			{
-				uint32_t i0 = indices[index];
-				uint32_t i1 = indices[index + 1];
-				uint32_t i2 = indices[index + 2];
+				corner = {};
+				p = ParseInt(p, pEnd, corner.position);
+				if (!p || p == pEnd || *p != '/')
+				{
+					return p;
+				}
 
-				Vector3 edgeV0V1 = positions[i1] - positions[i0];
-				Vector3 edgeV0V2 = positions[i2] - positions[i0];
-				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
+				++p;
+				if (p < pEnd && *p != '/')
+				{
+					p = ParseInt(p, pEnd, corner.uv);
+					if (!p || p == pEnd || *p != '/')
+					{
+						return p;
+					}
+				}
+
+				return ParseInt(p + 1, pEnd, corner.normal);
+			}
 
-				if (std::isnan(normal.x))
+			//1 based index, or negative relative to the count read so far, to a 0 based one; -1 when it does not reference anything
+			inline int64_t ResolveIndex(int64_t index, size_t count)
+			{
+				if (index > 0)
+				{
+					return index - 1;
+				}
+				if (index < 0)
 				{
-					int k = 0;
+					return static_cast<int64_t>(count) + index;
 				}
+				return -1;
+			}
+		}
 
-				normal.Normalize();
-				if (std::isnan(normal.x))
+		//Loads an OBJ file into mesh, replacing its geometry; the caller still updates the transforms and builds the BVH
+		//Polygons are triangulated as a fan around their first corner and the face normals are computed from the positions
+		//vn and vt are only kept when the faces reference them, per index in vertexNormals and uvs
+		inline bool ParseOBJ(const std::string& filename, TriangleMesh& mesh)
+		{
+			MappedFile const file{ filename };
+			if (!file.IsOpen())
+				return false;
+
+			const char* const pBegin{ file.GetData() };
+			const char* const pEnd{ pBegin + file.GetSize() };
+
+			//Pre-scan, only looks at the line keywords so every array is allocated once
+			size_t positionCount{ 0 };
+			size_t normalCount{ 0 };
+			size_t uvCount{ 0 };
+			size_t faceCount{ 0 };
+			for (const char* p{ pBegin }; p < pEnd; p = OBJ::NextLine(p, pEnd))
+			{
+				switch (OBJ::ParseLineType(p, pEnd))
 				{
-					int k = 0;
+				case OBJ::LineType::Position: ++positionCount; break;
+				case OBJ::LineType::Normal: ++normalCount; break;
+				case OBJ::LineType::UV: ++uvCount; break;
+				case OBJ::LineType::Face: ++faceCount; break;
+				default: break;
 				}
+			}
+
+			//Indices are stored as int, a larger mesh can not be addressed
+			if (positionCount > static_cast<size_t>(std::numeric_limits<int>::max()))
+				return false;
 
-				normals.push_back(normal);
+			std::vector<Vector3> positions(positionCount);
+			std::vector<Vector3> normals(normalCount);
+			std::vector<Vector3> uvs(uvCount); //(u, v, w)
+			std::vector<int> indices{};
+			std::vector<int64_t> normalIndices{}; //per index, -1 when the corner has none
+			std::vector<int64_t> uvIndices{};
+			indices.reserve(faceCount * 3); //Exact for triangle meshes, polygons grow it
+			normalIndices.reserve(normalCount > 0 ? faceCount * 3 : 0);
+			uvIndices.reserve(uvCount > 0 ? faceCount * 3 : 0);
+
+			size_t positionIdx{ 0 };
+			size_t normalIdx{ 0 };
+			size_t uvIdx{ 0 };
+			std::vector<OBJ::FaceCorner> corners{};
+			bool hasCornerNormals{ false };
+			bool hasCornerUVs{ false };
+
+			auto const parseVector{ [pEnd](const char* p, Vector3& v, int minComponents)
+			{
+				float* const pComponents[]{ &v.x, &v.y, &v.z };
+				for (int i{ 0 }; i < 3; ++i)
+				{
+					p = OBJ::SkipBlanks(p, pEnd);
+					if (i >= minComponents && (p == pEnd || *p == '\n' || *p == '#'))
+						return true;
+
+					p = OBJ::ParseFloat(p, pEnd, *pComponents[i]);
+					if (!p)
+						return false;
+				}
+				return true;
+			} };
+
+			for (const char* p{ pBegin }; p < pEnd; p = OBJ::NextLine(p, pEnd))
+			{
+				switch (OBJ::ParseLineType(p, pEnd))
+				{
+				case OBJ::LineType::Position:
+					if (!parseVector(p, positions[positionIdx++], 3))
+						return false;
+					break;
+				case OBJ::LineType::Normal:
+					if (!parseVector(p, normals[normalIdx++], 3))
+						return false;
+					break;
+				case OBJ::LineType::UV:
+					if (!parseVector(p, uvs[uvIdx++], 1))
+						return false;
+					break;
+				case OBJ::LineType::Face:
+				{
+					corners.clear();
+					for (p = OBJ::SkipBlanks(p, pEnd); p < pEnd && *p != '\n' && *p != '#'; p = OBJ::SkipBlanks(p, pEnd))
+					{
+						OBJ::FaceCorner corner{};
+						p = OBJ::ParseFaceCorner(p, pEnd, corner);
+						if (!p)
+							return false;
+
+						//Negative indices are relative to what has been read up to this line
+						corner.position = OBJ::ResolveIndex(corner.position, positionIdx);
+						corner.normal = OBJ::ResolveIndex(corner.normal, normalIdx);
+						corner.uv = OBJ::ResolveIndex(corner.uv, uvIdx);
+
+						//The pre-scan already has the final counts, so forward references are range checked here as well
+						//-1 means the corner has no normal or uv; one in a file without vn or vt lines is out of range too
+						if (corner.position < 0 || corner.position >= static_cast<int64_t>(positionCount)
+							|| corner.normal < -1 || corner.normal >= static_cast<int64_t>(normalCount)
+							|| corner.uv < -1 || corner.uv >= static_cast<int64_t>(uvCount))
+							return false;
+
+						hasCornerNormals |= corner.normal >= 0;
+						hasCornerUVs |= corner.uv >= 0;
+						corners.emplace_back(corner);
+					}
+
+					if (corners.size() < 3)
+						return false;
+
+					for (size_t i{ 1 }; i + 1 < corners.size(); ++i)
+					{
+						for (auto const& corner : { corners[0], corners[i], corners[i + 1] })
+						{
+							indices.emplace_back(static_cast<int>(corner.position));
+							if (normalCount > 0)
+								normalIndices.emplace_back(corner.normal);
+							if (uvCount > 0)
+								uvIndices.emplace_back(corner.uv);
+						}
+					}
+					break;
+				}
+				default:
+					break;
+				}
+			}
+
+			mesh.vertexNormals.clear();
+			if (hasCornerNormals)
+			{
+				mesh.vertexNormals.resize(indices.size());
+				for (size_t i{ 0 }; i < indices.size(); ++i)
+				{
+					if (normalIndices[i] >= 0)
+						mesh.vertexNormals[i] = normals[normalIndices[i]];
+				}
+			}
+
+			mesh.uvs.clear();
+			if (hasCornerUVs)
+			{
+				mesh.uvs.resize(indices.size());
+				for (size_t i{ 0 }; i < indices.size(); ++i)
+				{
+					if (uvIndices[i] >= 0)
+						mesh.uvs[i] = uvs[uvIndices[i]];
+				}
 			}
 
+			mesh.positions = std::move(positions);
+			mesh.indices = std::move(indices);
+			mesh.CalculateNormals();
+
 			return true;
 		}
-#pragma warning(pop)
+#pragma endregion
+
+		//Writes a 24 bit BMP, pixels are 0xAARRGGBB and stored top row first
+		inline bool WriteBMP(const std::string& filename, const uint32_t* pPixels, int width, int height)
+		{
+			std::ofstream file(filename, std::ios::binary);
+			if (!file)
+				return false;
+
+			//Every row is padded to a multiple of 4 bytes
+			uint32_t const rowSize{ (static_cast<uint32_t>(width) * 3 + 3) & ~3u };
+			uint32_t const imageSize{ rowSize * static_cast<uint32_t>(height) };
+			uint32_t const headerSize{ 14 + 40 };
+
+			auto const write16{ [&file](uint16_t value) { file.put(static_cast<char>(value & 0xFF)).put(static_cast<char>(value >> 8)); } };
+			auto const write32{ [&](uint32_t value) { write16(static_cast<uint16_t>(value & 0xFFFF)); write16(static_cast<uint16_t>(value >> 16)); } };
+
+			//File header
+			file.put('B').put('M');
+			write32(headerSize + imageSize);
+			write32(0);
+			write32(headerSize);
+
+			//Info header
+			write32(40);
+			write32(static_cast<uint32_t>(width));
+			write32(static_cast<uint32_t>(height));
+			write16(1); //planes
+			write16(24); //bits per pixel
+			write32(0); //no compression
+			write32(imageSize);
+			write32(2835); //72 dpi
+			write32(2835);
+			write32(0);
+			write32(0);
+
+			//BMP rows are stored bottom up
+			std::vector<char> row(rowSize, 0);
+			for (int y{ height - 1 }; y >= 0; --y)
+			{
+				for (int x{ 0 }; x < width; ++x)
+				{
+					uint32_t const pixel{ pPixels[x + y * width] };
+					row[x * 3 + 0] = static_cast<char>(pixel & 0xFF);
+					row[x * 3 + 1] = static_cast<char>((pixel >> 8) & 0xFF);
+					row[x * 3 + 2] = static_cast<char>((pixel >> 16) & 0xFF);
+				}
+				file.write(row.data(), rowSize);
+			}
+
+			return static_cast<bool>(file);
+		}
 	}
 }
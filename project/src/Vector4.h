@@ -1,5 +1,11 @@
 #pragma once
 
+#include <cassert>
+#include <cmath>
+
+#include "MathHelpers.h"
+#include "MathSIMD.h"
+
 namespace dae
 {
 	struct Vector3;
@@ -11,7 +17,7 @@ namespace dae
 		float w;
 
 		Vector4() = default;
-		Vector4(float _x, float _y, float _z, float _w);
+		constexpr Vector4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
 		Vector4(const Vector3& v, float _w);
 
 		float Magnitude() const;
@@ -29,5 +35,115 @@ namespace dae
 		float& operator[](int index);
 		float operator[](int index) const;
 		bool operator==(const Vector4& v) const;
+
+#if defined(DAE_MATH_SSE)
+		//setr instead of loadu, a Vector4 that was just built from scalars would otherwise stall on store forwarding
+		__m128 Load() const { return _mm_setr_ps(x, y, z, w); }
+		static Vector4 Store(__m128 v)
+		{
+			Vector4 out;
+			_mm_storeu_ps(&out.x, v);
+			return out;
+		}
+#endif
 	};
+
+	inline float Vector4::Magnitude() const
+	{
+		return std::sqrt(SqrMagnitude());
+	}
+
+	inline float Vector4::SqrMagnitude() const
+	{
+		return Dot(*this, *this);
+	}
+
+	inline float Vector4::Normalize()
+	{
+		const float m = Magnitude();
+		*this = *this * (1.f / m);
+
+		return m;
+	}
+
+	inline Vector4 Vector4::Normalized() const
+	{
+		return *this * (1.f / Magnitude());
+	}
+
+	inline float Vector4::Dot(const Vector4& v1, const Vector4& v2)
+	{
+#if defined(DAE_MATH_SSE)
+		return simd::Dot4(v1.Load(), v2.Load());
+#else
+		return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z + v1.w * v2.w;
+#endif
+	}
+
+#pragma region Operator Overloads
+	inline Vector4 Vector4::operator*(float scale) const
+	{
+#if defined(DAE_MATH_SSE)
+		return Store(_mm_mul_ps(Load(), _mm_set1_ps(scale)));
+#else
+		return { x * scale, y * scale, z * scale, w * scale };
+#endif
+	}
+
+	inline Vector4 Vector4::operator+(const Vector4& v) const
+	{
+#if defined(DAE_MATH_SSE)
+		return Store(_mm_add_ps(Load(), v.Load()));
+#else
+		return { x + v.x, y + v.y, z + v.z, w + v.w };
+#endif
+	}
+
+	inline Vector4 Vector4::operator-(const Vector4& v) const
+	{
+#if defined(DAE_MATH_SSE)
+		return Store(_mm_sub_ps(Load(), v.Load()));
+#else
+		return { x - v.x, y - v.y, z - v.z, w - v.w };
+#endif
+	}
+
+	inline Vector4& Vector4::operator+=(const Vector4& v)
+	{
+		*this = *this + v;
+		return *this;
+	}
+
+	inline float& Vector4::operator[](int index)
+	{
+		assert(index <= 3 && index >= 0);
+
+		if (index == 0)return x;
+		if (index == 1)return y;
+		if (index == 2)return z;
+		return w;
+	}
+
+	inline float Vector4::operator[](int index) const
+	{
+		assert(index <= 3 && index >= 0);
+
+		if (index == 0)return x;
+		if (index == 1)return y;
+		if (index == 2)return z;
+		return w;
+	}
+
+	inline bool Vector4::operator==(const Vector4& v) const
+	{
+		return AreEqual(x, v.x, .000001f) && AreEqual(y, v.y, .000001f) && AreEqual(z, v.z, .000001f) && AreEqual(w, v.w, .000001f);
+	}
+#pragma endregion
+}
+
+#include "Vector3.h"
+
+namespace dae
+{
+	inline Vector4::Vector4(const Vector3& v, float _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
 }
@@ -0,0 +1,462 @@
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+#include <cassert>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX__)
+#define WIDEBVH_AVX 1
+#endif
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define WIDEBVH_SSE 1
+#endif
+#if defined(WIDEBVH_SSE) || defined(WIDEBVH_AVX)
+#include <immintrin.h>
+#endif
+
+#include "BVH.h"
+#include "Vector3.h"
+
+namespace dae
+{
+	//Collapsed BVH node with Width children, the child bounds are stored SoA so all slabs can be tested at once
+	//Leaves are not separate nodes, a child slot with triangleCount > 0 references the triangles directly
+	template<uint32_t Width>
+	struct alignas(Width * sizeof(float)) WideBVHNode final
+	{
+		static constexpr uint32_t width{ Width };
+		static constexpr uint32_t maxDepth{ BVHNode::maxDepth }; //every wide level absorbs at least one binary one
+
+		//No user provided constructor, so emplace_back() value-initializes and the tail padding is zeroed too (the mesh cache stores the nodes as they are)
+		float minX[Width]{};
+		float minY[Width]{};
+		float minZ[Width]{};
+		float maxX[Width]{};
+		float maxY[Width]{};
+		float maxZ[Width]{};
+
+		uint32_t child[Width]{}; //child node index, or the first triangle for a leaf slot
+		uint32_t triangleCount[Width]{}; //0 for interior slots
+		uint32_t childCount{ 0 }; //slots [0, childCount) are in use
+
+		void SetChildBounds(uint32_t slot, const Vector3& bmin, const Vector3& bmax)
+		{
+			minX[slot] = bmin.x;
+			minY[slot] = bmin.y;
+			minZ[slot] = bmin.z;
+			maxX[slot] = bmax.x;
+			maxY[slot] = bmax.y;
+			maxZ[slot] = bmax.z;
+		}
+
+		//Builds the wide layout from a finished binary BVH (bvh[0] == root)
+		static void Collapse(std::vector<WideBVHNode>& wideBVH, std::vector<BVHNode>const& bvh)
+		{
+			wideBVH.clear();
+			if (bvh.empty())
+			{
+				return;
+			}
+
+			//Every wide node absorbs at least one binary interior node
+			wideBVH.reserve(bvh.size() / 2 + 1);
+			CollapseNode(wideBVH, bvh, 0);
+		}
+
+		//Writes the entry distance of every child slot to tEntry, returns a bitmask of the used slots that were hit
+		uint32_t Intersect(const Vector3& rayOrigin, const Vector3& rayInvDir, float rayMin, float rayMax, float* tEntry) const;
+
+	private:
+		static uint32_t CollapseNode(std::vector<WideBVHNode>& wideBVH, std::vector<BVHNode>const& bvh, uint32_t binaryIdx)
+		{
+			uint32_t const wideIdx{ static_cast<uint32_t>(wideBVH.size()) };
+			wideBVH.emplace_back();
+
+			uint32_t children[Width]{};
+			uint32_t childCount{ 0 };
+
+			BVHNode const& binaryNode{ bvh[binaryIdx] };
+			if (binaryNode.IsLeaf())
+			{
+				//Only happens for a root that was never split
+				children[childCount++] = binaryIdx;
+			}
+			else
+			{
+				children[childCount++] = binaryNode.leftFirst;
+				children[childCount++] = binaryNode.leftFirst + 1;
+			}
+
+			//Keep opening the interior child with the largest surface area until all slots are used
+			while (childCount < Width)
+			{
+				int bestSlot{ -1 };
+				float bestArea{ -1.f };
+				for (uint32_t i{ 0 }; i < childCount; ++i)
+				{
+					BVHNode const& c{ bvh[children[i]] };
+					if (c.IsLeaf())
+					{
+						continue;
+					}
+
+					AABB box{};
+					box.min = c.aabbMin;
+					box.max = c.aabbMax;
+					if (box.HalfArea() > bestArea)
+					{
+						bestArea = box.HalfArea();
+						bestSlot = static_cast<int>(i);
+					}
+				}
+
+				if (bestSlot < 0)
+				{
+					break;
+				}
+
+				uint32_t const opened{ children[bestSlot] };
+				children[bestSlot] = bvh[opened].leftFirst;
+				children[childCount++] = bvh[opened].leftFirst + 1;
+			}
+
+			for (uint32_t i{ 0 }; i < childCount; ++i)
+			{
+				BVHNode const& c{ bvh[children[i]] };
+
+				uint32_t childIdx{ c.leftFirst };
+				if (!c.IsLeaf())
+				{
+					//Recursing can reallocate wideBVH, so only index into it afterwards
+					childIdx = CollapseNode(wideBVH, bvh, children[i]);
+				}
+
+				WideBVHNode& node{ wideBVH[wideIdx] };
+				node.SetChildBounds(i, c.aabbMin, c.aabbMax);
+				node.child[i] = childIdx;
+				node.triangleCount[i] = c.triangleCount;
+			}
+
+			wideBVH[wideIdx].childCount = childCount;
+
+			return wideIdx;
+		}
+	};
+
+	template<uint32_t Width>
+	inline uint32_t WideBVHNode<Width>::Intersect(const Vector3& rayOrigin, const Vector3& rayInvDir, float rayMin, float rayMax, float* tEntry) const
+	{
+		uint32_t mask{ 0 };
+		for (uint32_t i{ 0 }; i < childCount; ++i)
+		{
+			float const tx1{ (minX[i] - rayOrigin.x) * rayInvDir.x };
+			float const tx2{ (maxX[i] - rayOrigin.x) * rayInvDir.x };
+			float const ty1{ (minY[i] - rayOrigin.y) * rayInvDir.y };
+			float const ty2{ (maxY[i] - rayOrigin.y) * rayInvDir.y };
+			float const tz1{ (minZ[i] - rayOrigin.z) * rayInvDir.z };
+			float const tz2{ (maxZ[i] - rayOrigin.z) * rayInvDir.z };
+
+			float const tmin{ std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), rayMin)) };
+			float const tmax{ std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), rayMax)) };
+
+			tEntry[i] = tmin;
+			if (tmin <= tmax)
+			{
+				mask |= 1u << i;
+			}
+		}
+
+		return mask;
+	}
+
+#if defined(WIDEBVH_SSE)
+	template<>
+	inline uint32_t WideBVHNode<4>::Intersect(const Vector3& rayOrigin, const Vector3& rayInvDir, float rayMin, float rayMax, float* tEntry) const
+	{
+		__m128 const ox{ _mm_set1_ps(rayOrigin.x) };
+		__m128 const oy{ _mm_set1_ps(rayOrigin.y) };
+		__m128 const oz{ _mm_set1_ps(rayOrigin.z) };
+		__m128 const idx{ _mm_set1_ps(rayInvDir.x) };
+		__m128 const idy{ _mm_set1_ps(rayInvDir.y) };
+		__m128 const idz{ _mm_set1_ps(rayInvDir.z) };
+
+		__m128 const tx1{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(minX), ox), idx) };
+		__m128 const tx2{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(maxX), ox), idx) };
+		__m128 const ty1{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(minY), oy), idy) };
+		__m128 const ty2{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(maxY), oy), idy) };
+		__m128 const tz1{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(minZ), oz), idz) };
+		__m128 const tz2{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(maxZ), oz), idz) };
+
+		__m128 const tmin{ _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)), _mm_max_ps(_mm_min_ps(tz1, tz2), _mm_set1_ps(rayMin))) };
+		__m128 const tmax{ _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_min_ps(_mm_max_ps(tz1, tz2), _mm_set1_ps(rayMax))) };
+
+		_mm_storeu_ps(tEntry, tmin);
+		return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tmin, tmax))) & ((1u << childCount) - 1);
+	}
+#endif
+
+#if defined(WIDEBVH_AVX)
+	template<>
+	inline uint32_t WideBVHNode<8>::Intersect(const Vector3& rayOrigin, const Vector3& rayInvDir, float rayMin, float rayMax, float* tEntry) const
+	{
+		__m256 const ox{ _mm256_set1_ps(rayOrigin.x) };
+		__m256 const oy{ _mm256_set1_ps(rayOrigin.y) };
+		__m256 const oz{ _mm256_set1_ps(rayOrigin.z) };
+		__m256 const idx{ _mm256_set1_ps(rayInvDir.x) };
+		__m256 const idy{ _mm256_set1_ps(rayInvDir.y) };
+		__m256 const idz{ _mm256_set1_ps(rayInvDir.z) };
+
+		__m256 const tx1{ _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(minX), ox), idx) };
+		__m256 const tx2{ _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(maxX), ox), idx) };
+		__m256 const ty1{ _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(minY), oy), idy) };
+		__m256 const ty2{ _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(maxY), oy), idy) };
+		__m256 const tz1{ _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(minZ), oz), idz) };
+		__m256 const tz2{ _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(maxZ), oz), idz) };
+
+		__m256 const tmin{ _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx1, tx2), _mm256_min_ps(ty1, ty2)), _mm256_max_ps(_mm256_min_ps(tz1, tz2), _mm256_set1_ps(rayMin))) };
+		__m256 const tmax{ _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx1, tx2), _mm256_max_ps(ty1, ty2)), _mm256_min_ps(_mm256_max_ps(tz1, tz2), _mm256_set1_ps(rayMax))) };
+
+		_mm256_storeu_ps(tEntry, tmin);
+		return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ))) & ((1u << childCount) - 1);
+	}
+#endif
+
+	using BVH4Node = WideBVHNode<4>;
+	using BVH8Node = WideBVHNode<8>;
+
+	//BVH4Node with the child bounds stored as 8 bit offsets from the node's own box, one cache line instead of 144 bytes
+	//Each axis uses a power of two step, so q * step is exact and decoding only rounds once in the final add
+	//Mins are rounded down and maxes up, a decoded box always contains the real one; rays may visit a few extra nodes, never miss one
+	struct alignas(64) QuantizedBVH4Node final
+	{
+		static constexpr uint32_t width{ 4 };
+		static constexpr uint32_t maxDepth{ BVHNode::maxDepth + 8 }; //split leaves add up to log4(2^32 / 2^16) levels
+
+		float origin[3]{}; //min corner of the union of the child boxes
+		int8_t exponent[3]{}; //step of an axis is 2^exponent
+		uint8_t childCount{ 0 }; //slots [0, childCount) are in use
+
+		uint8_t qMinX[4]{};
+		uint8_t qMinY[4]{};
+		uint8_t qMinZ[4]{};
+		uint8_t qMaxX[4]{};
+		uint8_t qMaxY[4]{};
+		uint8_t qMaxZ[4]{};
+
+		uint32_t child[4]{}; //child node index, or the first triangle for a leaf slot
+		uint16_t triangleCount[4]{}; //0 for interior slots
+
+		//Same topology and indices as the BVH4 it is made from, only the bounds change
+		//Leaves with more triangles than triangleCount can hold get extra nodes appended after the BVH4's ones
+		static void Compress(std::vector<QuantizedBVH4Node>& quantizedBVH, std::vector<BVH4Node>const& bvh4)
+		{
+			quantizedBVH.resize(bvh4.size());
+			for (size_t i{ 0 }; i < bvh4.size(); ++i)
+			{
+				quantizedBVH[i].CompressNode(bvh4[i]);
+
+				for (uint32_t slot{ 0 }; slot < bvh4[i].childCount; ++slot)
+				{
+					if (bvh4[i].triangleCount[slot] > UINT16_MAX)
+					{
+						//SplitLeaf appends to quantizedBVH, so it gets a copy of the node
+						QuantizedBVH4Node const parent{ quantizedBVH[i] };
+						uint32_t const splitIdx{ SplitLeaf(quantizedBVH, parent, slot, bvh4[i].child[slot], bvh4[i].triangleCount[slot]) };
+						quantizedBVH[i].child[slot] = splitIdx;
+						quantizedBVH[i].triangleCount[slot] = 0;
+					}
+				}
+			}
+		}
+
+		//Decoded bound of q on an axis, Intersect computes exactly the same value
+		float Decode(uint32_t axis, uint8_t q) const
+		{
+			return origin[axis] + static_cast<float>(q) * GetStep(exponent[axis]);
+		}
+
+		//Writes the entry distance of every child slot to tEntry, returns a bitmask of the used slots that were hit
+		uint32_t Intersect(const Vector3& rayOrigin, const Vector3& rayInvDir, float rayMin, float rayMax, float* tEntry) const;
+
+	private:
+		//Spreads the triangles of an oversized leaf over a node whose slots all reuse the leaf's box, recursing until every slot fits
+		//Such leaves only come from triangles the builder could not separate, so tighter boxes would not cull anything more
+		static uint32_t SplitLeaf(std::vector<QuantizedBVH4Node>& quantizedBVH, QuantizedBVH4Node const& parent, uint32_t parentSlot, uint32_t first, uint32_t count)
+		{
+			QuantizedBVH4Node node{};
+			std::copy(std::begin(parent.origin), std::end(parent.origin), node.origin);
+			std::copy(std::begin(parent.exponent), std::end(parent.exponent), node.exponent);
+
+			uint32_t const chunkSize{ (count + width - 1) / width };
+			for (uint32_t slot{ 0 }; slot < width && count > 0; ++slot)
+			{
+				uint32_t const chunkCount{ std::min(chunkSize, count) };
+
+				node.qMinX[slot] = parent.qMinX[parentSlot];
+				node.qMinY[slot] = parent.qMinY[parentSlot];
+				node.qMinZ[slot] = parent.qMinZ[parentSlot];
+				node.qMaxX[slot] = parent.qMaxX[parentSlot];
+				node.qMaxY[slot] = parent.qMaxY[parentSlot];
+				node.qMaxZ[slot] = parent.qMaxZ[parentSlot];
+
+				if (chunkCount > UINT16_MAX)
+				{
+					node.child[slot] = SplitLeaf(quantizedBVH, node, slot, first, chunkCount);
+				}
+				else
+				{
+					node.child[slot] = first;
+					node.triangleCount[slot] = static_cast<uint16_t>(chunkCount);
+				}
+
+				node.childCount = static_cast<uint8_t>(slot + 1);
+				first += chunkCount;
+				count -= chunkCount;
+			}
+
+			quantizedBVH.emplace_back(node);
+			return static_cast<uint32_t>(quantizedBVH.size() - 1);
+		}
+
+		//2^exponent built from its bits, exponent is kept in the normal float range
+		static float GetStep(int8_t exponent)
+		{
+			uint32_t const bits{ static_cast<uint32_t>(exponent + 127) << 23 };
+			float step{};
+			std::memcpy(&step, &bits, sizeof(float));
+			return step;
+		}
+
+		void CompressNode(const BVH4Node& node)
+		{
+			float const* const nodeMin[3]{ node.minX, node.minY, node.minZ };
+			float const* const nodeMax[3]{ node.maxX, node.maxY, node.maxZ };
+			uint8_t* const quantizedMin[3]{ qMinX, qMinY, qMinZ };
+			uint8_t* const quantizedMax[3]{ qMaxX, qMaxY, qMaxZ };
+
+			childCount = static_cast<uint8_t>(node.childCount);
+
+			for (uint32_t axis{ 0 }; axis < 3; ++axis)
+			{
+				float boxMin{ nodeMin[axis][0] };
+				float boxMax{ nodeMax[axis][0] };
+				for (uint32_t i{ 1 }; i < node.childCount; ++i)
+				{
+					boxMin = std::min(boxMin, nodeMin[axis][i]);
+					boxMax = std::max(boxMax, nodeMax[axis][i]);
+				}
+
+				//Smallest step where 255 steps still reach the max after rounding
+				int exp{ 0 };
+				std::frexp((boxMax - boxMin) / 255.f, &exp);
+				origin[axis] = boxMin;
+				exponent[axis] = static_cast<int8_t>(std::clamp(exp, -126, 127));
+				while (Decode(axis, 255) < boxMax && exponent[axis] < 127)
+				{
+					++exponent[axis];
+				}
+
+				float const step{ GetStep(exponent[axis]) };
+				for (uint32_t i{ 0 }; i < node.childCount; ++i)
+				{
+					float const low{ std::clamp(std::floor((nodeMin[axis][i] - boxMin) / step), 0.f, 255.f) };
+					float const high{ std::clamp(std::ceil((nodeMax[axis][i] - boxMin) / step), 0.f, 255.f) };
+
+					//The division rounds as well, step outwards until the decoded box covers the real one
+					uint8_t qMin{ static_cast<uint8_t>(low) };
+					uint8_t qMax{ static_cast<uint8_t>(high) };
+					while (qMin > 0 && Decode(axis, qMin) > nodeMin[axis][i])
+					{
+						--qMin;
+					}
+					while (qMax < 255 && Decode(axis, qMax) < nodeMax[axis][i])
+					{
+						++qMax;
+					}
+
+					quantizedMin[axis][i] = qMin;
+					quantizedMax[axis][i] = qMax;
+				}
+			}
+
+			//Counts that do not fit are replaced by Compress
+			for (uint32_t i{ 0 }; i < node.childCount; ++i)
+			{
+				child[i] = node.child[i];
+				triangleCount[i] = static_cast<uint16_t>(std::min(node.triangleCount[i], uint32_t{ UINT16_MAX }));
+			}
+		}
+	};
+
+	static_assert(sizeof(QuantizedBVH4Node) == 64, "QuantizedBVH4Node should fill exactly one cache line");
+
+	inline uint32_t QuantizedBVH4Node::Intersect(const Vector3& rayOrigin, const Vector3& rayInvDir, float rayMin, float rayMax, float* tEntry) const
+	{
+#if defined(WIDEBVH_SSE)
+		//Widens 4 bytes to 4 floats and decodes them, the unpacks keep this on plain SSE2
+		auto const decode = [](const uint8_t* q, __m128 nodeOrigin, __m128 step)
+		{
+			int32_t packed{};
+			std::memcpy(&packed, q, sizeof(int32_t));
+			__m128i const zero{ _mm_setzero_si128() };
+			__m128i const widened{ _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero) };
+			return _mm_add_ps(nodeOrigin, _mm_mul_ps(_mm_cvtepi32_ps(widened), step));
+		};
+
+		__m128 const originX{ _mm_set1_ps(origin[0]) };
+		__m128 const originY{ _mm_set1_ps(origin[1]) };
+		__m128 const originZ{ _mm_set1_ps(origin[2]) };
+		__m128 const stepX{ _mm_set1_ps(GetStep(exponent[0])) };
+		__m128 const stepY{ _mm_set1_ps(GetStep(exponent[1])) };
+		__m128 const stepZ{ _mm_set1_ps(GetStep(exponent[2])) };
+
+		__m128 const ox{ _mm_set1_ps(rayOrigin.x) };
+		__m128 const oy{ _mm_set1_ps(rayOrigin.y) };
+		__m128 const oz{ _mm_set1_ps(rayOrigin.z) };
+		__m128 const idx{ _mm_set1_ps(rayInvDir.x) };
+		__m128 const idy{ _mm_set1_ps(rayInvDir.y) };
+		__m128 const idz{ _mm_set1_ps(rayInvDir.z) };
+
+		__m128 const tx1{ _mm_mul_ps(_mm_sub_ps(decode(qMinX, originX, stepX), ox), idx) };
+		__m128 const tx2{ _mm_mul_ps(_mm_sub_ps(decode(qMaxX, originX, stepX), ox), idx) };
+		__m128 const ty1{ _mm_mul_ps(_mm_sub_ps(decode(qMinY, originY, stepY), oy), idy) };
+		__m128 const ty2{ _mm_mul_ps(_mm_sub_ps(decode(qMaxY, originY, stepY), oy), idy) };
+		__m128 const tz1{ _mm_mul_ps(_mm_sub_ps(decode(qMinZ, originZ, stepZ), oz), idz) };
+		__m128 const tz2{ _mm_mul_ps(_mm_sub_ps(decode(qMaxZ, originZ, stepZ), oz), idz) };
+
+		__m128 const tmin{ _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)), _mm_max_ps(_mm_min_ps(tz1, tz2), _mm_set1_ps(rayMin))) };
+		__m128 const tmax{ _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_min_ps(_mm_max_ps(tz1, tz2), _mm_set1_ps(rayMax))) };
+
+		_mm_storeu_ps(tEntry, tmin);
+		return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tmin, tmax))) & ((1u << childCount) - 1);
+#else
+		uint32_t mask{ 0 };
+		for (uint32_t i{ 0 }; i < childCount; ++i)
+		{
+			float const tx1{ (Decode(0, qMinX[i]) - rayOrigin.x) * rayInvDir.x };
+			float const tx2{ (Decode(0, qMaxX[i]) - rayOrigin.x) * rayInvDir.x };
+			float const ty1{ (Decode(1, qMinY[i]) - rayOrigin.y) * rayInvDir.y };
+			float const ty2{ (Decode(1, qMaxY[i]) - rayOrigin.y) * rayInvDir.y };
+			float const tz1{ (Decode(2, qMinZ[i]) - rayOrigin.z) * rayInvDir.z };
+			float const tz2{ (Decode(2, qMaxZ[i]) - rayOrigin.z) * rayInvDir.z };
+
+			float const tmin{ std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), rayMin)) };
+			float const tmax{ std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), rayMax)) };
+
+			tEntry[i] = tmin;
+			if (tmin <= tmax)
+			{
+				mask |= 1u << i;
+			}
+		}
+
+		return mask;
+#endif
+	}
+}
+
+#endif
@@ -59,6 +59,7 @@ int main(int argc, char* args[])
 
 	auto const pScene{ new Scene_W4_ReferenceScene{} };
 	//auto const pScene{ new Scene_W4_BunnyScene{} };
+	//auto const pScene{ new Scene_BunnyInstances{} };
 
 	//auto const pScene{ new Scene_Softshadows{} };
 
@@ -103,6 +104,7 @@ int main(int argc, char* args[])
 				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
 				{
 					pRenderer->CycleSampleMode();
+					std::cout << "Sample mode: " << pRenderer->GetSampleModeName() << std::endl;
 				}
 				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
 				{
@@ -112,6 +114,23 @@ int main(int argc, char* args[])
 				{
 					pRenderer->IncreaseSamples();
 				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+				{
+					pRenderer->PrintTileTimings();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+				{
+					pRenderer->ToggleProgressive();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+				{
+					pRenderer->ToggleAdaptiveSampling();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F10)
+				{
+					pRenderer->TogglePacketTracing();
+					std::cout << "Packet tracing: " << (pRenderer->IsPacketTracingEnabled() ? "on" : "off") << std::endl;
+				}
 
 				break;
 			}
@@ -134,7 +153,7 @@ int main(int argc, char* args[])
 		//Save screenshot after full render
 		if (takeScreenshot)
 		{
-			if (!pRenderer->SaveBufferToImage())
+			if (pRenderer->SaveBufferToImage())
 				std::cout << "Screenshot saved!" << std::endl;
 			else
 				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
@@ -156,6 +175,6 @@ void PrintInfo()
 {
 	std::cout << "Raytracer project Mauro Deryckere\n";
 	std::cout << "Keybinds: \n";
-	std::cout << "F1: Screenshot\nF2: Shadows on/off\nF3: Cycle light mode\nF4: Cycle sample mode\nF5: Decrease samples\nF6: Increase samples\n\n";
+	std::cout << "F1: Screenshot\nF2: Shadows on/off\nF3: Cycle light mode\nF4: Cycle sample mode\nF5: Decrease samples\nF6: Increase samples\nF7: Print tile timings\nF8: Progressive rendering on/off\nF9: Adaptive sampling on/off\nF10: Packet tracing on/off\n\n";
 	std::cout << "WASD: Move camera\nHold LMB and move: rotate camera\n\n";
 }
\ No newline at end of file
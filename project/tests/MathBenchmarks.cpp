@@ -0,0 +1,202 @@
+//Microbenchmarks for the math layer, built twice: once with the SIMD backend and once with DAE_MATH_SCALAR
+//Run both targets and compare the ns/ray of the primary ray benchmark to see the per ray gain in Renderer::Render
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../src/Maths.h"
+#include "../src/Scene.h"
+#include "../src/Utils.h"
+
+using namespace dae;
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	//Keeps the optimizer from removing the benchmarked work
+	volatile float g_Sink{};
+
+	template<typename Function>
+	double MeasureNanoseconds(uint32_t iterations, Function&& function)
+	{
+		auto const start{ Clock::now() };
+		function();
+		auto const end{ Clock::now() };
+
+		return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+	}
+
+	void Print(const char* name, double nanoseconds, const char* unit)
+	{
+		std::cout << "  " << name << ": " << nanoseconds << " ns/" << unit << "\n";
+	}
+
+	void BenchmarkTransforms()
+	{
+		constexpr uint32_t count{ 1 << 20 };
+
+		std::vector<Vector3> points(count);
+		for (uint32_t i{ 0 }; i < count; ++i)
+		{
+			points[i] = { static_cast<float>(i % 97), static_cast<float>(i % 89), static_cast<float>(i % 83) };
+		}
+
+		Matrix const transform{ Matrix::CreateScale(2.f, 2.f, 2.f) * Matrix::CreateRotationY(.7f) * Matrix::CreateTranslation(1.f, 2.f, 3.f) };
+
+		Print("Matrix::TransformPoint", MeasureNanoseconds(count, [&]()
+			{
+				float sum{ 0.f };
+				for (auto const& p : points)
+				{
+					sum += transform.TransformPoint(p).x;
+				}
+				g_Sink = sum;
+			}), "call");
+
+		Print("Matrix::TransformVector", MeasureNanoseconds(count, [&]()
+			{
+				float sum{ 0.f };
+				for (auto const& p : points)
+				{
+					sum += transform.TransformVector(p).y;
+				}
+				g_Sink = sum;
+			}), "call");
+
+		Print("Vector3::Dot + Cross", MeasureNanoseconds(count - 1, [&]()
+			{
+				float sum{ 0.f };
+				for (uint32_t i{ 1 }; i < count; ++i)
+				{
+					sum += Vector3::Dot(Vector3::Cross(points[i - 1], points[i]), points[i]);
+				}
+				g_Sink = sum;
+			}), "call");
+
+		Print("Vector4::Dot", MeasureNanoseconds(count - 1, [&]()
+			{
+				float sum{ 0.f };
+				for (uint32_t i{ 1 }; i < count; ++i)
+				{
+					sum += Vector4::Dot(points[i - 1].ToPoint4(), points[i].ToVector4());
+				}
+				g_Sink = sum;
+			}), "call");
+	}
+
+	//The old Random<T> stepped a thread_local mt19937, the render loop now seeds a PCG32 per sample
+	void BenchmarkRandom()
+	{
+		constexpr uint32_t count{ 1 << 22 };
+
+		Print("std::mt19937 + uniform_real_distribution", MeasureNanoseconds(count, [&]()
+			{
+				std::mt19937 generator{};
+				std::uniform_real_distribution<float> distribution{ 0.f, 1.f };
+
+				float sum{ 0.f };
+				for (uint32_t i{ 0 }; i < count; ++i)
+				{
+					sum += distribution(generator);
+				}
+				g_Sink = sum;
+			}), "draw");
+
+		Print("PCG32::NextFloat", MeasureNanoseconds(count, [&]()
+			{
+				PCG32 generator{ PCG32::ForSample(0, 0) };
+
+				float sum{ 0.f };
+				for (uint32_t i{ 0 }; i < count; ++i)
+				{
+					sum += generator.NextFloat();
+				}
+				g_Sink = sum;
+			}), "draw");
+
+		Print("PCG32::ForSample + 2 draws", MeasureNanoseconds(count, [&]()
+			{
+				float sum{ 0.f };
+				for (uint32_t i{ 0 }; i < count; ++i)
+				{
+					PCG32 generator{ PCG32::ForSample(i, 3) };
+					sum += generator.NextFloat() + generator.NextFloat();
+				}
+				g_Sink = sum;
+			}), "sample");
+	}
+
+	//Same ray setup as Renderer::Render, one primary ray per pixel plus a shadow ray per light
+	void BenchmarkPrimaryRays(Scene& scene, const char* name)
+	{
+		constexpr int width{ 640 };
+		constexpr int height{ 480 };
+
+		scene.Initialize();
+
+		Camera& camera{ scene.GetCamera() };
+		auto const& lights{ scene.GetLights() };
+
+		float const aspectRatio{ width / static_cast<float>(height) };
+		float const fov{ tan(camera.fovAngle * TO_RADIANS / 2) };
+		Matrix const cameraToWorld{ camera.CalculateCameraToWorld() };
+
+		Print(name, MeasureNanoseconds(width * height, [&]()
+			{
+				uint32_t hits{ 0 };
+				for (int py{ 0 }; py < height; ++py)
+				{
+					for (int px{ 0 }; px < width; ++px)
+					{
+						float const x{ ((2 * (px + .5f) / static_cast<float>(width) - 1) * aspectRatio * fov) };
+						float const y{ ((1 - 2 * (py + .5f) / static_cast<float>(height)) * fov) };
+
+						Vector3 const dirWorldSpace{ cameraToWorld.TransformVector(Vector3{ x, y, 1.f }).Normalized() };
+						Ray const viewRay{ cameraToWorld.GetTranslation(), dirWorldSpace };
+
+						HitRecord closestHit{};
+						scene.GetClosestHit(viewRay, closestHit);
+
+						if (!closestHit.didHit)
+						{
+							continue;
+						}
+
+						for (auto const& light : lights)
+						{
+							auto const dirToLight{ GetDirectionToLight(light, light.origin, closestHit.origin) };
+							Ray const shadowRay{ closestHit.origin, dirToLight.first, 0.001f, dirToLight.second };
+							hits += scene.DoesHit(shadowRay) ? 0 : 1;
+						}
+					}
+				}
+				g_Sink = static_cast<float>(hits);
+			}), "ray");
+	}
+}
+
+int main()
+{
+#if defined(DAE_MATH_SCALAR)
+	std::cout << "Math backend: scalar\n";
+#elif defined(DAE_MATH_FMA)
+	std::cout << "Math backend: SSE + FMA\n";
+#elif defined(DAE_MATH_SSE)
+	std::cout << "Math backend: SSE\n";
+#else
+	std::cout << "Math backend: scalar (no SSE target)\n";
+#endif
+
+	BenchmarkTransforms();
+	BenchmarkRandom();
+
+	Scene_W4_ReferenceScene referenceScene{};
+	BenchmarkPrimaryRays(referenceScene, "Primary + shadow rays (Reference Scene)");
+
+	Scene_W4_BunnyScene bunnyScene{};
+	BenchmarkPrimaryRays(bunnyScene, "Primary + shadow rays (Bunny Scene)");
+
+	return 0;
+}
@@ -2,6 +2,18 @@
 #include "../src/Vector3.h"
 #include "../src/Vector4.h"
 #include "../src/Matrix.h"
+#include "../src/DataTypes.h"
+#include "../src/Utils.h"
+#include "../src/TileScheduler.h"
+#include "../src/Sampling.h"
+#include "../src/RayPacket.h"
+#include "../src/PrimitiveBlocks.h"
+#include "../src/Scene.h"
+#include "../src/MeshCache.h"
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
 
 namespace dae
 {
@@ -37,6 +49,608 @@ namespace dae
 
 	// W1
 
+	// BVH
+	TEST(BVH, BinnedSAHCostBelowMidpoint) {
+		TriangleMesh midpointMesh{};
+		ASSERT_TRUE(Utils::ParseOBJ("resources/lowpoly_bunny.obj", midpointMesh));
+		midpointMesh.UpdateTransforms(true);
+
+		TriangleMesh sahMesh{ midpointMesh };
+
+		BVHBuildSettings midpointSettings{};
+		midpointSettings.splitMethod = BVHSplitMethod::Midpoint;
+		midpointMesh.InitializeBVH(midpointSettings);
+
+		BVHBuildSettings const sahSettings{};
+		sahMesh.InitializeBVH(sahSettings);
+
+		float const midpointCost{ BVHNode::CalculateSAHCost(midpointMesh.bvh, sahSettings) };
+		float const sahCost{ BVHNode::CalculateSAHCost(sahMesh.bvh, sahSettings) };
+
+		EXPECT_GT(midpointCost, 0.f);
+		EXPECT_LT(sahCost, midpointCost);
+	}
+
+	TEST(BVH, RefitFollowsTransforms) {
+		TriangleMesh mesh{};
+		ASSERT_TRUE(Utils::ParseOBJ("resources/lowpoly_bunny.obj", mesh));
+		mesh.UpdateAABB();
+		mesh.UpdateTransforms(true);
+		mesh.InitializeBVH();
+
+		mesh.Scale({ 2.f, 2.f, 2.f });
+		mesh.RotateY(PI_DIV_4);
+		mesh.UpdateTransforms();
+
+		Vector3 expectedMin{ mesh.transformedPositions[0] };
+		Vector3 expectedMax{ mesh.transformedPositions[0] };
+		for (auto const& p : mesh.transformedPositions)
+		{
+			expectedMin = Vector3::Min(expectedMin, p);
+			expectedMax = Vector3::Max(expectedMax, p);
+		}
+
+		EXPECT_EQ(expectedMin, mesh.bvh[0].aabbMin);
+		EXPECT_EQ(expectedMax, mesh.bvh[0].aabbMax);
+	}
+
+	TEST(BVH, ParallelBuildMatchesSerialBuild) {
+		//A grid big enough that several subtrees go to other threads
+		TriangleMesh serialMesh{};
+		constexpr int gridSize{ 120 };
+		for (int y{ 0 }; y <= gridSize; ++y)
+		{
+			for (int x{ 0 }; x <= gridSize; ++x)
+			{
+				serialMesh.positions.emplace_back(static_cast<float>(x), static_cast<float>(y), static_cast<float>((x * 7 + y * 3) % 5));
+			}
+		}
+		for (int y{ 0 }; y < gridSize; ++y)
+		{
+			for (int x{ 0 }; x < gridSize; ++x)
+			{
+				int const corner{ y * (gridSize + 1) + x };
+				serialMesh.indices.insert(serialMesh.indices.end(), { corner, corner + 1, corner + gridSize + 1, corner + 1, corner + gridSize + 2, corner + gridSize + 1 });
+			}
+		}
+		serialMesh.CalculateNormals();
+		serialMesh.UpdateAABB();
+		serialMesh.UpdateTransforms(true);
+
+		TriangleMesh parallelMesh{ serialMesh };
+
+		BVHBuildSettings settings{};
+		settings.threadCount = 1;
+		serialMesh.InitializeBVH(settings);
+		settings.threadCount = 8;
+		parallelMesh.InitializeBVH(settings);
+
+		EXPECT_LE(serialMesh.bvh.size(), serialMesh.indices.size() / 3 * 2 - 1);
+		EXPECT_EQ(serialMesh.indices, parallelMesh.indices);
+		ASSERT_EQ(serialMesh.bvh.size(), parallelMesh.bvh.size());
+		EXPECT_EQ(0, std::memcmp(serialMesh.bvh.data(), parallelMesh.bvh.data(), serialMesh.bvh.size() * sizeof(BVHNode)));
+	}
+
+	TEST(BVH, MortonBuildFindsSameHits) {
+		TriangleMesh mesh{};
+		ASSERT_TRUE(Utils::ParseOBJ("resources/lowpoly_bunny.obj", mesh));
+		mesh.UpdateAABB();
+		mesh.UpdateTransforms(true);
+
+		BVHBuildSettings settings{};
+		settings.splitMethod = BVHSplitMethod::Morton;
+		mesh.InitializeBVH(settings);
+
+		//Every triangle ends up in exactly one leaf, and every node encloses its children
+		std::vector<uint32_t> leafTriangles(mesh.normals.size(), 0);
+		for (auto const& node : mesh.bvh)
+		{
+			if (node.IsLeaf())
+			{
+				EXPECT_LE(node.triangleCount, settings.maxLeafSize);
+				for (uint32_t i{ 0 }; i < node.triangleCount; ++i)
+				{
+					++leafTriangles[node.leftFirst + i];
+				}
+				continue;
+			}
+
+			for (uint32_t child{ node.leftFirst }; child < node.leftFirst + 2; ++child)
+			{
+				EXPECT_EQ(node.aabbMin, Vector3::Min(node.aabbMin, mesh.bvh[child].aabbMin));
+				EXPECT_EQ(node.aabbMax, Vector3::Max(node.aabbMax, mesh.bvh[child].aabbMax));
+			}
+		}
+		EXPECT_EQ(std::vector<uint32_t>(mesh.normals.size(), 1), leafTriangles);
+
+		//Traversal agrees with testing every triangle
+		Vector3 const origin{ 0.f, 1.f, -10.f };
+		for (int y{ 0 }; y < 16; ++y)
+		{
+			for (int x{ 0 }; x < 16; ++x)
+			{
+				Vector3 const target{ -2.f + x * .25f, y * .2f, 0.f };
+				Ray const ray{ origin, (target - origin).Normalized() };
+
+				HitRecord bruteForce{};
+				HitRecord traversed{};
+				GeometryUtils::HitTest_TriangleMesh(mesh, ray, bruteForce);
+				GeometryUtils::HitTest_MeshBVH(ray, mesh, traversed);
+
+				EXPECT_EQ(bruteForce.didHit, traversed.didHit);
+				if (bruteForce.didHit)
+				{
+					EXPECT_FLOAT_EQ(bruteForce.t, traversed.t);
+				}
+			}
+		}
+	}
+
+	TEST(BVH, DepthStaysWithinTraversalStack) {
+		//Every triangle twice as far out as the previous one, a midpoint split only ever peels off the outermost
+		TriangleMesh mesh{};
+		constexpr int triangleCount{ 120 };
+		for (int i{ 0 }; i < triangleCount; ++i)
+		{
+			float const center{ std::ldexp(1.f, i) };
+			mesh.positions.insert(mesh.positions.end(), { { .75f * center, -.25f * center, 0.f }, { center, .25f * center, 0.f }, { 1.25f * center, -.25f * center, 0.f } });
+			mesh.indices.insert(mesh.indices.end(), { 3 * i, 3 * i + 1, 3 * i + 2 });
+		}
+		mesh.CalculateNormals();
+		mesh.UpdateAABB();
+		mesh.UpdateTransforms(true);
+
+		auto const getDepth{ [&mesh](auto const& self, uint32_t nodeIdx) -> uint32_t
+		{
+			BVHNode const& node{ mesh.bvh[nodeIdx] };
+			return node.IsLeaf() ? 0 : 1 + std::max(self(self, node.leftFirst), self(self, node.leftFirst + 1));
+		} };
+
+		for (BVHSplitMethod const splitMethod : { BVHSplitMethod::Midpoint, BVHSplitMethod::BinnedSAH, BVHSplitMethod::Morton })
+		{
+			for (BVHLayout const layout : { BVHLayout::Binary, BVHLayout::Wide4, BVHLayout::Quantized4 })
+			{
+				BVHBuildSettings settings{};
+				settings.splitMethod = splitMethod;
+				settings.layout = layout;
+				mesh.InitializeBVH(settings);
+				EXPECT_LE(getDepth(getDepth, 0), BVHNode::maxDepth);
+
+				for (int i{ 0 }; i < triangleCount; ++i)
+				{
+					float const center{ std::ldexp(1.f, i) };
+					Ray const ray{ { center, 0.f, -center }, Vector3::UnitZ };
+
+					HitRecord bruteForce{};
+					HitRecord traversed{};
+					GeometryUtils::HitTest_TriangleMesh(mesh, ray, bruteForce);
+					GeometryUtils::HitTest_MeshBVH(ray, mesh, traversed);
+					EXPECT_EQ(bruteForce.didHit, traversed.didHit) << i;
+					EXPECT_EQ(bruteForce.t, traversed.t) << i;
+				}
+			}
+		}
+	}
+
+	TEST(BVH, QuantizedNodesCoverFullBoxes) {
+		TriangleMesh mesh{};
+		ASSERT_TRUE(Utils::ParseOBJ("resources/lowpoly_bunny.obj", mesh));
+		mesh.UpdateAABB();
+		mesh.UpdateTransforms(true);
+
+		BVHBuildSettings settings{};
+		settings.layout = BVHLayout::Quantized4;
+		mesh.InitializeBVH(settings);
+		std::vector<BVH4Node> bvh4{};
+		BVH4Node::Collapse(bvh4, mesh.bvh);
+
+		//Same tree as the BVH4, every decoded box contains the full precision one
+		ASSERT_EQ(bvh4.size(), mesh.bvhQuantized4.size());
+		for (size_t n{ 0 }; n < bvh4.size(); ++n)
+		{
+			BVH4Node const& full{ bvh4[n] };
+			QuantizedBVH4Node const& quantized{ mesh.bvhQuantized4[n] };
+			ASSERT_EQ(full.childCount, quantized.childCount);
+			for (uint32_t i{ 0 }; i < full.childCount; ++i)
+			{
+				EXPECT_EQ(full.child[i], quantized.child[i]);
+				EXPECT_EQ(full.triangleCount[i], quantized.triangleCount[i]);
+				EXPECT_LE(quantized.Decode(0, quantized.qMinX[i]), full.minX[i]);
+				EXPECT_LE(quantized.Decode(1, quantized.qMinY[i]), full.minY[i]);
+				EXPECT_LE(quantized.Decode(2, quantized.qMinZ[i]), full.minZ[i]);
+				EXPECT_GE(quantized.Decode(0, quantized.qMaxX[i]), full.maxX[i]);
+				EXPECT_GE(quantized.Decode(1, quantized.qMaxY[i]), full.maxY[i]);
+				EXPECT_GE(quantized.Decode(2, quantized.qMaxZ[i]), full.maxZ[i]);
+			}
+		}
+
+		//Looser boxes change which nodes are visited, not the closest hit
+		Vector3 const origin{ 0.f, 1.f, -10.f };
+		for (int y{ 0 }; y < 16; ++y)
+		{
+			for (int x{ 0 }; x < 16; ++x)
+			{
+				Vector3 const target{ -2.f + x * .25f, y * .2f, 0.f };
+				Ray const ray{ origin, (target - origin).Normalized() };
+
+				HitRecord bruteForce{};
+				HitRecord traversed{};
+				GeometryUtils::HitTest_TriangleMesh(mesh, ray, bruteForce);
+				GeometryUtils::HitTest_MeshBVH(ray, mesh, traversed);
+
+				EXPECT_EQ(bruteForce.didHit, traversed.didHit);
+				if (bruteForce.didHit)
+				{
+					EXPECT_FLOAT_EQ(bruteForce.t, traversed.t);
+				}
+			}
+		}
+
+		//Triangles sharing one centroid can not be split, the leaf holding them is too big for a quantized slot
+		TriangleMesh stack{};
+		constexpr int stackSize{ 70000 };
+		for (int i{ 0 }; i < stackSize; ++i)
+		{
+			float const size{ 1.f + i * .001f };
+			stack.positions.insert(stack.positions.end(), { { -size, -size, 0.f }, { 2.f * size, -size, 0.f }, { -size, 2.f * size, 0.f } });
+			stack.indices.insert(stack.indices.end(), { 3 * i, 3 * i + 2, 3 * i + 1 });
+		}
+		stack.CalculateNormals();
+		stack.UpdateAABB();
+		stack.UpdateTransforms(true);
+		stack.InitializeBVH(settings);
+		ASSERT_GT(stack.bvh[0].triangleCount, uint32_t{ UINT16_MAX });
+
+		//Every triangle is still in exactly one leaf slot
+		std::vector<uint32_t> leafTriangles(stackSize, 0);
+		for (QuantizedBVH4Node const& node : stack.bvhQuantized4)
+		{
+			for (uint32_t i{ 0 }; i < node.childCount; ++i)
+			{
+				for (uint32_t t{ 0 }; t < node.triangleCount[i]; ++t)
+				{
+					++leafTriangles[node.child[i] + t];
+				}
+			}
+		}
+		EXPECT_EQ(std::vector<uint32_t>(stackSize, 1), leafTriangles);
+
+		//Far enough from the centroid that only the largest triangles are hit
+		Ray const ray{ { -60.f, -60.f, -1.f }, Vector3::UnitZ };
+		HitRecord bruteForce{};
+		HitRecord traversed{};
+		GeometryUtils::HitTest_TriangleMesh(stack, ray, bruteForce);
+		GeometryUtils::HitTest_MeshBVH(ray, stack, traversed);
+		ASSERT_TRUE(bruteForce.didHit);
+		EXPECT_TRUE(traversed.didHit);
+		EXPECT_FLOAT_EQ(bruteForce.t, traversed.t);
+	}
+
+	TEST(RayPacket, MatchesSingleRays) {
+		TriangleMesh mesh{};
+		ASSERT_TRUE(Utils::ParseOBJ("resources/lowpoly_bunny.obj", mesh));
+		mesh.UpdateAABB();
+		mesh.UpdateTransforms(true);
+
+		//Every layout for both closest and any hit, the wide and quantized ones are traced lane by lane
+		for (BVHLayout layout : { BVHLayout::Binary, BVHLayout::Wide4, BVHLayout::Wide8, BVHLayout::Quantized4 })
+		{
+			BVHBuildSettings settings{};
+			settings.layout = layout;
+			mesh.InitializeBVH(settings);
+
+			//A small grid of camera rays aimed at the bunny, some lanes hit and some miss
+			Vector3 const origin{ 0.f, 1.f, -10.f };
+			RayPacket<8> packet{};
+			for (int y{ 0 }; y < 16; ++y)
+			{
+				packet.Reset();
+				for (int x{ 0 }; x < 8; ++x)
+				{
+					Vector3 const target{ -1.f + x * .25f, y * .1f, 0.f };
+					packet.Add({ origin, (target - origin).Normalized() });
+				}
+				packet.Finalize();
+				GeometryUtils::HitTest_MeshBVH(mesh, packet);
+				uint32_t const occluded{ GeometryUtils::OcclusionTest_MeshBVH(mesh, packet, packet.GetLaneMask()) };
+
+				for (uint32_t i{ 0 }; i < packet.count; ++i)
+				{
+					HitRecord single{};
+					GeometryUtils::HitTest_MeshBVH(packet.GetRay(i), mesh, single);
+
+					EXPECT_EQ(GeometryUtils::HitTest_MeshBVH(packet.GetRay(i), mesh), (occluded & (1u << i)) != 0);
+					EXPECT_EQ(single.didHit, packet.hits[i].didHit);
+					if (single.didHit)
+					{
+						EXPECT_FLOAT_EQ(single.t, packet.hits[i].t);
+					}
+				}
+			}
+		}
+	}
+
+	TEST(RayPacket, SceneClosestHitsMatchSingleRays) {
+		Scene_W4_ReferenceScene scene{};
+		scene.Initialize();
+
+		//Rays fanning out from the camera position so lanes end on the spheres, the planes and the triangle meshes
+		Vector3 const origin{ 0.f, 3.f, -9.f };
+		for (int y{ 0 }; y < 12; ++y)
+		{
+			for (uint32_t count : { 3u, 8u })
+			{
+				RayPacket<8> packet{};
+				for (uint32_t x{ 0 }; x < count; ++x)
+				{
+					Vector3 const target{ -6.f + x * 1.6f, 8.f - y * .9f, 10.f };
+					packet.Add({ origin, (target - origin).Normalized() });
+				}
+				packet.Finalize();
+				scene.GetClosestHits(packet);
+
+				for (uint32_t i{ 0 }; i < packet.count; ++i)
+				{
+					HitRecord single{};
+					scene.GetClosestHit(packet.GetRay(i), single);
+
+					EXPECT_EQ(single.didHit, packet.hits[i].didHit);
+					if (single.didHit)
+					{
+						EXPECT_EQ(single.t, packet.hits[i].t);
+						EXPECT_EQ(single.materialIndex, packet.hits[i].materialIndex);
+					}
+				}
+			}
+		}
+	}
+
+	TEST(RayPacket, BatchedShadowRaysMatchSingleRays) {
+		Scene_W4_ReferenceScene scene{};
+		scene.Initialize();
+
+		//Rays from the floor to just below the ceiling, a mix of them is blocked by the spheres and the triangle meshes
+		Ray rays[32]{};
+		for (uint32_t i{ 0 }; i < 32; ++i)
+		{
+			Vector3 const origin{ -3.f + (i % 8) * .85f, .01f, -1.f + (i / 8) * .5f };
+			Vector3 const target{ -4.f + (i % 7) * 1.3f, 9.f, -2.f + (i % 3) * 1.5f };
+			Vector3 const toTarget{ target - origin };
+			rays[i] = Ray{ origin, toTarget.Normalized(), .001f, toTarget.Magnitude() };
+		}
+
+		for (uint32_t count : { 1u, 7u, 16u, 23u, 32u })
+		{
+			uint32_t const occluded{ scene.DoesHit(rays, count) };
+			EXPECT_EQ(0u, count < 32 ? occluded >> count : 0u);
+
+			for (uint32_t i{ 0 }; i < count; ++i)
+			{
+				EXPECT_EQ(scene.DoesHit(rays[i]), (occluded & (1u << i)) != 0) << "ray " << i;
+			}
+		}
+	}
+
+	TEST(PrimitiveBlocks, ClosestSlotMatchesScalarLoop) {
+		//6 of the 8 slots in use, overlapping spheres so the closest one changes from ray to ray
+		SphereBlock block{};
+		for (uint32_t i{ 0 }; i < 6; ++i)
+		{
+			block.Add({ { -2.5f + i, (i % 2) * .5f, 3.f + (i % 3) }, .8f + i * .1f, i });
+		}
+
+		for (int y{ 0 }; y < 8; ++y)
+		{
+			for (int x{ 0 }; x < 16; ++x)
+			{
+				Ray const ray{ { 0.f, 0.f, -5.f }, Vector3{ -.45f + x * .06f, -.2f + y * .06f, 1.f }.Normalized() };
+
+				HitRecord expected{};
+				for (uint32_t i{ 0 }; i < block.count; ++i)
+				{
+					HitRecord temp{};
+					if (GeometryUtils::HitTest_Sphere(block.Get(i), ray, temp) && temp.t < expected.t)
+					{
+						expected = temp;
+					}
+				}
+
+				float t[SphereBlock::width];
+				uint32_t const hitMask{ block.Intersect(ray, t) };
+				ASSERT_EQ(expected.didHit, hitMask != 0);
+				EXPECT_EQ(0u, hitMask >> block.count);
+				if (expected.didHit)
+				{
+					uint32_t const slot{ ClosestSlot(t, hitMask) };
+					EXPECT_EQ(expected.materialIndex, block.materialIndex[slot]);
+					EXPECT_EQ(expected.t, t[slot]);
+				}
+			}
+		}
+	}
+
+	TEST(OBJ, PolygonsAndFullFaceSyntax) {
+		{
+			std::ofstream file{ "obj_test_quad.obj" };
+			file << "# quad and a triangle with relative indices\r\n"
+				<< "v -1 0 1\nv 1 0 1\nv 1 0 -1\nv -1.5e0 0 -1\n"
+				<< "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+				<< "vn 0 1 0\n"
+				<< "f 1/1/1 2/2/1 3/3/1 4/4/1\r\n"
+				<< "f -4//-1 -2//-1 -1//-1 # comment\n";
+		}
+
+		TriangleMesh mesh{};
+		ASSERT_TRUE(Utils::ParseOBJ("obj_test_quad.obj", mesh));
+		std::remove("obj_test_quad.obj");
+
+		//The quad is split into a fan around its first corner
+		std::vector<int> const expectedIndices{ 0, 1, 2, 0, 2, 3, 0, 2, 3 };
+		EXPECT_EQ(expectedIndices, mesh.indices);
+		ASSERT_EQ(4u, mesh.positions.size());
+		EXPECT_EQ(Vector3(-1.5f, 0.f, -1.f), mesh.positions[3]);
+		EXPECT_EQ(3u, mesh.normals.size());
+
+		ASSERT_EQ(9u, mesh.uvs.size());
+		EXPECT_EQ(Vector3(1.f, 1.f, 0.f), mesh.uvs[4]);
+		EXPECT_EQ(Vector3(), mesh.uvs[6]); //The last face has no vt
+		ASSERT_EQ(9u, mesh.vertexNormals.size());
+		EXPECT_EQ(Vector3::UnitY, mesh.vertexNormals[8]);
+
+		//The fast path has to round exactly like strtof
+		for (const char* number : { "0.1", "-0.182683", "3.4028235e38", "1e-45", "16777217", "0.30000001192092896", "123456.789e-3" })
+		{
+			float parsed{};
+			Utils::OBJ::ParseFloat(number, number + std::strlen(number), parsed);
+			EXPECT_EQ(std::strtof(number, nullptr), parsed) << number;
+		}
+
+		//Indices without a matching vn, vt or v line are rejected instead of read past the end
+		for (const char* face : { "f 1//1 2//1 3//1\n", "f 1/1 2/1 3/1\n", "f 1 2 1099511627777\n" })
+		{
+			{
+				std::ofstream file{ "obj_test_invalid.obj" };
+				file << "v 0 0 0\nv 1 0 0\nv 0 1 0\n" << face;
+			}
+
+			TriangleMesh invalid{};
+			EXPECT_FALSE(Utils::ParseOBJ("obj_test_invalid.obj", invalid)) << face;
+			std::remove("obj_test_invalid.obj");
+		}
+	}
+
+	TEST(MeshCache, RoundTripMatchesBuiltMesh) {
+		BVHBuildSettings settings{};
+		settings.layout = BVHLayout::Wide4;
+
+		TriangleMesh built{};
+		built.Scale({ 2.f, 2.f, 2.f });
+		ASSERT_TRUE(Utils::ParseOBJ("resources/lowpoly_bunny.obj", built));
+		built.UpdateAABB();
+		built.UpdateTransforms(true);
+		built.InitializeBVH(settings);
+		ASSERT_TRUE(MeshCache::Write("bunny_test.meshcache", "resources/lowpoly_bunny.obj", built));
+
+		TriangleMesh cached{};
+		cached.Scale({ 2.f, 2.f, 2.f });
+		ASSERT_TRUE(MeshCache::Load("bunny_test.meshcache", "resources/lowpoly_bunny.obj", cached, settings));
+		EXPECT_EQ(built.positions, cached.positions);
+		EXPECT_EQ(built.indices, cached.indices);
+		EXPECT_EQ(built.transformedNormals, cached.transformedNormals);
+		ASSERT_EQ(built.triangles.size(), cached.triangles.size());
+		EXPECT_EQ(0, std::memcmp(built.triangles.data(), cached.triangles.data(), built.triangles.size() * sizeof(TriangleIntersectionData)));
+		ASSERT_EQ(built.bvh4.size(), cached.bvh4.size());
+		EXPECT_EQ(0, std::memcmp(built.bvh4.data(), cached.bvh4.data(), built.bvh4.size() * sizeof(BVH4Node)));
+		EXPECT_EQ(built.bvhBuildCost, cached.bvhBuildCost);
+
+		//Writing the loaded mesh again gives the same file, padding included
+		ASSERT_TRUE(MeshCache::Write("bunny_test_again.meshcache", "resources/lowpoly_bunny.obj", cached));
+		{
+			std::ifstream first{ "bunny_test.meshcache", std::ios::binary };
+			std::ifstream second{ "bunny_test_again.meshcache", std::ios::binary };
+			EXPECT_TRUE(std::equal(std::istreambuf_iterator<char>{ first }, std::istreambuf_iterator<char>{}, std::istreambuf_iterator<char>{ second }, std::istreambuf_iterator<char>{}));
+		}
+		std::remove("bunny_test_again.meshcache");
+
+		//A mesh placed differently can not use it
+		TriangleMesh moved{};
+		moved.Scale({ 3.f, 3.f, 3.f });
+		EXPECT_FALSE(MeshCache::Load("bunny_test.meshcache", "resources/lowpoly_bunny.obj", moved, settings));
+		EXPECT_TRUE(moved.positions.empty());
+
+		std::remove("bunny_test.meshcache");
+	}
+
+	TEST(TileScheduler, RunsEveryTaskOnce) {
+		TileScheduler scheduler{ 4 };
+		EXPECT_EQ(4u, scheduler.GetThreadCount());
+
+		constexpr uint32_t taskCount{ 300 };
+		std::vector<std::atomic<uint32_t>> runs(taskCount);
+
+		//Run twice to make sure the workers pick up a second batch
+		for (int pass{ 0 }; pass < 2; ++pass)
+		{
+			scheduler.Run(taskCount, [&](uint32_t task) { ++runs[task]; });
+		}
+
+		for (auto const& count : runs)
+		{
+			EXPECT_EQ(2u, count.load());
+		}
+		EXPECT_EQ(taskCount, scheduler.GetTaskTimes().size());
+	}
+
+	TEST(PCG32, DeterministicPerSampleAndInRange) {
+		PCG32 a{ PCG32::ForSample(1234, 7) };
+		PCG32 b{ PCG32::ForSample(1234, 7) };
+		PCG32 other{ PCG32::ForSample(1234, 8) };
+
+		bool differs{ false };
+		for (int i{ 0 }; i < 1000; ++i)
+		{
+			uint32_t const value{ a.NextUInt() };
+			EXPECT_EQ(value, b.NextUInt());
+			differs |= value != other.NextUInt();
+		}
+		EXPECT_TRUE(differs);
+
+		//Different ranges from the same generator must each be respected
+		for (int i{ 0 }; i < 1000; ++i)
+		{
+			float const unit{ a.Next(0.f, 1.f) };
+			EXPECT_GE(unit, 0.f);
+			EXPECT_LT(unit, 1.f);
+
+			float const wide{ a.Next(-5.f, 10.f) };
+			EXPECT_GE(wide, -5.f);
+			EXPECT_LT(wide, 10.f);
+
+			int const dice{ a.Next(1, 6) };
+			EXPECT_GE(dice, 1);
+			EXPECT_LE(dice, 6);
+		}
+	}
+
+	TEST(Sampling, ScrambledSobolIsStratified) {
+		//The first 2^k points of a (0, 2) sequence put exactly one point in every 1/2^k wide column and row, scrambling must keep that
+		constexpr uint32_t count{ 64 };
+		for (uint32_t seed : { 0u, 17u, 0xDEADBEEFu })
+		{
+			std::vector<int> columns(count, 0);
+			std::vector<int> rows(count, 0);
+			for (uint32_t i{ 0 }; i < count; ++i)
+			{
+				Vector3 const p{ Sampling::Sobol2D(i, seed) };
+				++columns[static_cast<uint32_t>(p.x * count)];
+				++rows[static_cast<uint32_t>(p.y * count)];
+			}
+
+			for (uint32_t i{ 0 }; i < count; ++i)
+			{
+				EXPECT_EQ(1, columns[i]);
+				EXPECT_EQ(1, rows[i]);
+			}
+		}
+	}
+
+	TEST(Sampling, BlueNoiseMaskIsPermutation) {
+		auto const& mask{ Sampling::BlueNoiseMask::Get() };
+		constexpr uint32_t size{ Sampling::BlueNoiseMask::size };
+
+		std::vector<bool> seen(size * size, false);
+		for (uint32_t y{ 0 }; y < size; ++y)
+		{
+			for (uint32_t x{ 0 }; x < size; ++x)
+			{
+				uint32_t const rank{ mask.GetRank(x, y) };
+				ASSERT_LT(rank, size * size);
+				EXPECT_FALSE(seen[rank]);
+				seen[rank] = true;
+			}
+		}
+	}
+
 	int main(int argc, char** argv) {
 		::testing::InitGoogleTest(&argc, argv);
 		return RUN_ALL_TESTS();